@@ -3,12 +3,25 @@
 #include <assert.h>
 #include "GPIO.h"
 #include "port.h"
-#include "CircularBuffer.h"
 #include "stdlib.h"
 
-#define BUFFER_SIZE 100
-#define TX_QUEUE_SIZE 100
-#define RX_QUEUE_SIZE 100
+#define TX_RING_SIZE 128 // PUSHR words queued by SPI_SendMessage. Power of 2
+#define RX_RING_SIZE 128 // Frames received while SPI_SendMessage runs. Power of 2
+#define TRANSACTION_QUEUE_LEN 8 // SPI_DeviceTransfer calls waiting for the bus. Power of 2
+#define SPI_MAX_DEVICES 6
+#define SPI_NO_DEVICE -1
+#define RING_COUNT(ring) ((uint16_t)((ring).head - (ring).tail)) // head and tail run free and wrap together
+#define SPI_CLOCK (__CORE_CLOCK__ >> 1) // Bus clock, hw_Init sets OUTDIV2 to 2
+#define SPI_DUMMY_FRAME 0xFF // Sent when SPI_Transfer has no tx buffer
+#define SPI_RSER_DEFAULT (SPI_RSER_RFDF_RE_MASK | SPI_RSER_EOQF_RE_MASK)
+
+// eDMA mode (SPI_0 only: SPI1 and SPI2 share one DMA request for TX and RX)
+#define SPI_DMA_TX_CHANNEL 0
+#define SPI_DMA_RX_CHANNEL 1 // Higher priority than TX, so RX is drained before the next frame is pushed
+#define SPI_DMA_TX_SOURCE 15 // DMAMUX source SPI0 Transmit
+#define SPI_DMA_RX_SOURCE 14 // DMAMUX source SPI0 Receive
+#define SPI_DMA_MAX_MAJOR_LOOP 32767 // CITER without channel linking
+#define SPI_DMA_MAX_SEGMENTS 8 // Scatter-gather TCDs per channel
 
 static void turnTheWheel(SPI_Instance_t instance);
 
@@ -18,31 +31,120 @@ __ISR__ SPI2_IRQHandler(void);
 static void SPI_IRQHandler(SPI_Instance_t instance);
 static void SPI_EOQFDispatcher(SPI_Instance_t instance);
 static void SPI_RFDFDispatcher(SPI_Instance_t instance);
+static void SPI_TransferIRQHandler(SPI_Instance_t instance);
+static void SPI_TransferFillTxFIFO(SPI_Instance_t instance);
+static void SPI_TransferDrainRxFIFO(SPI_Instance_t instance);
+static void SPI_TransferStart(SPI_Instance_t instance, uint32_t command, const void *tx, void *rx, size_t length, bool wide, SPI_onTransferCompleteCallback callback, bool batched);
+static void SPI_TransferEnd(SPI_Instance_t instance);
+static void SPI_DeviceDispatch(SPI_Instance_t instance);
+static uint32_t SPI_EncodeCTAR(SPI_BitsPerFrame_t bitsPerFrame, SPI_ClockConfig_t clockConfig, SPI_BitOrder_t bitOrder,
+                               uint8_t pcsToClockDelay, uint8_t clockDelayScaler, uint8_t delayAfterTransfer, uint32_t baudRate);
+__ISR__ DMA1_IRQHandler(void);
+static void SPI_DMAInit(void);
+
+// Same layout as a hardware TCD, so the eDMA can load it by itself (scatter-gather)
+typedef struct
+{
+  uint32_t SADDR;
+  int16_t SOFF;
+  uint16_t ATTR;
+  uint32_t NBYTES;
+  int32_t SLAST;
+  uint32_t DADDR;
+  int16_t DOFF;
+  uint16_t CITER;
+  int32_t DLAST_SGA;
+  uint16_t CSR;
+  uint16_t BITER;
+} SPI_DMATcd_t;
+
+static void SPI_DMALoadTCD(uint8_t channel, const SPI_DMATcd_t *tcd);
 
 //*Creates the array of spis and sets on the default value
 static SPI_Type *SPIs[] = SPI_BASE_ADDRS;
 
+// TX queue: frames already encoded as PUSHR words, so the ISR does one store per frame
+typedef struct
+{
+  uint32_t commands[TX_RING_SIZE];
+  volatile uint16_t head; // Only written by SPI_SendMessage
+  volatile uint16_t tail; // Only written by turnTheWheel
+} SPI_CommandRing_t;
+
+// RX queue: whole frames, up to 16 bits
 typedef struct
 {
+  uint16_t frames[RX_RING_SIZE];
+  volatile uint16_t head; // Only written by the ISR
+  volatile uint16_t tail; // Only written by SPI_ReceiveMessage
+} SPI_FrameRing_t;
+
+// State of the SPI_Transfer in progress
+typedef struct
+{
+  const void *tx; // uint8_t frames, or uint16_t when wide
+  void *rx;
+  bool wide; // Frames of more than 8 bits
+  size_t length;
+  size_t txIndex; // Frames already pushed to the TX FIFO
+  size_t rxIndex; // Frames already popped from the RX FIFO
+  uint32_t command; // PUSHR bits shared by every frame (PCS and CTAS)
+  SPI_onTransferCompleteCallback callback;
+  volatile bool active;
+} SPI_TransferHandle;
+
+// A device registered with SPI_AddDevice
+typedef struct
+{
+  SPI_Instance_t instance;
   SPI_PCSignal_t pcsSignal;
-  bool eoq;
-  uint16_t message;
-} SPI_Data_t;
+  uint32_t ctar; // Encoded once when the device is added
+  bool wide;
+} SPI_Device_t;
+
+typedef struct
+{
+  int8_t device;
+  const void *tx;
+  void *rx;
+  size_t length;
+  SPI_onTransferCompleteCallback callback;
+} SPI_Transaction_t;
 
 typedef struct
 {
   uint8_t fifoSize; /*!< FIFO dataSize.*/
 
-  CircularBuffer_t txCircularBuffer;
-  CircularBuffer_t rxCircularBuffer;
-  uint32_t transmitBuffer[TX_QUEUE_SIZE]; // Buffer for tx
-  uint16_t recieveBuffer[RX_QUEUE_SIZE];  // Buffer for rx
-  volatile bool communicationFinished;    /*!< A number of bytes remaining to send.*/
+  SPI_CommandRing_t txRing;
+  SPI_FrameRing_t rxRing;
+  volatile bool communicationFinished;    /*!< SPI_SendMessage frames are all out, including the ones in the hardware FIFO*/
   size_t totalByteCount;                  /*!< A number of transfer bytes*/
+  SPI_CTAR_t CTARUsed;                    /*!< CTAR written by SPI_MasterInit*/
+  SPI_TransferHandle transfer;
+
+  //* Bus manager: SPI_DeviceTransfer calls waiting for the bus
+  SPI_Transaction_t transactions[TRANSACTION_QUEUE_LEN];
+  volatile uint8_t transactionHead, transactionTail;
+  int8_t currentDevice; // Device of the transfer in progress, SPI_NO_DEVICE for SPI_Transfer
+  int8_t deviceCTAROwner; // Device whose attributes are in the CTAR that SPI_MasterInit doesn't use
 
 } SPI_MasterHandle;
 
-SPI_MasterHandle SPI_Handlers[FSL_FEATURE_SOC_DSPI_COUNT] = {{.fifoSize = 4}, {.fifoSize = 1}, {.fifoSize = 1}};
+SPI_MasterHandle SPI_Handlers[FSL_FEATURE_SOC_DSPI_COUNT] = {
+    {.fifoSize = 4, .communicationFinished = true, .currentDevice = SPI_NO_DEVICE, .deviceCTAROwner = SPI_NO_DEVICE},
+    {.fifoSize = 1, .communicationFinished = true, .currentDevice = SPI_NO_DEVICE, .deviceCTAROwner = SPI_NO_DEVICE},
+    {.fifoSize = 1, .communicationFinished = true, .currentDevice = SPI_NO_DEVICE, .deviceCTAROwner = SPI_NO_DEVICE}};
+
+static SPI_Device_t devices[SPI_MAX_DEVICES];
+static uint8_t devicesCount;
+
+// SPI0 PCS0..PCS3 are PTD0, PTD4, PTD5 and PTD6 (ALT2)
+static const uint8_t spi0PCSPins[] = {0, 4, 5, 6};
+
+// The eDMA only loads TCDs aligned to 32 bytes
+static SPI_DMATcd_t txTCDs[SPI_DMA_MAX_SEGMENTS] __attribute__((aligned(32)));
+static SPI_DMATcd_t rxTCDs[SPI_DMA_MAX_SEGMENTS] __attribute__((aligned(32)));
+static uint8_t rxDummy; // Destination of the received frames when there is no rx buffer
 
 // Declaring the data structure of a baud rate setting
 typedef struct
@@ -95,22 +197,10 @@ void SPI_MasterInit(SPI_Instance_t n, SPI_MasterConfig_t *config)
   //* Check if in the actual config the master is enabled
   if (config->enableMaster)
   {
-    baud_rate_cfg_t baudrateConfiguration = computeBaudRateSettings(config->baudRate);
+    SPI_Handlers[n].CTARUsed = config->CTARUsed;
     //* Sets the clock and transfer attributes register (CTAR ON MASTER MODE) selected on config
-    SPIs[n]->CTAR[config->CTARUsed] =
-        SPI_CTAR_FMSZ(config->bitsPerFrame) |
-        SPI_CTAR_CPOL(config->clockConfig.clockPolarity) |
-        SPI_CTAR_CPHA(config->clockConfig.clockPhase) |
-        SPI_CTAR_LSBFE(config->bitOrder) |
-        SPI_CTAR_PCSSCK(3) | //* This function configures the PCS to SCK delay pre-scalar
-        SPI_CTAR_CSSCK(4) | //* PCS to SCK Delay Scaler: then t_CSC = (1/fP ) x PCSSCK x CSSCK. (page 1513 ref manual)
-        SPI_CTAR_PASC(1) |                        //* This function configures the after SCK delay delay pre-scalar
-        SPI_CTAR_ASC(config->clockDelayScaler) |  //*After SCK Delay Scaler: tASC = (1/fP) x PASC x ASC (page 1513 ref manual)
-        SPI_CTAR_PDT(7) |                         //*This function configures delayAfterTransferPreScale (PDT) 3 means 11 wich represent that the Delay after Transfer Prescaler value is 7.
-        SPI_CTAR_DT(config->delayAfterTransfer) | //*Delay After Transfer Scaler: tDT = (1/fP ) x PDT x DT
-        SPI_CTAR_DBR(baudrateConfiguration.DBR) | //* Double Baud Rate, Doubles the effective baud rate of the Serial Communications Clock
-        SPI_CTAR_PBR(baudrateConfiguration.PBR) | //* Sets the SCK Duty Cycle on 50/50
-        SPI_CTAR_BR(baudrateConfiguration.BR);    //* Baud Rate Scaler: SCK baud rate = (fP /PBR) x [(1+DBR)/BR]
+    SPIs[n]->CTAR[config->CTARUsed] = SPI_EncodeCTAR(config->bitsPerFrame, config->clockConfig, config->bitOrder, 4,
+                                                     config->clockDelayScaler, config->delayAfterTransfer, config->baudRate);
   }
 
   ///////////////////////////////////////////////////////////////////////
@@ -145,9 +235,7 @@ void SPI_MasterInit(SPI_Instance_t n, SPI_MasterConfig_t *config)
       SPI_SR_RFOF(1) |
       SPI_SR_RFDF(1);
   //* DMA/Interrupt Request Select and Enable Register (SPIx_RSER)
-  SPIs[n]->RSER =
-      SPI_RSER_RFDF_RE(1) |
-      SPI_RSER_EOQF_RE(1);
+  SPIs[n]->RSER = SPI_RSER_DEFAULT;
   ///////////////////////////////////////////////////////////////////////
   //*				   Output Config
   ///////////////////////////////////////////////////////////////////////
@@ -165,116 +253,242 @@ void SPI_MasterInit(SPI_Instance_t n, SPI_MasterConfig_t *config)
 
   SPIs[n]->MCR = (SPIs[n]->MCR & ~SPI_MCR_MDIS_MASK) | SPI_MCR_MDIS(0);
 
-  SPI_Handlers[n].txCircularBuffer = newCircularBuffer(SPI_Handlers[n].transmitBuffer, BUFFER_SIZE, sizeof(uint8_t));
-  SPI_Handlers[n].rxCircularBuffer = newCircularBuffer(SPI_Handlers[n].recieveBuffer, BUFFER_SIZE, sizeof(uint8_t));
+  SPI_Handlers[n].txRing.head = SPI_Handlers[n].txRing.tail = 0;
+  SPI_Handlers[n].rxRing.head = SPI_Handlers[n].rxRing.tail = 0;
+  SPI_Handlers[n].communicationFinished = true;
 }
 
 uint8_t spi_transaction(uint8_t *data_ptr, uint8_t len, uint8_t *recieve_ptr)
 {
-  uint32_t pushr_data = 0;
-  uint8_t data_i = 0;
-  uint8_t send_i = 0;
+  if (!SPI_Transfer(SPI_0, SPI_PCS_0, data_ptr, recieve_ptr, len, NULL))
+    return 0;
 
-  while (send_i < len)
+  while (SPI_Handlers[SPI_0].transfer.active)
   {
-    //Datos intermedios
-    if (send_i < len - 1)
-    {
-      pushr_data = SPI_PUSHR_PCS(1) | SPI_PUSHR_CONT(1) | SPI_PUSHR_TXDATA(data_ptr[send_i]);
-    }
-    //Ultimo dato
-    else
-    {
-      pushr_data = SPI_PUSHR_PCS(1) | SPI_PUSHR_CONT(0) | SPI_PUSHR_EOQ(1) | SPI_PUSHR_TXDATA(data_ptr[send_i]);
-    }
+    //Wait until the interrupt finishes the transfer
+  }
+  return 1;
+}
 
-    SPI0->MCR |= SPI_MCR_HALT(1);  //Halt transfers
-    SPI0->SR |= SPI_SR_TCF(1);     //TCF reset
-    SPI0->PUSHR = pushr_data;      //Write to PUSHR
-    SPI0->MCR &= ~SPI_MCR_HALT(1); //Start transfers
+bool SPI_Transfer(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint8_t *tx, uint8_t *rx, size_t length, SPI_onTransferCompleteCallback callback)
+{
+  SPI_MasterHandle *handle = &SPI_Handlers[instance];
+  SPI_TransferHandle *transfer = &handle->transfer;
+  bool started = false;
 
-    while (!(SPI0->SR & SPI_SR_TCF_MASK))
-    {
-      //Wait until transfer is done
-    }
-    SPI0->SR |= SPI_SR_TCF(1); //TCF reset
+  if (length == 0)
+    return false;
 
-    while ((SPI0->SR & SPI_SR_RXCTR_MASK) >> SPI_SR_RXCTR_SHIFT)
-    { //RXCTR counts valid entries on RX FIFO
-      if (recieve_ptr)
-      {
-        recieve_ptr[data_i] = SPI0->POPR; //Store recieved data on provided buffer
-      }
-      else
-      {
-        SPI0->POPR; //Discard recieved data
-      }
-      data_i++;
-    }
-    send_i++;
+  //* Only one transfer at a time, and never mixed with the SPI_SendMessage queue.
+  //* The interrupts also start transfers from the device queue
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (!transfer->active && handle->communicationFinished)
+  {
+    handle->currentDevice = SPI_NO_DEVICE;
+    SPI_TransferStart(instance, SPI_PUSHR_PCS(1 << pcsSignal) | SPI_PUSHR_CTAS(handle->CTARUsed), tx, rx, length, false, callback, false);
+    started = true;
   }
-  return (data_i != 0);
+  __set_PRIMASK(primask);
+  return started;
 }
 
-bool SPI_SendMessage(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint16_t messageToSend[], size_t messageLength, bool onlyRead)
+int SPI_AddDevice(SPI_Instance_t instance, const SPI_DeviceConfig_t *config)
+{
+  if (devicesCount == SPI_MAX_DEVICES || (instance == SPI_0 && config->pcsSignal >= sizeof(spi0PCSPins)))
+    return SPI_NO_DEVICE;
+
+  SPI_Device_t *device = &devices[devicesCount];
+  device->instance = instance;
+  device->pcsSignal = config->pcsSignal;
+  device->wide = config->bitsPerFrame > SPI_eightBitsFrame;
+  device->ctar = SPI_EncodeCTAR(config->bitsPerFrame, config->clockConfig, config->bitOrder, config->pcsToClockDelay,
+                                config->clockDelayScaler, config->delayAfterTransfer, config->baudRate);
+
+  //* SPI_MasterInit only sets up PCS0
+  if (instance == SPI_0)
+  {
+    PORT_Config portConfig;
+    PORT_GetPinDefaultConfig(&portConfig);
+    portConfig.ds = 1;
+    PORT_PinConfig(PORT_D, spi0PCSPins[config->pcsSignal], &portConfig, PORT_MuxAlt2);
+  }
+
+  return devicesCount++;
+}
+
+bool SPI_DeviceTransfer(int deviceID, const void *tx, void *rx, size_t length, SPI_onTransferCompleteCallback callback)
 {
-  /*1. Check available space in the buffer*/
-  if (numberOfElementsLeft(&(SPI_Handlers[instance].txCircularBuffer)) < messageLength)
+  if (deviceID < 0 || deviceID >= devicesCount || length == 0)
     return false;
 
-  /*2.Push the message to the circular buffer. If only read is needed -> Send any character as trash*/
+  SPI_MasterHandle *handle = &SPI_Handlers[devices[deviceID].instance];
+  bool queued = false;
 
-  if (onlyRead)
+  //* The queue is also emptied from the SPI and DMA interrupts
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if ((uint8_t)(handle->transactionHead - handle->transactionTail) < TRANSACTION_QUEUE_LEN)
   {
-    for (int i = 0; i < messageLength; i++)
-    {
-      push(&(SPI_Handlers[instance].txCircularBuffer), 'a'); //Trash
-    }
+    SPI_Transaction_t *transaction = &handle->transactions[handle->transactionHead & (TRANSACTION_QUEUE_LEN - 1)];
+    transaction->device = deviceID;
+    transaction->tx = tx;
+    transaction->rx = rx;
+    transaction->length = length;
+    transaction->callback = callback;
+    handle->transactionHead++;
+    SPI_DeviceDispatch(devices[deviceID].instance);
+    queued = true;
   }
-  else
+  __set_PRIMASK(primask);
+  return queued;
+}
+
+void SPI_BuildCommands(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint8_t *tx, uint32_t *commands, size_t length)
+{
+  uint32_t command = SPI_PUSHR_PCS(1 << pcsSignal) | SPI_PUSHR_CTAS(SPI_Handlers[instance].CTARUsed) | SPI_PUSHR_CONT_MASK;
+
+  for (size_t i = 0; i < length; i++)
+    commands[i] = command | SPI_PUSHR_TXDATA(tx != NULL ? tx[i] : SPI_DUMMY_FRAME);
+
+  //* The last frame releases PCS and ends the queue
+  if (length > 0)
+    commands[length - 1] = (commands[length - 1] & ~SPI_PUSHR_CONT_MASK) | SPI_PUSHR_EOQ_MASK;
+}
+
+bool SPI_TransferDMA(SPI_Instance_t instance, const uint32_t *commands, uint8_t *rx, size_t length, SPI_onTransferCompleteCallback callback)
+{
+  SPI_MasterHandle *handle = &SPI_Handlers[instance];
+  size_t segments = (length + SPI_DMA_MAX_MAJOR_LOOP - 1) / SPI_DMA_MAX_MAJOR_LOOP;
+
+  if (instance != SPI_0 || length == 0 || segments > SPI_DMA_MAX_SEGMENTS)
+    return false;
+
+  //* Claim the bus with the interrupts masked, as SPI_Transfer does
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (handle->transfer.active || !handle->communicationFinished)
   {
-    int untilFifoSizeCounter = 0; //Counter that reinitiates when it equals fifoSize. Function: send an "eoq" when this happens.
-    for (int i = 0; i < messageLength; i++)
-    {
-      bool reachedFifoSize = false; //untilFifoSizeCounter reached fifoSize.
-      bool eoq = false;             //eoq flag to send.
+    __set_PRIMASK(primask);
+    return false;
+  }
+  handle->currentDevice = SPI_NO_DEVICE;
+  handle->transfer.length = length;
+  handle->transfer.callback = callback;
+  handle->transfer.active = true;
+  __set_PRIMASK(primask);
 
-      if (++untilFifoSizeCounter == SPI_Handlers[instance].fifoSize)
-      {
-        reachedFifoSize = true;
-        untilFifoSizeCounter = 0; //Reinitiates counter.
-      }
+  SPI_DMAInit();
+
+  ///////////////////////////////////////////////////////////////////////
+  //*		One TCD per major loop, chained with scatter-gather
+  ///////////////////////////////////////////////////////////////////////
+  for (size_t i = 0; i < segments; i++)
+  {
+    size_t offset = i * SPI_DMA_MAX_MAJOR_LOOP;
+    uint16_t count = (length - offset) > SPI_DMA_MAX_MAJOR_LOOP ? SPI_DMA_MAX_MAJOR_LOOP : (length - offset);
+    bool last = (i == segments - 1);
+
+    //* TX: one 32 bit PUSHR command word per request
+    txTCDs[i].SADDR = (uint32_t)&commands[offset];
+    txTCDs[i].SOFF = sizeof(uint32_t);
+    txTCDs[i].ATTR = DMA_ATTR_SSIZE(2) | DMA_ATTR_DSIZE(2);
+    txTCDs[i].NBYTES = sizeof(uint32_t);
+    txTCDs[i].SLAST = 0;
+    txTCDs[i].DADDR = (uint32_t)&SPIs[instance]->PUSHR;
+    txTCDs[i].DOFF = 0;
+    txTCDs[i].CITER = txTCDs[i].BITER = DMA_CITER_ELINKNO_CITER(count);
+    txTCDs[i].DLAST_SGA = last ? 0 : (int32_t)&txTCDs[i + 1];
+    txTCDs[i].CSR = last ? DMA_CSR_DREQ_MASK : DMA_CSR_ESG_MASK;
+
+    //* RX: the low byte of POPR per request. Interrupt when the last frame arrives
+    rxTCDs[i].SADDR = (uint32_t)&SPIs[instance]->POPR;
+    rxTCDs[i].SOFF = 0;
+    rxTCDs[i].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+    rxTCDs[i].NBYTES = sizeof(uint8_t);
+    rxTCDs[i].SLAST = 0;
+    rxTCDs[i].DADDR = rx != NULL ? (uint32_t)&rx[offset] : (uint32_t)&rxDummy;
+    rxTCDs[i].DOFF = rx != NULL ? sizeof(uint8_t) : 0;
+    rxTCDs[i].CITER = rxTCDs[i].BITER = DMA_CITER_ELINKNO_CITER(count);
+    rxTCDs[i].DLAST_SGA = last ? 0 : (int32_t)&rxTCDs[i + 1];
+    rxTCDs[i].CSR = last ? (DMA_CSR_DREQ_MASK | DMA_CSR_INTMAJOR_MASK) : DMA_CSR_ESG_MASK;
+  }
 
-      if (i == messageLength - 1 || reachedFifoSize) //The message ends or untilFifoSizeCounter reached fifoSize.
-        eoq = true;
+  SPI_DMALoadTCD(SPI_DMA_TX_CHANNEL, &txTCDs[0]);
+  SPI_DMALoadTCD(SPI_DMA_RX_CHANNEL, &rxTCDs[0]);
 
-      SPI_Data_t sendingData = {
-          .message = messageToSend[i],
-          .pcsSignal = pcsSignal,
-          .eoq = eoq};
+  //* Empty FIFOs and TFFF/RFDF routed to the eDMA instead of the interrupt
+  SPIs[instance]->MCR |= SPI_MCR_HALT_MASK | SPI_MCR_CLR_TXF_MASK | SPI_MCR_CLR_RXF_MASK;
+  SPIs[instance]->SR = SPI_SR_EOQF_MASK | SPI_SR_TCF_MASK | SPI_SR_TFUF_MASK | SPI_SR_TFFF_MASK | SPI_SR_RFOF_MASK | SPI_SR_RFDF_MASK;
+  SPIs[instance]->RSER = SPI_RSER_TFFF_RE_MASK | SPI_RSER_TFFF_DIRS_MASK | SPI_RSER_RFDF_RE_MASK | SPI_RSER_RFDF_DIRS_MASK;
 
-      push(&SPI_Handlers[instance].txCircularBuffer, (void *)&sendingData);
-    }
+  DMA0->SERQ = DMA_SERQ_SERQ(SPI_DMA_RX_CHANNEL);
+  DMA0->SERQ = DMA_SERQ_SERQ(SPI_DMA_TX_CHANNEL);
+  SPIs[instance]->MCR &= ~SPI_MCR_HALT_MASK;
+  return true;
+}
+
+bool SPI_SendMessage(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint16_t messageToSend[], size_t messageLength, bool onlyRead)
+{
+  SPI_MasterHandle *handle = &SPI_Handlers[instance];
+  SPI_CommandRing_t *ring = &handle->txRing;
+
+  /*1. Check available space in the buffer. The bus is claimed with the interrupts masked, as SPI_Transfer does,
+       so a transfer started from the device queue can't get in between the check and the start*/
+  uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (messageLength == 0 || handle->transfer.active || TX_RING_SIZE - RING_COUNT(*ring) < messageLength)
+  {
+    __set_PRIMASK(primask);
+    return false;
   }
 
-  /*3. Start the transmission*/
+  /*2. Encode every frame as its PUSHR word. If only read is needed -> Send dummy frames*/
+  uint32_t command = SPI_PUSHR_CONT(1) | SPI_PUSHR_CTAS(handle->CTARUsed) | SPI_PUSHR_CTCNT(1) | SPI_PUSHR_PCS(1 << pcsSignal);
+  uint16_t head = ring->head;
+
+  for (size_t i = 0; i < messageLength; i++)
+  {
+    //* eoq when the message ends or every fifoSize frames, so EOQF refills the FIFO
+    bool eoq = (i == messageLength - 1) || ((i + 1) % handle->fifoSize == 0);
+    uint16_t frame = onlyRead ? SPI_DUMMY_FRAME : messageToSend[i];
+
+    ring->commands[head & (TX_RING_SIZE - 1)] = command | SPI_PUSHR_EOQ(eoq) | SPI_PUSHR_TXDATA(frame);
+    head++;
+  }
+  ring->head = head; //Publish the frames once they are all written
+
+  /*3. Start the transmission. The ISR also pops from the ring*/
+  handle->communicationFinished = false; //Until the EOQF of the last frame, SPI_Transfer has to wait
+  handle->currentDevice = SPI_NO_DEVICE; //The next device transfer can't be batched after this message
   turnTheWheel(instance);
   SPIs[instance]->MCR = (SPIs[instance]->MCR & ~SPI_MCR_HALT_MASK) | SPI_MCR_HALT(0);
+  __set_PRIMASK(primask);
   return true;
 }
 
-static void turnTheWheel(SPI_Instance_t instance)
+size_t SPI_ReceiveMessage(SPI_Instance_t instance, uint16_t message[], size_t maxLength)
 {
-  while ((SPIs[instance]->SR & SPI_SR_TFFF_MASK) && !isEmpty(&SPI_Handlers[instance].txCircularBuffer))
+  SPI_FrameRing_t *ring = &SPI_Handlers[instance].rxRing;
+  size_t count = 0;
+
+  while (count < maxLength && RING_COUNT(*ring) != 0)
   {
-    SPI_Data_t bufferData;
-    if (pop(&SPI_Handlers[instance].txCircularBuffer, &bufferData))
-    {
-      SPIs[instance]->PUSHR = SPI_PUSHR_CONT(1) | SPI_PUSHR_CTAS(0b000) | SPI_PUSHR_EOQ(bufferData.eoq) |
-                              SPI_PUSHR_CTCNT(1) | SPI_PUSHR_PCS(1 << bufferData.pcsSignal) | SPI_PUSHR_TXDATA(bufferData.message);
+    message[count++] = ring->frames[ring->tail & (RX_RING_SIZE - 1)];
+    ring->tail++;
+  }
+  return count;
+}
 
-      SPIs[instance]->SR = SPI_SR_TFFF_MASK;
-    }
+static void turnTheWheel(SPI_Instance_t instance)
+{
+  SPI_CommandRing_t *ring = &SPI_Handlers[instance].txRing;
+
+  //* TXCTR instead of TFFF, so there is no flag to clear: one store per frame
+  while (((SPIs[instance]->SR & SPI_SR_TXCTR_MASK) >> SPI_SR_TXCTR_SHIFT) < SPI_Handlers[instance].fifoSize && RING_COUNT(*ring) != 0)
+  {
+    SPIs[instance]->PUSHR = ring->commands[ring->tail & (TX_RING_SIZE - 1)];
+    ring->tail++;
   }
 }
 
@@ -295,6 +509,12 @@ __ISR__ SPI2_IRQHandler(void)
 
 static void SPI_IRQHandler(SPI_Instance_t instance)
 {
+  if (SPI_Handlers[instance].transfer.active)
+  {
+    SPI_TransferIRQHandler(instance);
+    return;
+  }
+
   // save status register
   uint32_t statusRegister = SPIs[instance]->SR;
 
@@ -314,10 +534,11 @@ static void SPI_IRQHandler(SPI_Instance_t instance)
 
 static void SPI_EOQFDispatcher(SPI_Instance_t instance)
 {
-  if (isEmpty(&(SPI_Handlers[instance].txCircularBuffer))) //if there's nothing else to send
+  if (RING_COUNT(SPI_Handlers[instance].txRing) == 0) //if there's nothing else to send
   {
     SPIs[instance]->MCR = (SPIs[instance]->MCR & ~SPI_MCR_HALT_MASK) | SPI_MCR_HALT(1); //stop transmission!
     SPI_Handlers[instance].communicationFinished = true;
+    SPI_DeviceDispatch(instance); //Transactions that waited for the message
   }
   else
   {
@@ -327,15 +548,223 @@ static void SPI_EOQFDispatcher(SPI_Instance_t instance)
 
 static void SPI_RFDFDispatcher(SPI_Instance_t instance)
 {
-  // Read RX Hardware FIFO
-  if (SPIs[instance]->SR & SPI_SR_RXCTR_MASK)
+  SPI_FrameRing_t *ring = &SPI_Handlers[instance].rxRing;
+
+  // Read RX Hardware FIFO. If the ring is full the frame is lost
+  while (SPIs[instance]->SR & SPI_SR_RXCTR_MASK)
   {
     uint16_t newFrame = SPIs[instance]->POPR;
-    if (numberOfElementsLeft(&(SPI_Handlers[instance].rxCircularBuffer)) > 0)
+    if (RING_COUNT(*ring) < RX_RING_SIZE)
+    {
+      ring->frames[ring->head & (RX_RING_SIZE - 1)] = newFrame;
+      ring->head++;
+    }
+  }
+}
+
+static void SPI_TransferIRQHandler(SPI_Instance_t instance)
+{
+  SPI_TransferHandle *transfer = &SPI_Handlers[instance].transfer;
+
+  SPI_TransferDrainRxFIFO(instance);
+
+  if (transfer->rxIndex == transfer->length) //The last frame came back, so the bus is idle again
+  {
+    SPI_TransferEnd(instance);
+  }
+  else
+  {
+    SPI_TransferFillTxFIFO(instance);
+  }
+}
+
+static void SPI_TransferStart(SPI_Instance_t instance, uint32_t command, const void *tx, void *rx, size_t length, bool wide, SPI_onTransferCompleteCallback callback, bool batched)
+{
+  SPI_TransferHandle *transfer = &SPI_Handlers[instance].transfer;
+
+  transfer->tx = tx;
+  transfer->rx = rx;
+  transfer->wide = wide;
+  transfer->length = length;
+  transfer->txIndex = 0;
+  transfer->rxIndex = 0;
+  transfer->command = command;
+  transfer->callback = callback;
+  transfer->active = true;
+
+  if (batched)
+  {
+    //* Same device as the last transfer: the FIFOs are already empty and the EOQ stopped the module.
+    //* Clearing EOQF starts it again, without halting
+    SPIs[instance]->RSER = SPI_RSER_RFDF_RE_MASK;
+    SPI_TransferFillTxFIFO(instance);
+    SPIs[instance]->SR = SPI_SR_EOQF_MASK;
+  }
+  else
+  {
+    //* Start from empty FIFOs and clean flags, then prefill while halted
+    SPIs[instance]->MCR |= SPI_MCR_HALT_MASK | SPI_MCR_CLR_TXF_MASK | SPI_MCR_CLR_RXF_MASK;
+    SPIs[instance]->SR = SPI_SR_EOQF_MASK | SPI_SR_TCF_MASK | SPI_SR_TFUF_MASK | SPI_SR_TFFF_MASK | SPI_SR_RFOF_MASK | SPI_SR_RFDF_MASK;
+    SPIs[instance]->RSER = SPI_RSER_RFDF_RE_MASK;
+    SPI_TransferFillTxFIFO(instance);
+    SPIs[instance]->MCR &= ~SPI_MCR_HALT_MASK;
+  }
+}
+
+static void SPI_TransferEnd(SPI_Instance_t instance)
+{
+  SPI_MasterHandle *handle = &SPI_Handlers[instance];
+
+  handle->transfer.active = false;
+  if (handle->transfer.callback != NULL)
+    handle->transfer.callback();
+
+  //* The callback may have started another transfer. If not, the next queued one
+  SPI_DeviceDispatch(instance);
+  if (!handle->transfer.active)
+  {
+    SPIs[instance]->RSER = SPI_RSER_DEFAULT;
+    SPIs[instance]->MCR |= SPI_MCR_HALT_MASK;
+    handle->currentDevice = SPI_NO_DEVICE;
+  }
+}
+
+static void SPI_DeviceDispatch(SPI_Instance_t instance)
+{
+  SPI_MasterHandle *handle = &SPI_Handlers[instance];
+
+  //* The ring empties up to fifoSize frames before the last EOQF: communicationFinished covers those too
+  if (handle->transfer.active || !handle->communicationFinished || handle->transactionHead == handle->transactionTail)
+    return;
+
+  SPI_Transaction_t transaction = handle->transactions[handle->transactionTail & (TRANSACTION_QUEUE_LEN - 1)];
+  SPI_Device_t *device = &devices[transaction.device];
+  SPI_CTAR_t deviceCTAR = (handle->CTARUsed == SPI_CTAR_0) ? SPI_CTAR_1 : SPI_CTAR_0; //The other one stays as SPI_MasterInit left it
+  bool batched = (transaction.device == handle->currentDevice);
+  handle->transactionTail++;
+
+  if (!batched)
+  {
+    //* The CTAR can only be written while halted. Skipped if the device was the last one to use it
+    SPIs[instance]->MCR |= SPI_MCR_HALT_MASK;
+    if (handle->deviceCTAROwner != transaction.device)
     {
-      push(&(SPI_Handlers[instance].rxCircularBuffer), (void *)&newFrame);
+      SPIs[instance]->CTAR[deviceCTAR] = device->ctar;
+      handle->deviceCTAROwner = transaction.device;
     }
+    handle->currentDevice = transaction.device;
+  }
+
+  SPI_TransferStart(instance, SPI_PUSHR_PCS(1 << device->pcsSignal) | SPI_PUSHR_CTAS(deviceCTAR),
+                    transaction.tx, transaction.rx, transaction.length, device->wide, transaction.callback, batched);
+}
+
+static void SPI_TransferFillTxFIFO(SPI_Instance_t instance)
+{
+  SPI_TransferHandle *transfer = &SPI_Handlers[instance].transfer;
+  uint8_t fifoSize = SPI_Handlers[instance].fifoSize;
+
+  //* Never more frames on the fly than the RX FIFO can hold, so RX can't overflow
+  while (transfer->txIndex < transfer->length &&
+         transfer->txIndex - transfer->rxIndex < fifoSize &&
+         (SPIs[instance]->SR & SPI_SR_TFFF_MASK))
+  {
+    uint32_t frame = SPI_DUMMY_FRAME;
+    if (transfer->tx != NULL)
+      frame = transfer->wide ? ((const uint16_t *)transfer->tx)[transfer->txIndex] : ((const uint8_t *)transfer->tx)[transfer->txIndex];
+
+    //* CONT keeps PCS asserted between frames; the last one releases it and ends the queue
+    if (transfer->txIndex == transfer->length - 1)
+      SPIs[instance]->PUSHR = transfer->command | SPI_PUSHR_EOQ_MASK | SPI_PUSHR_TXDATA(frame);
+    else
+      SPIs[instance]->PUSHR = transfer->command | SPI_PUSHR_CONT_MASK | SPI_PUSHR_TXDATA(frame);
+
+    SPIs[instance]->SR = SPI_SR_TFFF_MASK;
+    transfer->txIndex++;
   }
+
+  //* TFFF only while there is something to push and room for its answer, otherwise it would fire nonstop
+  if (transfer->txIndex < transfer->length && transfer->txIndex - transfer->rxIndex < fifoSize)
+    SPIs[instance]->RSER |= SPI_RSER_TFFF_RE_MASK;
+  else
+    SPIs[instance]->RSER &= ~SPI_RSER_TFFF_RE_MASK;
+}
+
+static void SPI_TransferDrainRxFIFO(SPI_Instance_t instance)
+{
+  SPI_TransferHandle *transfer = &SPI_Handlers[instance].transfer;
+
+  //* Clear first, so a frame arriving while draining sets RFDF again
+  SPIs[instance]->SR = SPI_SR_RFDF_MASK;
+  while ((SPIs[instance]->SR & SPI_SR_RXCTR_MASK) && transfer->rxIndex < transfer->length)
+  {
+    uint16_t frame = SPIs[instance]->POPR;
+    if (transfer->rx != NULL && transfer->wide)
+      ((uint16_t *)transfer->rx)[transfer->rxIndex] = frame;
+    else if (transfer->rx != NULL)
+      ((uint8_t *)transfer->rx)[transfer->rxIndex] = frame;
+    transfer->rxIndex++;
+  }
+}
+
+__ISR__ DMA1_IRQHandler(void)
+{
+  DMA0->CINT = DMA_CINT_CINT(SPI_DMA_RX_CHANNEL);
+
+  //* The RX channel ends after the last frame came back, so the bus is idle again
+  SPI_TransferEnd(SPI_0);
+}
+
+static void SPI_DMAInit(void)
+{
+  static bool initialized = false;
+
+  if (initialized)
+    return;
+
+  SIM->SCGC6 |= SIM_SCGC6_DMAMUX_MASK;
+  SIM->SCGC7 |= SIM_SCGC7_DMA_MASK;
+  DMAMUX->CHCFG[SPI_DMA_TX_CHANNEL] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(SPI_DMA_TX_SOURCE);
+  DMAMUX->CHCFG[SPI_DMA_RX_CHANNEL] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(SPI_DMA_RX_SOURCE);
+  NVIC_EnableIRQ(DMA1_IRQn);
+  initialized = true;
+}
+
+static void SPI_DMALoadTCD(uint8_t channel, const SPI_DMATcd_t *tcd)
+{
+  //* DONE must be clear before ESG can be set. CSR goes last, it may start the scatter-gather chain
+  DMA0->CDNE = DMA_CDNE_CDNE(channel);
+  DMA0->TCD[channel].SADDR = tcd->SADDR;
+  DMA0->TCD[channel].SOFF = tcd->SOFF;
+  DMA0->TCD[channel].ATTR = tcd->ATTR;
+  DMA0->TCD[channel].NBYTES_MLNO = tcd->NBYTES;
+  DMA0->TCD[channel].SLAST = tcd->SLAST;
+  DMA0->TCD[channel].DADDR = tcd->DADDR;
+  DMA0->TCD[channel].DOFF = tcd->DOFF;
+  DMA0->TCD[channel].CITER_ELINKNO = tcd->CITER;
+  DMA0->TCD[channel].BITER_ELINKNO = tcd->BITER;
+  DMA0->TCD[channel].DLAST_SGA = tcd->DLAST_SGA;
+  DMA0->TCD[channel].CSR = tcd->CSR;
+}
+
+static uint32_t SPI_EncodeCTAR(SPI_BitsPerFrame_t bitsPerFrame, SPI_ClockConfig_t clockConfig, SPI_BitOrder_t bitOrder,
+                               uint8_t pcsToClockDelay, uint8_t clockDelayScaler, uint8_t delayAfterTransfer, uint32_t baudRate)
+{
+  baud_rate_cfg_t baudrateConfiguration = computeBaudRateSettings(baudRate);
+
+  return SPI_CTAR_FMSZ(bitsPerFrame) |
+         SPI_CTAR_CPOL(clockConfig.clockPolarity) |
+         SPI_CTAR_CPHA(clockConfig.clockPhase) |
+         SPI_CTAR_LSBFE(bitOrder) |
+         SPI_CTAR_PCSSCK(3) |                       //* This function configures the PCS to SCK delay pre-scalar
+         SPI_CTAR_CSSCK(pcsToClockDelay) |          //* PCS to SCK Delay Scaler: then t_CSC = (1/fP ) x PCSSCK x CSSCK. (page 1513 ref manual)
+         SPI_CTAR_PASC(1) |                         //* This function configures the after SCK delay delay pre-scalar
+         SPI_CTAR_ASC(clockDelayScaler) |           //*After SCK Delay Scaler: tASC = (1/fP) x PASC x ASC (page 1513 ref manual)
+         SPI_CTAR_PDT(7) |                          //*This function configures delayAfterTransferPreScale (PDT) 3 means 11 wich represent that the Delay after Transfer Prescaler value is 7.
+         SPI_CTAR_DT(delayAfterTransfer) |          //*Delay After Transfer Scaler: tDT = (1/fP ) x PDT x DT
+         SPI_CTAR_DBR(baudrateConfiguration.DBR) |  //* Double Baud Rate, Doubles the effective baud rate of the Serial Communications Clock
+         SPI_CTAR_PBR(baudrateConfiguration.PBR) |  //* Sets the SCK Duty Cycle on 50/50
+         SPI_CTAR_BR(baudrateConfiguration.BR);     //* Baud Rate Scaler: SCK baud rate = (fP /PBR) x [(1+DBR)/BR]
 }
 
 /*********************************************/
@@ -364,43 +793,50 @@ static uint16_t spiScaler[] = {
     16384,
     32768};
 
-static uint32_t computeBaudRate(uint8_t dbr, uint8_t br, uint8_t pbr)
+static uint32_t computeBaudRate(uint32_t busClock, uint8_t dbr, uint8_t br, uint8_t pbr)
 {
-  return (100000000U * (1 + dbr)) / (spiScaler[br] * spiPrescaler[pbr]);
+  return (busClock * (1 + dbr)) / (spiScaler[br] * spiPrescaler[pbr]);
 }
 
-static baud_rate_cfg_t computeBaudRateSettings(uint32_t baudRate)
+uint32_t SPI_ComputeBaudRate(uint32_t busClock, uint32_t baudRate, uint8_t *pbr, uint8_t *br, uint8_t *dbr)
 {
-  baud_rate_cfg_t setting = {.BR = 0, .DBR = 0, .PBR = 0};
-  //uint16_t ret_br = 0, ret_dbr = 0, ret_pbr = 0, ret_baudrate;
-  uint32_t bestBaudRate = 0;
-  uint32_t bestError = 0;
-  uint32_t currentBaudRate = 0;
-  uint32_t currentError = 0;
-
-  for (uint8_t dbr = 0; dbr < 1; dbr++)
+  //* Slowest setting, in case every rate is above the one asked for
+  uint32_t bestBaudRate = computeBaudRate(busClock, 0, 15, 3);
+  *dbr = 0;
+  *pbr = 3;
+  *br = 15;
+
+  //* All 128 settings: the fastest one that doesn't go over baudRate.
+  //* DBR = 0 first, so it wins the ties (DBR = 1 may break the 50/50 duty cycle)
+  for (uint8_t d = 0; d < 2; d++)
   {
-    for (uint8_t pbr = 0; pbr < 4; pbr++)
+    for (uint8_t p = 0; p < 4; p++)
     {
-      for (uint8_t br = 0; br < 16; br++)
+      for (uint8_t b = 0; b < 16; b++)
       {
-        currentBaudRate = computeBaudRate(dbr, br, pbr);
-        currentError = baudRate < currentBaudRate ? currentBaudRate - baudRate : baudRate - currentBaudRate;
-        if (bestBaudRate == 0 || currentError < bestError)
+        uint32_t currentBaudRate = computeBaudRate(busClock, d, b, p);
+        if (currentBaudRate <= baudRate && currentBaudRate > bestBaudRate)
         {
-          // Save the current best baud rate values
           bestBaudRate = currentBaudRate;
-          bestError = currentError;
-
-          // Save the current configuration of the register for the best baud rate
-          setting.BR = br;
-          setting.PBR = pbr;
-          setting.DBR = dbr;
-          setting.baudRate = bestBaudRate;
+          *dbr = d;
+          *pbr = p;
+          *br = b;
         }
       }
     }
   }
 
+  return bestBaudRate;
+}
+
+static baud_rate_cfg_t computeBaudRateSettings(uint32_t baudRate)
+{
+  uint8_t dbr, pbr, br;
+  baud_rate_cfg_t setting;
+
+  setting.baudRate = SPI_ComputeBaudRate(SPI_CLOCK, baudRate, &pbr, &br, &dbr);
+  setting.DBR = dbr;
+  setting.PBR = pbr;
+  setting.BR = br;
   return setting;
 }
@@ -3,6 +3,7 @@
 
 #include <stdint.h>
 #include "stdbool.h"
+#include <stddef.h>
 
 // Clock polarity
 typedef enum
@@ -118,14 +119,90 @@ typedef struct
     uint32_t baudRate;
 } SPI_MasterConfig_t;
 
-uint8_t spi_transaction(uint8_t *data_ptr, uint8_t len, uint8_t *recieve_ptr);
-
 void SPI_MasterInit(SPI_Instance_t n, SPI_MasterConfig_t *config);
 
+/**
+ * @brief Finds the CTAR PBR, BR and DBR fields for a baud rate. SPI_MasterInit and SPI_AddDevice call it once, with the bus clock.
+ * @param busClock Module clock in Hz
+ * @param baudRate Desired SCK rate in Hz. The result is the fastest one that doesn't go over it
+ * @return The achieved rate in Hz
+ */
+uint32_t SPI_ComputeBaudRate(uint32_t busClock, uint32_t baudRate, uint8_t *pbr, uint8_t *br, uint8_t *dbr);
+
 typedef void (*SPI_onTransferCompleteCallback)(void);
 
+/**
+ * @brief Bus attributes of one device. Each device keeps its own, the bus manager loads them when the device gets the bus
+ */
+typedef struct
+{
+    SPI_PCSignal_t pcsSignal;
+    SPI_BitsPerFrame_t bitsPerFrame;
+    SPI_ClockConfig_t clockConfig;
+    SPI_BitOrder_t bitOrder;
+    uint8_t pcsToClockDelay;
+    uint8_t clockDelayScaler;
+    uint8_t delayAfterTransfer;
+    uint32_t baudRate;
+} SPI_DeviceConfig_t;
+
+/**
+ * @brief Full-duplex transfer on SPI_0 that waits until it ends. Don't call it from an interrupt.
+ * @return 1 if the transfer was done, 0 if the bus was busy
+ */
+uint8_t spi_transaction(uint8_t *data_ptr, uint8_t len, uint8_t *recieve_ptr);
+
+/**
+ * @brief Starts a full-duplex transfer that runs in the background from the SPI interrupt.
+ * PCS stays asserted for the whole transfer.
+ * @param tx Frames to send. NULL sends 0xFF (only read)
+ * @param rx Where to store the received frames. NULL discards them (only write)
+ * @param callback Called from the interrupt when the last frame is received. May be NULL
+ * @return false if there is a transfer or message in progress. Buffers must live until the callback
+ */
+bool SPI_Transfer(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint8_t *tx, uint8_t *rx, size_t length, SPI_onTransferCompleteCallback callback);
+
+/**
+ * @brief Encodes frames as PUSHR command words for SPI_TransferDMA. CONT on every frame but the last, which has EOQ.
+ * @param tx Frames to send. NULL sends 0xFF (only read)
+ * @param commands Buffer of at least length words
+ */
+void SPI_BuildCommands(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint8_t *tx, uint32_t *commands, size_t length);
+
+/**
+ * @brief Starts a transfer that the eDMA runs on its own: one channel feeds the PUSHR commands and another drains POPR.
+ * Only SPI_0 has separate TX and RX DMA requests. Up to 8 x 32767 frames.
+ * @param commands Built with SPI_BuildCommands
+ * @param rx Where to store the received frames. NULL discards them
+ * @param callback Called from the DMA interrupt when the last frame is received. May be NULL
+ * @return false if the bus is busy or the transfer can't be done with DMA
+ */
+bool SPI_TransferDMA(SPI_Instance_t instance, const uint32_t *commands, uint8_t *rx, size_t length, SPI_onTransferCompleteCallback callback);
+
+/**
+ * @brief Registers a device on the bus. Call it after SPI_MasterInit.
+ * @return device ID for SPI_DeviceTransfer, -1 if there's no room or the PCS has no pin
+ */
+int SPI_AddDevice(SPI_Instance_t instance, const SPI_DeviceConfig_t *config);
+
+/**
+ * @brief Queues a full-duplex transfer with a device. Transfers run in order. Consecutive ones to the
+ * same device don't halt the module in between.
+ * @param tx uint8_t frames, or uint16_t if the device uses more than 8 bits per frame. NULL sends 0xFF
+ * @param rx Same type as tx. NULL discards the received frames
+ * @param callback Called from the interrupt when the transfer ends. May be NULL
+ * @return false if the queue is full
+ */
+bool SPI_DeviceTransfer(int deviceID, const void *tx, void *rx, size_t length, SPI_onTransferCompleteCallback callback);
+
 bool SPI_SendByte(uint8_t byte);
 
 bool SPI_SendMessage(SPI_Instance_t instance, SPI_PCSignal_t pcsSignal, const uint16_t message[], size_t messageLength, bool onlyRead);
 
+/**
+ * @brief Copies the frames received by SPI_SendMessage.
+ * @return Quantity of copied frames
+ */
+size_t SPI_ReceiveMessage(SPI_Instance_t instance, uint16_t message[], size_t maxLength);
+
 #endif /* SPI_H_ */
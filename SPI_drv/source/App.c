@@ -51,7 +51,8 @@ void send(void)
 {
 	static uint8_t recive[100];
 	static uint8_t send[] = {21};
-	spi_transaction(send, sizeof(send), recive);
+	// Corre en el SysTick: no se puede esperar al SPI, si sigue ocupado se saltea este envio
+	SPI_Transfer(SPI_0, SPI_PCS_0, send, recive, sizeof(send), NULL);
 }
 /*******************************************************************************
  *******************************************************************************
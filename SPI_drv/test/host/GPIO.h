@@ -0,0 +1,2 @@
+// spi.c incluye "GPIO.h": en Windows es drivers/gpio.h, aca hay que decirlo
+#include "gpio.h"
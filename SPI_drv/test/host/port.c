@@ -0,0 +1,10 @@
+/***************************************************************************//**
+  @file     port.c
+  @brief    port.h of the SPI driver for the host tests: the pin mux isn't modeled
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "port.h"
+
+void PORT_GetPinDefaultConfig(PORT_Config *config) { (void)config; }
+void PORT_PinConfig(PORT_Instance n, uint32_t pin, PORT_Config *config, PORT_Mux mux) { (void)n; (void)pin; (void)config; (void)mux; }
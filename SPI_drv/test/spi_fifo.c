@@ -0,0 +1,134 @@
+/***************************************************************************//**
+  @file     spi_fifo.c
+  @brief    Host model of the DSPI FIFOs, for the SPI driver tests
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "spi_fifo.h"
+#include "hardware.h"
+#include <stdio.h>
+#include <string.h>
+
+uint32_t spi_fifo_log[SPI_FIFO_LOG_LEN];
+int spi_fifo_log_count;
+int spi_fifo_errors;
+int spi_fifo_unmasked_pushes;
+
+static uint32_t txFifo[3][SPI_FIFO_DEPTH];
+static uint16_t rxFifo[3][SPI_FIFO_DEPTH];
+static int txCount[3], rxCount[3];
+static bool eoqf[3];
+static bool inIrq;
+
+void SPI0_IRQHandler(void);
+void SPI1_IRQHandler(void);
+void SPI2_IRQHandler(void);
+
+uint32_t spi_fifo_sr(int n)
+{
+	return (txCount[n] < SPI_FIFO_DEPTH ? SPI_SR_TFFF_MASK : 0) | (rxCount[n] ? SPI_SR_RFDF_MASK : 0) |
+			(eoqf[n] ? SPI_SR_EOQF_MASK : 0) | SPI_SR_TXCTR(txCount[n]) | SPI_SR_RXCTR(rxCount[n]);
+}
+
+void spi_fifo_sr_write(int n, uint32_t value)
+{
+	// TFFF y RFDF dependen del nivel de las FIFOs: borrarlos no cambia nada
+	if(value & SPI_SR_EOQF_MASK)
+		eoqf[n] = false;
+}
+
+void spi_fifo_pushr(int n, uint32_t command)
+{
+	if(host_spi[n].MCR & SPI_MCR_CLR_TXF_MASK)
+	{
+		txCount[n] = 0;
+		host_spi[n].MCR &= ~SPI_MCR_CLR_TXF_MASK;
+	}
+	if(txCount[n] == SPI_FIFO_DEPTH)
+	{
+		printf("  TX FIFO overflow\n");
+		spi_fifo_errors++;
+		return;
+	}
+	if(!inIrq && !host_primask)
+		spi_fifo_unmasked_pushes++;
+	txFifo[n][txCount[n]++] = command;
+}
+
+uint32_t spi_fifo_popr(int n)
+{
+	uint16_t frame = rxFifo[n][0];
+
+	if(rxCount[n] == 0)
+	{
+		printf("  POPR with an empty RX FIFO\n");
+		spi_fifo_errors++;
+		return 0;
+	}
+	memmove(rxFifo[n], rxFifo[n] + 1, sizeof(rxFifo[n][0]) * (SPI_FIFO_DEPTH - 1));
+	rxCount[n]--;
+	return frame;
+}
+
+void spi_fifo_reset(void)
+{
+	memset(txCount, 0, sizeof(txCount));
+	memset(rxCount, 0, sizeof(rxCount));
+	memset(eoqf, 0, sizeof(eoqf));
+	spi_fifo_log_count = 0;
+	spi_fifo_errors = 0;
+	spi_fifo_unmasked_pushes = 0;
+}
+
+bool spi_fifo_shift(int n)
+{
+	uint32_t command;
+
+	// CLR_TXF/CLR_RXF se autoborran
+	if(host_spi[n].MCR & SPI_MCR_CLR_TXF_MASK)
+		txCount[n] = 0;
+	if(host_spi[n].MCR & SPI_MCR_CLR_RXF_MASK)
+		rxCount[n] = 0;
+	host_spi[n].MCR &= ~(SPI_MCR_CLR_TXF_MASK | SPI_MCR_CLR_RXF_MASK);
+
+	// Frenado por HALT o por el ultimo EOQ hasta que se borre EOQF
+	if((host_spi[n].MCR & SPI_MCR_HALT_MASK) || eoqf[n] || txCount[n] == 0)
+		return false;
+
+	command = txFifo[n][0];
+	memmove(txFifo[n], txFifo[n] + 1, sizeof(txFifo[n][0]) * (SPI_FIFO_DEPTH - 1));
+	txCount[n]--;
+
+	if(spi_fifo_log_count < SPI_FIFO_LOG_LEN)
+		spi_fifo_log[spi_fifo_log_count++] = command;
+	if(rxCount[n] == SPI_FIFO_DEPTH)
+	{
+		printf("  RX FIFO overflow\n");
+		spi_fifo_errors++;
+	}
+	else
+	{
+		rxFifo[n][rxCount[n]++] = (command & SPI_PUSHR_TXDATA_MASK) ^ SPI_FIFO_ECHO_XOR;
+	}
+	if(command & SPI_PUSHR_EOQ_MASK)
+		eoqf[n] = true;
+	return true;
+}
+
+bool spi_fifo_irq(int n)
+{
+	static void (*const handlers[])(void) = {SPI0_IRQHandler, SPI1_IRQHandler, SPI2_IRQHandler};
+	static const IRQn_Type irqs[] = {SPI0_IRQn, SPI1_IRQn, SPI2_IRQn};
+	uint32_t rser = host_spi[n].RSER;
+	bool pending;
+
+	pending = ((rser & SPI_RSER_RFDF_RE_MASK) && !(rser & SPI_RSER_RFDF_DIRS_MASK) && rxCount[n] != 0) ||
+			((rser & SPI_RSER_TFFF_RE_MASK) && !(rser & SPI_RSER_TFFF_DIRS_MASK) && txCount[n] < SPI_FIFO_DEPTH) ||
+			((rser & SPI_RSER_EOQF_RE_MASK) && eoqf[n]);
+	if(!pending || host_primask || !NVIC_GetEnableIRQ(irqs[n]))
+		return false;
+	inIrq = true;
+	handlers[n]();
+	inIrq = false;
+	return true;
+}
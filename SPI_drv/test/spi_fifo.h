@@ -0,0 +1,43 @@
+/***************************************************************************//**
+  @file     spi_fifo.h
+  @brief    Host model of the DSPI FIFOs, for the SPI driver tests
+  @author   Grupo 2
+ ******************************************************************************/
+
+#ifndef _SPI_FIFO_H_
+#define _SPI_FIFO_H_
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/*
+ * El Makefile pasa drivers/spi.c por sed: cada PUSHR, POPR y SR de spi.c
+ * llama a estas funciones. MCR, RSER y CTAR quedan en host_spi (hardware.h).
+ * Cada frame que sale vuelve por RX como (frame ^ SPI_FIFO_ECHO_XOR).
+ */
+
+#define SPI_FIFO_DEPTH		4
+#define SPI_FIFO_ECHO_XOR	0x5A
+#define SPI_FIFO_LOG_LEN	1024
+
+uint32_t spi_fifo_sr(int n);
+void spi_fifo_sr_write(int n, uint32_t value);
+void spi_fifo_pushr(int n, uint32_t command);
+uint32_t spi_fifo_popr(int n);
+
+// Vacia las FIFOs y el registro de lo que salio
+void spi_fifo_reset(void);
+
+// Saca un frame de la FIFO de TX si el modulo corre. Devuelve si salio alguno
+bool spi_fifo_shift(int n);
+
+// Atiende la interrupcion del modulo si esta pedida y no enmascarada. Devuelve si la atendio
+bool spi_fifo_irq(int n);
+
+// Lo que salio por el bus: la palabra de PUSHR completa
+extern uint32_t spi_fifo_log[SPI_FIFO_LOG_LEN];
+extern int spi_fifo_log_count;
+extern int spi_fifo_errors;	// Overflow de alguna FIFO
+extern int spi_fifo_unmasked_pushes;	// PUSHR desde el programa con las interrupciones habilitadas
+
+#endif // _SPI_FIFO_H_
@@ -0,0 +1,65 @@
+/***************************************************************************//**
+  @file     test_spi_baud.c
+  @brief    SPI_ComputeBaudRate against every PBR/BR/DBR setting of the CTAR
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "spi.h"
+#include "check.h"
+
+// SCK = fBUS / PBR * (1 + DBR) / BR, tablas del manual de referencia (CTAR)
+static const uint32_t prescalers[] = {2, 3, 5, 7};
+static const uint32_t scalers[] = {2, 4, 6, 8, 16, 32, 64, 128, 256, 512, 1024, 2048, 4096, 8192, 16384, 32768};
+
+static uint32_t sck(uint32_t busClock, uint8_t pbr, uint8_t br, uint8_t dbr)
+{
+	return (uint32_t)(((uint64_t)busClock * (1 + dbr)) / (prescalers[pbr] * scalers[br]));
+}
+
+static void test_rate(uint32_t busClock, uint32_t baudRate)
+{
+	uint8_t pbr, br, dbr, p, b, d;
+	uint32_t achieved, best = 0, rate;
+	bool bestNeedsDbr = false;
+
+	achieved = SPI_ComputeBaudRate(busClock, baudRate, &pbr, &br, &dbr);
+
+	// La mas rapida que no se pasa; a igual velocidad, sin DBR
+	for(d = 0; d < 2; d++)
+		for(p = 0; p < 4; p++)
+			for(b = 0; b < 16; b++)
+			{
+				rate = sck(busClock, p, b, d);
+				if(rate <= baudRate && rate > best)
+				{
+					best = rate;
+					bestNeedsDbr = d;
+				}
+			}
+	if(best == 0)
+		best = sck(busClock, 3, 15, 0); // Ninguna alcanza: la mas lenta
+
+	check(pbr <= 3 && br <= 15 && dbr <= 1 && achieved == sck(busClock, pbr, br, dbr) && achieved == best &&
+			(!dbr || bestNeedsDbr),
+			"bus %lu baud %lu: got %lu (pbr %u br %u dbr %u), best %lu", (unsigned long)busClock,
+			(unsigned long)baudRate, (unsigned long)achieved, pbr, br, dbr, (unsigned long)best);
+}
+
+int main(void)
+{
+	static const uint32_t clocks[] = {50000000, 60000000, 48000000, 20970000};
+	static const uint32_t common[] = {100000, 250000, 400000, 500000, 1000000, 2000000, 4000000, 5000000,
+			8000000, 10000000, 12500000, 16000000, 20000000, 25000000, 30000000};
+	uint32_t baud;
+	unsigned int c, i;
+
+	for(c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+	{
+		for(i = 0; i < sizeof(common) / sizeof(common[0]); i++)
+			test_rate(clocks[c], common[i]);
+		for(baud = 1; baud < 40000000; baud += baud / 7 + 1)
+			test_rate(clocks[c], baud);
+	}
+
+	return check_report();
+}
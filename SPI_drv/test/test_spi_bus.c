@@ -0,0 +1,86 @@
+/***************************************************************************//**
+  @file     test_spi_bus.c
+  @brief    Bus arbitration between SPI_SendMessage, SPI_Transfer and the device queue
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "spi.h"
+#include "spi_fifo.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define MAX_STEPS	100000
+
+static int completed;
+
+static void onComplete(void)
+{
+	completed++;
+}
+
+static void run(void)
+{
+	int steps;
+
+	for(steps = 0; steps < MAX_STEPS && !completed; steps++)
+	{
+		spi_fifo_shift(SPI_0);
+		spi_fifo_irq(SPI_0);
+	}
+}
+
+// Un mensaje que entra entero en la FIFO deja el ring vacio antes de salir: el bus sigue ocupado
+static void test_short_message(size_t length)
+{
+	const uint16_t message[] = {0x11, 0x22, 0x33, 0x44, 0x55, 0x66};
+	const uint8_t tx[] = {0xA1, 0xA2};
+	uint8_t rx[2];
+	uint16_t received[8];
+	SPI_DeviceConfig_t config = {.pcsSignal = SPI_PCS_1, .bitsPerFrame = SPI_eightBitsFrame, .baudRate = 1000000};
+	int device;
+	size_t i;
+
+	spi_fifo_reset();
+	completed = 0;
+
+	check(SPI_SendMessage(SPI_0, SPI_PCS_0, message, length, false), "SPI_SendMessage rejected");
+	check(spi_fifo_unmasked_pushes == 0, "SPI_SendMessage claimed the bus with the interrupts enabled");
+	check(!SPI_Transfer(SPI_0, SPI_PCS_2, tx, rx, sizeof(tx), onComplete), "SPI_Transfer accepted during SPI_SendMessage");
+
+	// La transaccion del dispositivo espera al EOQF del mensaje
+	device = SPI_AddDevice(SPI_0, &config);
+	check(device >= 0, "SPI_AddDevice failed");
+	check(SPI_DeviceTransfer(device, tx, rx, sizeof(tx), onComplete), "SPI_DeviceTransfer rejected");
+	check(spi_fifo_log_count == 0 && completed == 0, "device transfer started before the message");
+
+	run();
+	check(completed == 1, "device transfer never completed");
+	check(spi_fifo_errors == 0, "FIFO overflow");
+	check(spi_fifo_log_count == (int)length + 2, "wrong frame count");
+
+	for(i = 0; i < length; i++)
+		check((spi_fifo_log[i] & SPI_PUSHR_TXDATA_MASK) == message[i] &&
+				(spi_fifo_log[i] & SPI_PUSHR_PCS_MASK) == SPI_PUSHR_PCS(1 << SPI_PCS_0), "message frame clobbered");
+	for(i = 0; i < sizeof(tx); i++)
+		check((spi_fifo_log[length + i] & SPI_PUSHR_TXDATA_MASK) == tx[i] &&
+				(spi_fifo_log[length + i] & SPI_PUSHR_PCS_MASK) == SPI_PUSHR_PCS(1 << SPI_PCS_1), "device frame");
+
+	check(SPI_ReceiveMessage(SPI_0, received, 8) == length, "SPI_ReceiveMessage count");
+	check(received[0] == (message[0] ^ SPI_FIFO_ECHO_XOR), "SPI_ReceiveMessage data");
+	check(host_primask == 0, "interrupts left masked");
+}
+
+int main(void)
+{
+	size_t length;
+
+	NVIC_EnableIRQ(SPI0_IRQn);
+	host_spi[SPI_0].RSER = SPI_RSER_RFDF_RE_MASK | SPI_RSER_EOQF_RE_MASK; // Como lo deja SPI_MasterInit
+	host_spi[SPI_0].MCR = SPI_MCR_HALT_MASK;
+
+	for(length = 1; length <= 6; length++)
+		test_short_message(length);
+
+	return check_report();
+}
@@ -0,0 +1,131 @@
+/***************************************************************************//**
+  @file     test_spi_dma.c
+  @brief    SPI_BuildCommands and the eDMA setup of SPI_TransferDMA: TCDs, DMAMUX, RSER and end state
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "spi.h"
+#include "spi_fifo.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define TX_CHANNEL		0
+#define RX_CHANNEL		1
+#define MAX_MAJOR_LOOP	32767
+#define LONG_LEN		(2 * MAX_MAJOR_LOOP + 10)	// Tres segmentos de scatter-gather
+
+// En el host las direcciones son de 64 bits: el TCD guarda los 32 de abajo
+#define ADDR(p)		((uint32_t)(uintptr_t)(p))
+
+void DMA1_IRQHandler(void);
+
+static int completed;
+static uint32_t commands[LONG_LEN];
+static uint8_t tx[LONG_LEN], rx[LONG_LEN];
+
+static void onComplete(void)
+{
+	completed++;
+}
+
+static void test_build_commands(void)
+{
+	static const uint8_t data[] = {0x10, 0x20, 0x30, 0x40, 0x50};
+	size_t i, len = sizeof(data);
+
+	SPI_BuildCommands(SPI_0, SPI_PCS_2, data, commands, len);
+	for(i = 0; i < len; i++)
+	{
+		check((commands[i] & SPI_PUSHR_TXDATA_MASK) == data[i], "frame %zu data", i);
+		check((commands[i] & SPI_PUSHR_PCS_MASK) == SPI_PUSHR_PCS(1 << SPI_PCS_2), "frame %zu PCS", i);
+		check(!(commands[i] & SPI_PUSHR_CONT_MASK) == (i == len - 1), "frame %zu CONT", i);
+		check(!(commands[i] & SPI_PUSHR_EOQ_MASK) == (i != len - 1), "frame %zu EOQ", i);
+	}
+
+	SPI_BuildCommands(SPI_0, SPI_PCS_0, NULL, commands, 1);
+	check((commands[0] & SPI_PUSHR_TXDATA_MASK) == 0xFF, "NULL tx sends 0xFF");
+	check((commands[0] & (SPI_PUSHR_CONT_MASK | SPI_PUSHR_EOQ_MASK)) == SPI_PUSHR_EOQ_MASK, "single frame: EOQ, no CONT");
+}
+
+static void test_rejected(void)
+{
+	check(!SPI_TransferDMA(SPI_1, commands, rx, 1, onComplete), "DMA on SPI_1 accepted");
+	check(!SPI_TransferDMA(SPI_0, commands, rx, 0, onComplete), "empty DMA transfer accepted");
+	check(!SPI_TransferDMA(SPI_0, commands, rx, 8 * MAX_MAJOR_LOOP + 1, onComplete), "more than 8 segments accepted");
+	check(host_primask == 0, "interrupts left masked");
+}
+
+// Tres segmentos: el primer TCD de cada canal queda cargado en el hardware y encadena al siguiente
+static void test_long_transfer(void)
+{
+	DMA_Type * dma = &host_dma;
+
+	memset(tx, 0x5A, sizeof(tx));
+	SPI_BuildCommands(SPI_0, SPI_PCS_0, tx, commands, LONG_LEN);
+	completed = 0;
+
+	check(SPI_TransferDMA(SPI_0, commands, rx, LONG_LEN, onComplete), "SPI_TransferDMA rejected");
+	check(host_primask == 0, "interrupts left masked");
+	check(host_dmamux.CHCFG[TX_CHANNEL] == (DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(15)), "TX DMAMUX source");
+	check(host_dmamux.CHCFG[RX_CHANNEL] == (DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(14)), "RX DMAMUX source");
+	check(NVIC_GetEnableIRQ(DMA1_IRQn), "DMA1 IRQ not enabled");
+
+	check(dma->TCD[TX_CHANNEL].SADDR == ADDR(commands) && dma->TCD[TX_CHANNEL].SOFF == 4 &&
+			dma->TCD[TX_CHANNEL].NBYTES_MLNO == 4, "TX TCD source: one command word per request");
+	check(dma->TCD[TX_CHANNEL].CITER_ELINKNO == MAX_MAJOR_LOOP && dma->TCD[TX_CHANNEL].BITER_ELINKNO == MAX_MAJOR_LOOP,
+			"TX major loop split at 32767");
+	check(dma->TCD[TX_CHANNEL].CSR == DMA_CSR_ESG_MASK && dma->TCD[TX_CHANNEL].DLAST_SGA != 0, "TX chained to the next TCD");
+
+	check(dma->TCD[RX_CHANNEL].DADDR == ADDR(rx) && dma->TCD[RX_CHANNEL].DOFF == 1 &&
+			dma->TCD[RX_CHANNEL].NBYTES_MLNO == 1, "RX TCD destination: one byte per request");
+	check(dma->TCD[RX_CHANNEL].CITER_ELINKNO == MAX_MAJOR_LOOP, "RX major loop split at 32767");
+	check(dma->TCD[RX_CHANNEL].CSR == DMA_CSR_ESG_MASK && dma->TCD[RX_CHANNEL].DLAST_SGA != 0, "RX chained to the next TCD");
+
+	check(host_spi[SPI_0].RSER == (SPI_RSER_TFFF_RE_MASK | SPI_RSER_TFFF_DIRS_MASK | SPI_RSER_RFDF_RE_MASK |
+			SPI_RSER_RFDF_DIRS_MASK), "TFFF/RFDF not routed to the eDMA");
+	check(!(host_spi[SPI_0].MCR & SPI_MCR_HALT_MASK), "module left halted");
+	check(dma->SERQ == TX_CHANNEL, "TX request enabled last");
+
+	check(!SPI_TransferDMA(SPI_0, commands, rx, 1, onComplete), "second DMA transfer accepted while busy");
+	check(!SPI_Transfer(SPI_0, SPI_PCS_0, tx, rx, 1, onComplete), "SPI_Transfer accepted during a DMA transfer");
+
+	// El RX termina despues del ultimo frame: una sola interrupcion
+	DMA1_IRQHandler();
+	check(completed == 1, "callback not called once");
+	check(dma->CINT == RX_CHANNEL, "RX channel interrupt not cleared");
+	check(host_spi[SPI_0].RSER == (SPI_RSER_RFDF_RE_MASK | SPI_RSER_EOQF_RE_MASK), "RSER not restored");
+	check(host_spi[SPI_0].MCR & SPI_MCR_HALT_MASK, "module not halted");
+}
+
+// Un segmento sin rx: el ultimo TCD pide la interrupcion solo en RX y el destino no avanza
+static void test_short_transfer(void)
+{
+	DMA_Type * dma = &host_dma;
+
+	SPI_BuildCommands(SPI_0, SPI_PCS_0, NULL, commands, 10);
+	completed = 0;
+
+	check(SPI_TransferDMA(SPI_0, commands, NULL, 10, onComplete), "SPI_TransferDMA rejected after the first one");
+	check(dma->TCD[TX_CHANNEL].CITER_ELINKNO == 10 && dma->TCD[RX_CHANNEL].CITER_ELINKNO == 10, "major loop count");
+	check(dma->TCD[TX_CHANNEL].CSR == DMA_CSR_DREQ_MASK, "TX last TCD: DREQ, no interrupt");
+	check(dma->TCD[RX_CHANNEL].CSR == (DMA_CSR_DREQ_MASK | DMA_CSR_INTMAJOR_MASK), "RX last TCD: DREQ and interrupt");
+	check(dma->TCD[RX_CHANNEL].DOFF == 0, "NULL rx still advances the destination");
+
+	DMA1_IRQHandler();
+	check(completed == 1, "callback not called once");
+}
+
+int main(void)
+{
+	host_spi[SPI_0].RSER = SPI_RSER_RFDF_RE_MASK | SPI_RSER_EOQF_RE_MASK; // Como lo deja SPI_MasterInit
+	host_spi[SPI_0].MCR = SPI_MCR_HALT_MASK;
+	spi_fifo_reset();
+
+	test_build_commands();
+	test_rejected();
+	test_long_transfer();
+	test_short_transfer();
+
+	return check_report();
+}
@@ -0,0 +1,92 @@
+/***************************************************************************//**
+  @file     test_spi_transfer.c
+  @brief    SPI_Transfer on the DSPI FIFO model: CONT/EOQ framing, FIFO levels and end state
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "spi.h"
+#include "spi_fifo.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+// Cada falla dice con que largo de transferencia fue
+#define check_len(ok, what, len)	check(ok, "len %d: %s", len, what)
+
+#define MAX_LEN		200
+#define MAX_STEPS	100000
+
+static int completed;
+
+static void onComplete(void)
+{
+	completed++;
+}
+
+// Corre el bus y las interrupciones hasta que termina la transferencia
+static bool run(void)
+{
+	int steps;
+
+	for(steps = 0; steps < MAX_STEPS && !completed; steps++)
+	{
+		spi_fifo_shift(SPI_0);
+		spi_fifo_irq(SPI_0);
+	}
+	return completed == 1;
+}
+
+static void test_framing(int len, const uint8_t * tx, uint8_t * rx, SPI_PCSignal_t pcs)
+{
+	int i;
+	bool framing = true, data = true;
+
+	spi_fifo_reset();
+	completed = 0;
+	check_len(SPI_Transfer(SPI_0, pcs, tx, rx, len, onComplete), "SPI_Transfer rejected", len);
+	check_len(host_primask == 0, "interrupts left masked", len);
+	check_len(!SPI_Transfer(SPI_0, pcs, tx, rx, len, onComplete), "second transfer accepted while busy", len);
+	check_len(run(), "never completed", len);
+	check_len(spi_fifo_log_count == len, "wrong frame count", len);
+	check_len(spi_fifo_errors == 0, "FIFO overflow", len);
+
+	for(i = 0; i < spi_fifo_log_count; i++)
+	{
+		uint32_t frame = spi_fifo_log[i];
+		bool last = (i == len - 1);
+
+		// PCS queda activo (CONT) en todos menos el ultimo, que cierra la cola (EOQ)
+		framing &= !!(frame & SPI_PUSHR_CONT_MASK) == !last;
+		framing &= !!(frame & SPI_PUSHR_EOQ_MASK) == last;
+		framing &= ((frame & SPI_PUSHR_PCS_MASK) >> SPI_PUSHR_PCS_SHIFT) == (1U << pcs);
+		data &= (frame & SPI_PUSHR_TXDATA_MASK) == (tx != NULL ? tx[i] : 0xFF);
+		if(rx != NULL)
+			data &= rx[i] == (uint8_t)((frame & SPI_PUSHR_TXDATA_MASK) ^ SPI_FIFO_ECHO_XOR);
+	}
+	check_len(framing, "CONT/EOQ/PCS bits", len);
+	check_len(data, "tx or rx data", len);
+
+	// Al terminar vuelve al modo de SPI_SendMessage, frenado
+	check_len(host_spi[SPI_0].RSER == (SPI_RSER_RFDF_RE_MASK | SPI_RSER_EOQF_RE_MASK), "RSER not restored", len);
+	check_len(host_spi[SPI_0].MCR & SPI_MCR_HALT_MASK, "module not halted", len);
+}
+
+int main(void)
+{
+	uint8_t tx[MAX_LEN], rx[MAX_LEN];
+	int len, i;
+
+	NVIC_EnableIRQ(SPI0_IRQn);
+
+	for(len = 1; len <= MAX_LEN; len += (len < 10) ? 1 : 37)
+	{
+		for(i = 0; i < len; i++)
+			tx[i] = i * 7 + 3;
+		memset(rx, 0, sizeof(rx));
+		test_framing(len, tx, rx, SPI_PCS_2);
+	}
+	test_framing(5, NULL, rx, SPI_PCS_0);	// Solo lectura: sale 0xFF
+	test_framing(3, tx, NULL, SPI_PCS_0);	// Solo escritura
+
+	return check_report();
+}
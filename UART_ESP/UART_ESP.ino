@@ -1,12 +1,17 @@
 /**************************************************************
 * UART Test code
-* This code waits for a 0x04 from Kinetis and replies
-* with the following bytes 0x00,0x01,0x02,0x03.
+* This code waits for a POLL frame from Kinetis and replies
+* with an ACK frame carrying the bytes 0x01,0x01,0x01.
 *
 **************************************************************/
+#include "frame.h"
+
 #define LED D0
 
 boolean ledState = true;
+frame_decoder_t decoder;
+
+void onFrame(uint8_t type, const uint8_t * payload, uint8_t len);
 
 void setup()
 {
@@ -15,6 +20,7 @@ void setup()
  Serial.swap();                   // TX = D8, RX = D7 
  pinMode(LED, OUTPUT);
  digitalWrite(LED, ledState);
+ frame_decoder_init(&decoder);
 }
 
 void loop()
@@ -23,22 +29,10 @@ void loop()
  byte serin=0;
 
   
-  if (Serial.available()>0)
+  while (Serial.available()>0)
   {
     serin=Serial.read();
-    ledState = !ledState;
-    digitalWrite(LED, ledState);
-  }
-  
-  if(serin==0x04)
-  {
-    Serial.write(1);
-    Serial.write(1);
-    Serial.write(1);
-    Serial.write(3);
-    serin=0;
-
-   
+    frame_decode(&decoder, &serin, 1, onFrame);
   }
 
   delay(100);
@@ -46,3 +40,18 @@ void loop()
 
  
 }
+
+
+void onFrame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+  static const uint8_t reply[] = {1, 1, 1};
+  uint8_t out[FRAME_ENCODED_LEN(sizeof(reply))];
+
+  ledState = !ledState;
+  digitalWrite(LED, ledState);
+
+  if(type == FRAME_TYPE_POLL)
+  {
+    Serial.write(out, frame_encode(FRAME_TYPE_ACK, reply, sizeof(reply), out, sizeof(out)));
+  }
+}
@@ -0,0 +1,189 @@
+/*******************************************************************************
+  @file     frame.c
+  @brief    Framing for the Kinetis <-> ESP8266 UART link. COBS + CRC16
+  @author   Grupo 2
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include "frame.h"
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+#define CRC16_INIT		0xFFFF
+#define CRC16_POLY		0x1021
+
+#define COBS_MAX_CODE	0xFF	// Bloque de 254 bytes sin cero al final
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
+ ******************************************************************************/
+
+static void frame_append(frame_decoder_t * dec, uint8_t b);
+static void frame_end(frame_decoder_t * dec, frame_callback_t callback, uint16_t * found);
+
+/*******************************************************************************
+ *                        GLOBAL FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+uint16_t frame_crc16(uint16_t crc, const uint8_t * data, size_t len)
+{
+	uint8_t i;
+
+	while(len--)
+	{
+		crc ^= (uint16_t)(*data++) << 8;
+		for(i = 0; i < 8; i++)
+			crc = (crc & 0x8000)?((crc << 1) ^ CRC16_POLY):(crc << 1);
+	}
+	return crc;
+}
+
+
+size_t frame_encode(uint8_t type, const uint8_t * payload, uint8_t len, uint8_t * out, size_t out_size)
+{
+	uint8_t header[FRAME_HEADER_LEN] = {type, len};
+	uint8_t trailer[FRAME_CRC_LEN];
+	const uint8_t * parts[3] = {header, payload, trailer};
+	size_t parts_len[3] = {FRAME_HEADER_LEN, len, FRAME_CRC_LEN};
+	size_t code_index = 0, o = 1, i, p;
+	uint8_t code = 1;
+	uint16_t crc;
+
+	if(len > FRAME_MAX_PAYLOAD || out_size < (size_t)FRAME_ENCODED_LEN(len))
+		return 0;
+
+	crc = frame_crc16(CRC16_INIT, header, FRAME_HEADER_LEN);
+	crc = frame_crc16(crc, payload, len);
+	trailer[0] = crc >> 8;
+	trailer[1] = crc & 0xFF;
+
+	// COBS sobre header, payload y CRC sin armar la trama cruda en otro buffer
+	for(p = 0; p < 3; p++)
+	{
+		for(i = 0; i < parts_len[p]; i++)
+		{
+			if(parts[p][i] == 0)
+			{
+				out[code_index] = code;
+				code_index = o++;
+				code = 1;
+			}
+			else
+			{
+				out[o++] = parts[p][i];
+				if(++code == COBS_MAX_CODE)
+				{
+					out[code_index] = code;
+					code_index = o++;
+					code = 1;
+				}
+			}
+		}
+	}
+	out[code_index] = code;
+	out[o++] = FRAME_DELIMITER;
+	return o;
+}
+
+
+void frame_decoder_init(frame_decoder_t * dec)
+{
+	dec->index = 0;
+	dec->code = 0;
+	dec->remaining = 0;
+	dec->discard = false;	// Sin esperar un delimitador: si arranca a mitad de trama, la pierde el CRC
+	dec->frames_ok = 0;
+	dec->frames_error = 0;
+}
+
+
+uint16_t frame_decode(frame_decoder_t * dec, const uint8_t * data, size_t len, frame_callback_t callback)
+{
+	uint16_t found = 0;
+	uint8_t b;
+
+	while(len--)
+	{
+		b = *data++;
+		if(b == FRAME_DELIMITER)
+		{
+			frame_end(dec, callback, &found);
+		}
+		else if(dec->discard)
+		{
+			// Espero al proximo delimitador para sincronizar
+		}
+		else if(dec->remaining == 0)
+		{
+			// Nuevo bloque: el cero del bloque anterior se agrega recien ahora, asi no queda al final
+			if(dec->code != 0 && dec->code != COBS_MAX_CODE)
+				frame_append(dec, 0);
+			dec->code = b;
+			dec->remaining = b - 1;
+		}
+		else
+		{
+			frame_append(dec, b);
+			dec->remaining--;
+		}
+	}
+	return found;
+}
+
+
+/*******************************************************************************
+ *                       LOCAL FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static void frame_append(frame_decoder_t * dec, uint8_t b)
+{
+	if(dec->index < sizeof(dec->raw))
+	{
+		dec->raw[dec->index++] = b;
+	}
+	else // Trama demasiado larga
+	{
+		dec->discard = true;
+		dec->frames_error++;
+	}
+}
+
+static void frame_end(frame_decoder_t * dec, frame_callback_t callback, uint16_t * found)
+{
+	uint16_t crc;
+	uint8_t len;
+
+	if(!dec->discard && dec->index != 0)
+	{
+		len = dec->raw[1];
+		if(dec->remaining != 0 || dec->index < FRAME_RAW_LEN(0) || dec->index != FRAME_RAW_LEN(len))
+		{
+			dec->frames_error++;
+		}
+		else
+		{
+			crc = frame_crc16(CRC16_INIT, dec->raw, FRAME_HEADER_LEN + len);
+			if(crc != (((uint16_t)dec->raw[FRAME_HEADER_LEN + len] << 8) | dec->raw[FRAME_HEADER_LEN + len + 1]))
+			{
+				dec->frames_error++;
+			}
+			else
+			{
+				dec->frames_ok++;
+				(*found)++;
+				if(callback != NULL)
+					callback(dec->raw[0], &dec->raw[FRAME_HEADER_LEN], len);
+			}
+		}
+	}
+	dec->index = 0;
+	dec->code = 0;
+	dec->remaining = 0;
+	dec->discard = false;
+}
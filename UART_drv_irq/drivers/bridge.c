@@ -0,0 +1,259 @@
+/*******************************************************************************
+  @file     bridge.c
+  @brief    MQTT topic multiplexing over the Kinetis <-> ESP8266 framed link
+  @author   Grupo 2
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include "bridge.h"
+#include <string.h>
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+#define FNV_OFFSET	2166136261U
+#define FNV_PRIME	16777619U
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef struct {
+	char name[BRIDGE_MAX_TOPIC_LEN];
+	uint32_t hash;
+} local_topic_t;
+
+typedef struct {
+	char name[BRIDGE_MAX_TOPIC_LEN];
+	bridge_handler_t handler;	// Resuelto al recibir el BIND
+	bool bound;
+	bool requested;		// Ya se pidio el BIND de este id y todavia no llego
+} remote_topic_t;
+
+typedef struct {
+	char name[BRIDGE_MAX_TOPIC_LEN];
+	bridge_handler_t handler;
+} subscription_t;
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
+ ******************************************************************************/
+
+static uint32_t bridge_hash(const char * name);
+static void bridge_send_frame(uint8_t type, uint8_t id, const uint8_t * data, uint8_t len);
+static void bridge_send_bind(uint8_t id);
+static bridge_handler_t bridge_lookup_handler(const char * name);
+
+/*******************************************************************************
+ * PRIVATE VARIABLES WITH FILE LEVEL SCOPE
+ ******************************************************************************/
+
+static bridge_send_t send_fn;
+static bridge_handler_t default_fn;
+
+static local_topic_t local_topics[BRIDGE_MAX_TOPICS];
+static uint8_t local_count;
+
+static remote_topic_t remote_topics[BRIDGE_MAX_TOPICS];
+
+static subscription_t subscriptions[BRIDGE_MAX_TOPICS];
+static uint8_t subscriptions_count;
+
+/*******************************************************************************
+ *                        GLOBAL FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void bridge_init(bridge_send_t send, bridge_handler_t default_handler)
+{
+	uint8_t i;
+
+	send_fn = send;
+	default_fn = default_handler;
+	local_count = 0;
+	subscriptions_count = 0;
+	for(i = 0; i < BRIDGE_MAX_TOPICS; i++)
+	{
+		remote_topics[i].bound = false;
+		remote_topics[i].requested = false;
+	}
+}
+
+
+uint8_t bridge_bind(const char * name)
+{
+	uint8_t id = bridge_find(name);
+
+	if(id == BRIDGE_INVALID_ID)
+	{
+		if(local_count == BRIDGE_MAX_TOPICS || strlen(name) >= BRIDGE_MAX_TOPIC_LEN)
+			return BRIDGE_INVALID_ID;
+		id = local_count++;
+		strcpy(local_topics[id].name, name);
+		local_topics[id].hash = bridge_hash(name);
+	}
+	bridge_send_bind(id);
+	return id;
+}
+
+
+uint8_t bridge_find(const char * name)
+{
+	uint32_t hash = bridge_hash(name);
+	uint8_t i;
+
+	// El hash descarta casi todos los topics; strcmp solo confirma el que coincide
+	for(i = 0; i < local_count; i++)
+	{
+		if(local_topics[i].hash == hash && !strcmp(local_topics[i].name, name))
+			return i;
+	}
+	return BRIDGE_INVALID_ID;
+}
+
+
+bool bridge_publish(uint8_t topic_id, const uint8_t * payload, uint8_t len)
+{
+	if(topic_id >= local_count || len > BRIDGE_MAX_PAYLOAD)
+		return false;
+	bridge_send_frame(FRAME_TYPE_PUBLISH, topic_id, payload, len);
+	return true;
+}
+
+
+bool bridge_on_topic(const char * name, bridge_handler_t handler)
+{
+	uint8_t i;
+
+	if(subscriptions_count == BRIDGE_MAX_TOPICS || strlen(name) >= BRIDGE_MAX_TOPIC_LEN)
+		return false;
+	strcpy(subscriptions[subscriptions_count].name, name);
+	subscriptions[subscriptions_count].handler = handler;
+	subscriptions_count++;
+
+	// Si el otro lado ya lo anuncio, lo resuelvo ahora
+	for(i = 0; i < BRIDGE_MAX_TOPICS; i++)
+	{
+		if(remote_topics[i].bound && !strcmp(remote_topics[i].name, name))
+			remote_topics[i].handler = handler;
+	}
+	return true;
+}
+
+
+const char * bridge_remote_name(uint8_t topic_id)
+{
+	if(topic_id >= BRIDGE_MAX_TOPICS || !remote_topics[topic_id].bound)
+		return NULL;
+	return remote_topics[topic_id].name;
+}
+
+
+void bridge_rebind_all(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < local_count; i++)
+		bridge_send_bind(i);
+}
+
+
+void bridge_request_binds(void)
+{
+	uint8_t out[FRAME_ENCODED_LEN(0)];
+
+	if(send_fn != NULL)
+		send_fn(out, frame_encode(FRAME_TYPE_BIND_REQUEST, NULL, 0, out, sizeof(out)));
+}
+
+
+void bridge_handle_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	remote_topic_t * topic;
+	bridge_handler_t handler;
+
+	if(type == FRAME_TYPE_BIND_REQUEST)
+	{
+		bridge_rebind_all();
+		return;
+	}
+	if(len == 0 || payload[0] >= BRIDGE_MAX_TOPICS)
+		return;
+
+	topic = &remote_topics[payload[0]];
+	if(type == FRAME_TYPE_BIND)
+	{
+		if(len - 1 >= BRIDGE_MAX_TOPIC_LEN)
+			return;
+		memcpy(topic->name, &payload[1], len - 1);
+		topic->name[len - 1] = '\0';
+		topic->handler = bridge_lookup_handler(topic->name);
+		topic->bound = true;
+		topic->requested = false;
+	}
+	else if(type == FRAME_TYPE_PUBLISH)
+	{
+		if(!topic->bound) // Me perdi el BIND: pido que lo repitan, una sola vez hasta que llegue
+		{
+			if(!topic->requested)
+			{
+				topic->requested = true;
+				bridge_request_binds();
+			}
+			return;
+		}
+		handler = (topic->handler != NULL)?(topic->handler):(default_fn);
+		if(handler != NULL)
+			handler(payload[0], &payload[1], len - 1);
+	}
+}
+
+
+/*******************************************************************************
+ *                       LOCAL FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static uint32_t bridge_hash(const char * name)
+{
+	uint32_t hash = FNV_OFFSET;
+
+	while(*name)
+	{
+		hash ^= (uint8_t)*name++;
+		hash *= FNV_PRIME;
+	}
+	return hash;
+}
+
+static void bridge_send_frame(uint8_t type, uint8_t id, const uint8_t * data, uint8_t len)
+{
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+	uint8_t out[FRAME_ENCODED_LEN(FRAME_MAX_PAYLOAD)];
+
+	if(send_fn == NULL)
+		return;
+	payload[0] = id;
+	memcpy(&payload[1], data, len);
+	send_fn(out, frame_encode(type, payload, len + 1, out, sizeof(out)));
+}
+
+static void bridge_send_bind(uint8_t id)
+{
+	bridge_send_frame(FRAME_TYPE_BIND, id, (const uint8_t *)local_topics[id].name, strlen(local_topics[id].name));
+}
+
+static bridge_handler_t bridge_lookup_handler(const char * name)
+{
+	uint8_t i;
+
+	for(i = 0; i < subscriptions_count; i++)
+	{
+		if(!strcmp(subscriptions[i].name, name))
+			return subscriptions[i].handler;
+	}
+	return NULL;
+}
@@ -20,7 +20,14 @@
 #define UART_DEFAULT_BAUDRATE 9600
 #define UART_HAL_DEFAULT_BAUDRATE 9600
 
-#define MAX_BUFFER_LEN 101
+#define UART_SBR_MAX	0x1FFF	// SBR es de 13 bits
+#define UART_BRFA_STEPS	32		// BRFA agrega fracciones de 1/32 al SBR
+
+#define UART_FIFO_DEPTH(x) (((x) == 0)?(1):(1 << ((x) + 1))) // Codificacion de PFIFO_TXFIFOSIZE/RXFIFOSIZE
+
+#define UART_CLOCK(id) (((id) < 2)?(__CORE_CLOCK__):(__CORE_CLOCK__ >> 1)) // UART0/1 usan el core clock, el resto el bus clock
+
+#define UART_IS_POW2(x) (((x) != 0) && (((x) & ((x) - 1)) == 0))
 
 #define ISR_TDRE(x) (((x) & UART_S1_TDRE_MASK) != 0x0)
 #define ISR_RDRF(x) (((x) & UART_S1_RDRF_MASK) != 0x0)
@@ -31,36 +38,94 @@
 #define ISR_FE(x) (((x) & UART_S1_FE_MASK) != 0x0)
 #define ISR_PF(x) (((x) & UART_S1_PF_MASK) != 0x0)
 
-#define MSG_LEN(x,y,z) (((x)+(z)-(y)) % ((z) - 1 )) // MSG_LEN(rear, front, max_len)
+_Static_assert(UART_IS_POW2(UART0_RX_BUFFER_LEN) && UART_IS_POW2(UART0_TX_BUFFER_LEN), "UART0 buffers must be a power of two");
+_Static_assert(UART_IS_POW2(UART1_RX_BUFFER_LEN) && UART_IS_POW2(UART1_TX_BUFFER_LEN), "UART1 buffers must be a power of two");
+_Static_assert(UART_IS_POW2(UART2_RX_BUFFER_LEN) && UART_IS_POW2(UART2_TX_BUFFER_LEN), "UART2 buffers must be a power of two");
+_Static_assert(UART_IS_POW2(UART3_RX_BUFFER_LEN) && UART_IS_POW2(UART3_TX_BUFFER_LEN), "UART3 buffers must be a power of two");
+_Static_assert(UART_IS_POW2(UART4_RX_BUFFER_LEN) && UART_IS_POW2(UART4_TX_BUFFER_LEN), "UART4 buffers must be a power of two");
 
 #define UART_PORTS	{PORTB, PORTC, PORTD, PORTC, PORTE}
+
+#define UART_DMA_TX_CH(id)	((id) << 1)			// Canales de eDMA fijos por UART
+#define UART_DMA_RX_CH(id)	(((id) << 1) + 1)
+#define UART_DMA_TX_SOURCES	{3, 5, 7, 9, 0}		// UART4 tiene una sola fuente para TX y RX: se usa para RX
+#define UART_DMA_RX_SOURCES	{2, 4, 6, 8, 10}
+#define UART_DMA_MAX_LEN	0x7FFF				// CITER/BITER de 15 bits
+_Static_assert(UART0_RX_BUFFER_LEN <= UART_DMA_MAX_LEN && UART1_RX_BUFFER_LEN <= UART_DMA_MAX_LEN &&
+		UART2_RX_BUFFER_LEN <= UART_DMA_MAX_LEN && UART3_RX_BUFFER_LEN <= UART_DMA_MAX_LEN &&
+		UART4_RX_BUFFER_LEN <= UART_DMA_MAX_LEN, "RX buffers are used as DMA rings");
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+/*
+ * Ring single-producer/single-consumer. head lo escribe solo el productor y tail
+ * solo el consumidor; los dos corren libres y se enmascaran al indexar, asi que
+ * head - tail es siempre la cantidad de bytes y no se desperdicia ningun lugar.
+ */
+typedef struct {
+	uint8_t * const buffer;
+	const uint32_t mask;
+	volatile uint32_t head;
+	volatile uint32_t tail;
+} uart_ring_t;
+
+#define RING_INIT(buf)		{(buf), sizeof(buf) - 1, 0, 0}
+#define RING_SIZE(r)		((r)->mask + 1)
+#define RING_LEN(r)			((size_t)((r)->head - (r)->tail))
+#define RING_FREE(r)		((size_t)(RING_SIZE(r) - RING_LEN(r)))
 /*******************************************************************************
  * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
  ******************************************************************************/
 
-void UART_set_baud_rate(UART_Type * uart, uint32_t baudrate);
+bool UART_set_baud_rate(UART_Type * uart, uint8_t id, uint32_t baudrate);
 void UART_set_parity(UART_Type * uart, uart_parity_t parity);
 void UART_rx_tx_irq_handler(UART_Type * p_uart, uint8_t id);
+void UART_dma_init(UART_Type * p_uart, uint8_t id);
+size_t UART_dma_rx_len(uint8_t id);
+void UART_dma_tx_start(uint8_t id, uint32_t saddr, uint16_t cant);
+void UART_dma_tx_kick(uint8_t id);
+void UART_tx_start(uint8_t id);
+size_t UART_ring_spans(uart_ring_t * ring, uint32_t from, size_t len, uart_span_t spans[2]);
+void UART_dma_irq_handler(uint8_t ch);
 
 /*******************************************************************************
  * PRIVATE VARIABLES WITH FILE LEVEL SCOPE
  ******************************************************************************/
 
-static uint8_t buffer_out[UART_CANT_IDS][MAX_BUFFER_LEN];
-static uint8_t p_out_rear[UART_CANT_IDS], p_out_front[UART_CANT_IDS];
+static uint8_t buffer_out0[UART0_TX_BUFFER_LEN], buffer_in0[UART0_RX_BUFFER_LEN];
+static uint8_t buffer_out1[UART1_TX_BUFFER_LEN], buffer_in1[UART1_RX_BUFFER_LEN];
+static uint8_t buffer_out2[UART2_TX_BUFFER_LEN], buffer_in2[UART2_RX_BUFFER_LEN];
+static uint8_t buffer_out3[UART3_TX_BUFFER_LEN], buffer_in3[UART3_RX_BUFFER_LEN];
+static uint8_t buffer_out4[UART4_TX_BUFFER_LEN], buffer_in4[UART4_RX_BUFFER_LEN];
 
-static uint8_t buffer_in[UART_CANT_IDS][MAX_BUFFER_LEN];
-static uint8_t p_in_rear[UART_CANT_IDS], p_in_front[UART_CANT_IDS];
+static uart_ring_t buffer_out[UART_CANT_IDS] = {RING_INIT(buffer_out0), RING_INIT(buffer_out1),
+		RING_INIT(buffer_out2), RING_INIT(buffer_out3), RING_INIT(buffer_out4)};
+static uart_ring_t buffer_in[UART_CANT_IDS] = {RING_INIT(buffer_in0), RING_INIT(buffer_in1),
+		RING_INIT(buffer_in2), RING_INIT(buffer_in3), RING_INIT(buffer_in4)};
 
 static bool uart_use[UART_CANT_IDS] = {false};
+
+static uint8_t tx_fifo_depth[UART_CANT_IDS], rx_fifo_depth[UART_CANT_IDS];
+
+static uint32_t isr_count[UART_CANT_IDS], isr_bytes[UART_CANT_IDS];
+
+static uint32_t uart_baudrate[UART_CANT_IDS];
+static int32_t uart_baudrate_error[UART_CANT_IDS];
+
+static uart_mode_t uart_mode[UART_CANT_IDS];
+static uart_callback_t dma_tx_callback[UART_CANT_IDS];
+static volatile bool dma_tx_busy[UART_CANT_IDS];
+static uint16_t dma_tx_ring_chunk[UART_CANT_IDS];		// Bytes de buffer_out en vuelo, 0 si es un buffer del usuario
+static volatile uint32_t dma_rx_wraps[UART_CANT_IDS];	// Vueltas completas del ring de RX
+static uint32_t rx_overrun[UART_CANT_IDS];
 /*******************************************************************************
  *                        GLOBAL FUNCTION DEFINITIONS
  ******************************************************************************/
 
-void UART_init (uint8_t id, uart_cfg_t config)
+bool UART_init (uint8_t id, uart_cfg_t config)
 {
-	uint8_t i;
-
 	/********* Tomo el puerto ***********/
 	PORT_Type * arr_uart_ports[] = UART_PORTS;
 	uint8_t ports_number[] = {16,3,2,16,25};
@@ -72,17 +137,15 @@ void UART_init (uint8_t id, uart_cfg_t config)
 	UART_Type * ptr_s[] = UART_BASE_PTRS;
 	UART_Type * p_uart = ptr_s[id];
 
+	// Un baudrate imposible no se cambia por otro: no se toca el UART
+	if(!UART_set_baud_rate(NULL, id, config.baudrate))
+		return false;
 
-	p_out_rear[id] = 0;
-	p_out_front[id] = 1;
-	p_in_rear[id] = 0;
-	p_in_front[id] = 1;
-	for(i = 0; i < MAX_BUFFER_LEN; i++)
-	{
-		buffer_out[id][i] = 0;
-		buffer_in[id][i] = 0;
-	}
+	buffer_out[id].head = buffer_out[id].tail = 0;
+	buffer_in[id].head = buffer_in[id].tail = 0;
 	uart_use[id] = true;
+	uart_mode[id] = config.mode;
+	rx_overrun[id] = 0;
 
 	if(id == 4 || id == 5)
 	{
@@ -95,7 +158,7 @@ void UART_init (uint8_t id, uart_cfg_t config)
 		NVIC_EnableIRQ(UART0_RX_TX_IRQn+id*2);
 	}
 
-	UART_set_baud_rate(p_uart, config.baudrate);
+	UART_set_baud_rate(p_uart, id, config.baudrate);
 	UART_set_parity(p_uart, config.parity);
 
 	uart_port->PCR[rx] = 0;
@@ -107,58 +170,209 @@ void UART_init (uint8_t id, uart_cfg_t config)
 	uart_port->PCR[rx] |= PORT_PCR_IRQC(0); // Disable interrupts
 	uart_port->PCR[tx] |= PORT_PCR_IRQC(0);
 
-	p_uart->C2 = UART_C2_TE_MASK | UART_C2_RE_MASK | UART_C2_RIE_MASK ;
+	/********* FIFOs de hardware ***********/
+	// PFIFO solo se puede modificar con TE y RE apagados
+	p_uart->C2 &= ~(UART_C2_TE_MASK | UART_C2_RE_MASK);
+	tx_fifo_depth[id] = UART_FIFO_DEPTH((p_uart->PFIFO & UART_PFIFO_TXFIFOSIZE_MASK) >> UART_PFIFO_TXFIFOSIZE_SHIFT);
+	rx_fifo_depth[id] = UART_FIFO_DEPTH((p_uart->PFIFO & UART_PFIFO_RXFIFOSIZE_MASK) >> UART_PFIFO_RXFIFOSIZE_SHIFT);
+	p_uart->PFIFO |= UART_PFIFO_TXFE_MASK | UART_PFIFO_RXFE_MASK;
+	p_uart->CFIFO = UART_CFIFO_TXFLUSH_MASK | UART_CFIFO_RXFLUSH_MASK;
+	// TDRE cuando queda lugar para la mitad de la FIFO, RDRF cuando llega a la mitad
+	p_uart->TWFIFO = UART_TWFIFO_TXWATER(tx_fifo_depth[id] >> 1);
+	p_uart->RWFIFO = UART_RWFIFO_RXWATER((rx_fifo_depth[id] > 1)?(rx_fifo_depth[id] >> 1):(1));
+	isr_count[id] = 0;
+	isr_bytes[id] = 0;
+	/********************************************/
 
+	if(uart_mode[id] == UART_MODE_DMA)
+	{
+		UART_dma_init(p_uart, id);
+		// RIE con RDMAS pide DMA en vez de interrupcion
+		p_uart->C2 = UART_C2_TE_MASK | UART_C2_RE_MASK | UART_C2_RIE_MASK;
+	}
+	else
+	{
+		// ILIE para levantar los bytes que quedan por debajo del watermark al terminar una trama
+		p_uart->C2 = UART_C2_TE_MASK | UART_C2_RE_MASK | UART_C2_RIE_MASK | UART_C2_ILIE_MASK;
+	}
+	return true;
 }
 
 
 bool UART_is_rx_msg(uint8_t id)
 {
-	return MSG_LEN(p_in_rear[id], p_in_front[id], MAX_BUFFER_LEN) != 0;
+	return UART_get_rx_msg_length(id) != 0;
 }
 
 
 
-uint8_t UART_get_rx_msg_length(uint8_t id)
+size_t UART_get_rx_msg_length(uint8_t id)
 {
-	return MSG_LEN(p_in_rear[id], p_in_front[id], MAX_BUFFER_LEN);
+	if(uart_mode[id] == UART_MODE_DMA)
+		return UART_dma_rx_len(id);
+	return RING_LEN(&buffer_in[id]);
 }
 
 
-uint8_t UART_read_msg(uint8_t id, char* msg, uint8_t cant)
+size_t UART_read_msg(uint8_t id, char* msg, size_t cant)
 {
-	uint8_t i,len_read = MSG_LEN(p_in_rear[id], p_in_front[id], MAX_BUFFER_LEN);
+	uart_ring_t * ring = &buffer_in[id];
+	size_t i, len_read = UART_get_rx_msg_length(id); // En modo DMA tambien descarta lo pisado por un overrun
+	uint32_t tail = ring->tail;
+
 	if(len_read > cant)
 		len_read = cant;
 
+	__DMB(); // Leo los datos recien despues de haber visto head
 	for(i = 0; i<len_read; i++)
 	{
-		msg[i] = buffer_in[id][p_in_front[id]];
-		p_in_front[id] = (p_in_front[id] + 1) % (MAX_BUFFER_LEN - 1 );
+		msg[i] = ring->buffer[tail & ring->mask];
+		tail++;
 	}
+	__DMB(); // Termino de leer antes de liberar el lugar
+	ring->tail = tail;
 	return len_read;
 }
 
 
-uint8_t UART_write_msg(uint8_t id, const char* msg, uint8_t cant)
+size_t UART_write_msg(uint8_t id, const char* msg, size_t cant)
 {
-	uint8_t len_write = 0;
-	UART_Type * ptr_s[] = UART_BASE_PTRS;
+	uart_ring_t * ring = &buffer_out[id];
+	size_t i, len_write = RING_FREE(ring);
+	uint32_t head = ring->head;
+
+	if(len_write > cant)
+		len_write = cant;
 
-	while((cant > len_write) && (((p_out_rear[id] + 2) % (MAX_BUFFER_LEN - 1)) != p_out_front[id])) // Buffer full
+	for(i = 0; i < len_write; i++)
 	{
-		p_out_rear[id] = (p_out_rear[id] + 1) % (MAX_BUFFER_LEN - 1); // Incremento circular
-		buffer_out[id][p_out_rear[id]] = msg[len_write];
-		len_write++;
+		ring->buffer[head & ring->mask] = msg[i];
+		head++;
 	}
-	ptr_s[id]->C2 |= UART_C2_TIE_MASK; // Enable tie interrupts
+	__DMB(); // Los datos quedan escritos antes de publicar head
+	ring->head = head;
+
+	UART_tx_start(id);
 	return len_write;
 }
 
 
+size_t UART_rx_peek(uint8_t id, uart_span_t spans[2])
+{
+	uart_ring_t * ring = &buffer_in[id];
+	size_t len = UART_get_rx_msg_length(id);
+
+	__DMB(); // El llamador lee los datos recien despues de haber visto head
+	return UART_ring_spans(ring, ring->tail, len, spans);
+}
+
+
+void UART_rx_commit(uint8_t id, size_t cant)
+{
+	uart_ring_t * ring = &buffer_in[id];
+	size_t len = RING_LEN(ring);
+
+	if(cant > len) // En modo DMA un overrun pudo haber descartado parte de lo que se miro
+		cant = len;
+	__DMB(); // El llamador termino de leer antes de liberar el lugar
+	ring->tail += cant;
+}
+
+
+size_t UART_tx_reserve(uint8_t id, uart_span_t spans[2])
+{
+	uart_ring_t * ring = &buffer_out[id];
+
+	return UART_ring_spans(ring, ring->head, RING_FREE(ring), spans);
+}
+
+
+void UART_tx_commit(uint8_t id, size_t cant)
+{
+	uart_ring_t * ring = &buffer_out[id];
+
+	if(cant > RING_FREE(ring))
+		cant = RING_FREE(ring);
+	__DMB(); // Los datos quedan escritos antes de publicar head
+	ring->head += cant;
+
+	UART_tx_start(id);
+}
+
+
 bool UART_is_tx_msg_complete(uint8_t id)
 {
-	return MSG_LEN(p_out_rear[id], p_out_front[id], MAX_BUFFER_LEN) == 0;
+	if(uart_mode[id] == UART_MODE_DMA)
+		return !dma_tx_busy[id] && RING_LEN(&buffer_out[id]) == 0;
+	return RING_LEN(&buffer_out[id]) == 0;
+}
+
+uint32_t UART_get_baudrate(uint8_t id, int32_t * error_ppm)
+{
+	if(error_ppm != NULL)
+		*error_ppm = uart_baudrate_error[id];
+	return uart_baudrate[id];
+}
+
+uint32_t UART_compute_baudrate(uint32_t clock, uint32_t baudrate, uint16_t * sbr, uint8_t * brfa)
+{
+	uint32_t div, achieved;
+
+	if(baudrate == 0 || baudrate > UART_MAX_BAUDRATE)
+		return 0;
+
+	// baud = clock / (16 * (SBR + BRFA/32))  =>  32*SBR + BRFA = 2*clock / baud
+	div = (uint32_t)((((uint64_t)clock << 1) + (baudrate >> 1)) / baudrate); // Redondeo al mas cercano
+
+	if(div < UART_BRFA_STEPS || (div / UART_BRFA_STEPS) > UART_SBR_MAX)
+		return 0;
+
+	achieved = (uint32_t)((((uint64_t)clock << 1) + (div >> 1)) / div);
+
+	if(sbr != NULL)
+		*sbr = div / UART_BRFA_STEPS;
+	if(brfa != NULL)
+		*brfa = div % UART_BRFA_STEPS;
+
+	return achieved;
+}
+
+bool UART_write_dma(uint8_t id, const uint8_t* msg, uint16_t cant, uart_callback_t callback)
+{
+	if(uart_mode[id] != UART_MODE_DMA || id == 4 || cant == 0 || cant > UART_DMA_MAX_LEN)
+		return false;
+
+	hw_DisableInterrupts();
+	if(dma_tx_busy[id])
+	{
+		hw_EnableInterrupts();
+		return false;
+	}
+	dma_tx_callback[id] = callback;
+	dma_tx_ring_chunk[id] = 0;
+	UART_dma_tx_start(id, (uint32_t)msg, cant);
+	hw_EnableInterrupts();
+	return true;
+}
+
+uint32_t UART_get_rx_overrun(uint8_t id)
+{
+	if(uart_mode[id] == UART_MODE_DMA)
+		UART_dma_rx_len(id); // Actualiza la cuenta
+	return rx_overrun[id];
+}
+
+uint32_t UART_get_isr_per_kb(uint8_t id)
+{
+	if(isr_bytes[id] == 0)
+		return 0;
+	return (uint32_t)(((uint64_t)isr_count[id] << 10) / isr_bytes[id]);
+}
+
+void UART_reset_isr_stats(uint8_t id)
+{
+	isr_count[id] = 0;
+	isr_bytes[id] = 0;
 }
 
 unsigned char UART_Recieve_Data(void)
@@ -180,22 +394,60 @@ void UART_Send_Data(unsigned char tx_data)
  *                       LOCAL FUNCTION DEFINITIONS
  ******************************************************************************/
 
-void UART_set_baud_rate(UART_Type * uart, uint32_t baudrate)
+size_t UART_ring_spans(uart_ring_t * ring, uint32_t from, size_t len, uart_span_t spans[2])
+{
+	size_t first = RING_SIZE(ring) - (from & ring->mask); // Hasta el final del buffer
+
+	if(first > len)
+		first = len;
+	spans[0].data = &ring->buffer[from & ring->mask];
+	spans[0].len = first;
+	spans[1].data = ring->buffer;
+	spans[1].len = len - first;
+	return len;
+}
+
+void UART_tx_start(uint8_t id)
+{
+	UART_Type * ptr_s[] = UART_BASE_PTRS;
+
+	// UART4 no tiene fuente de DMA para TX: aun en modo DMA transmite por interrupcion (TDMAS apagado)
+	if(uart_mode[id] == UART_MODE_DMA && id != 4)
+	{
+		hw_DisableInterrupts();
+		if(!dma_tx_busy[id])
+			UART_dma_tx_kick(id);
+		hw_EnableInterrupts();
+	}
+	else
+	{
+		ptr_s[id]->C2 |= UART_C2_TIE_MASK; // Enable tie interrupts
+	}
+}
+
+bool UART_set_baud_rate(UART_Type * uart, uint8_t id, uint32_t baudrate)
 {
-	uint16_t sbr, brfa;
-	uint32_t clock;
+	uint16_t sbr;
+	uint8_t brfa;
+	uint32_t clock, achieved;
 
-	clock = ((uart == UART0) || (uart == UART1))? (__CORE_CLOCK__):(__CORE_CLOCK__ >> 1);
+	clock = UART_CLOCK(id);
 
-	baudrate = ((baudrate == 0)?(UART_HAL_DEFAULT_BAUDRATE):
-			((baudrate > 0x1FFF)?(UART_DEFAULT_BAUDRATE):(baudrate)));
+	if(baudrate == 0)
+		baudrate = UART_HAL_DEFAULT_BAUDRATE;
 
-	sbr = clock / (baudrate<<4);
-	brfa = (clock<<1) / baudrate - (sbr<<5);
+	// El error es siempre contra lo pedido: fuera de rango queda en 0 baudios, -1000000 ppm
+	achieved = UART_compute_baudrate(clock, baudrate, &sbr, &brfa);
+	uart_baudrate[id] = achieved;
+	uart_baudrate_error[id] = (int32_t)(((int64_t)achieved - baudrate) * 1000000 / baudrate);
+
+	if(achieved == 0 || uart == NULL) // Baudrate fuera de rango para este clock, o solo se valida
+		return achieved != 0;
 
 	uart->BDH = UART_BDH_SBR(sbr >> 8);
 	uart->BDL = UART_BDL_SBR(sbr);
 	uart->C4 = (uart->C4 & ~UART_C4_BRFA_MASK) | UART_C4_BRFA(brfa);
+	return true;
 }
 
 void UART_set_parity(UART_Type * uart, uart_parity_t parity)
@@ -209,43 +461,86 @@ void UART_set_parity(UART_Type * uart, uart_parity_t parity)
 
 void UART_rx_tx_irq_handler(UART_Type * p_uart, uint8_t id)
 {
-	unsigned char tmp, i, rx_data, tx_data;
+	unsigned char tmp, i, rx_data;
+	uint8_t room;
+	uint32_t head, tail;
+	uart_ring_t * ring;
+	bool drained = false;
 	i = id;
 	tmp=p_uart->S1;
-	if(ISR_TDRE(tmp))
+	isr_count[i]++;
+	if(ISR_TDRE(tmp) && (p_uart->C2 & UART_C2_TIE_MASK))
 	{
-		uint8_t msg_len = MSG_LEN(p_out_rear[i], p_out_front[i], MAX_BUFFER_LEN);
-		if(msg_len != 0) // Si tengo caracteres en la cola lo mando
+		// Lleno la FIFO de TX con lo que haya en la cola
+		ring = &buffer_out[i];
+		head = ring->head;
+		tail = ring->tail;
+		__DMB(); // Leo los datos recien despues de haber visto head
+		room = tx_fifo_depth[i] - p_uart->TCFIFO;
+		while(tail != head && room != 0)
 		{
-			tx_data = buffer_out[i][p_out_front[i]];
-			p_out_front[i] = (p_out_front[i] + 1) % (MAX_BUFFER_LEN - 1 );
-			p_uart->D = tx_data; // Transmito
-
-			if(msg_len == 1) //Clear tie interrupt when buffer is empty
-				p_uart->C2 = (p_uart->C2 & ~UART_C2_TIE_MASK);
+			p_uart->D = ring->buffer[tail & ring->mask]; // Transmito
+			tail++;
+			room--;
+			isr_bytes[i]++;
 		}
-		else
-		{
-			//ERROR no message to send,
-		}
-
+		ring->tail = tail;
+		if(tail == head) //Clear tie interrupt when buffer is empty
+			p_uart->C2 = (p_uart->C2 & ~UART_C2_TIE_MASK);
 	}
 	if(ISR_TC(tmp)) //creo que no vale la pena usarlo
 	{
 
 	}
-	if(ISR_RDRF(tmp))
+	if((ISR_RDRF(tmp) || ISR_IDLE(tmp)) && uart_mode[i] != UART_MODE_DMA) // En modo DMA el RX es del DMA
 	{
-		rx_data=p_uart->D;
-		if (((p_in_rear[i] + 2) % (MAX_BUFFER_LEN - 1)) != p_in_front[i]) // Buffer full
+		// Vacio la FIFO de RX: por watermark (RDRF) o por fin de trama (IDLE)
+		ring = &buffer_in[i];
+		head = ring->head;
+		tail = ring->tail;
+		while(p_uart->RCFIFO != 0)
 		{
-			p_in_rear[i] = (p_in_rear[i] + 1) % (MAX_BUFFER_LEN - 1); // Incremento circular
-			buffer_in[i][p_in_rear[i]] = rx_data;
+			rx_data=p_uart->D;
+			drained = true;
+			isr_bytes[i]++;
+			if ((head - tail) != RING_SIZE(ring)) // Buffer full
+			{
+				ring->buffer[head & ring->mask] = rx_data;
+				head++;
+			}
+			else
+			{
+				rx_overrun[i]++;
+			}
 		}
+		__DMB(); // Los datos quedan escritos antes de publicar head
+		ring->head = head;
 	}
-	if(ISR_IDLE(tmp)) //creo que no vale la pena usarlo
+	if(ISR_IDLE(tmp) && !drained && uart_mode[i] != UART_MODE_DMA)
 	{
-
+		// IDLE se limpia leyendo S1 y despues D. Si el vaciado ya leyo D no hace falta.
+		// Con la FIFO vacia la lectura da underflow; si justo llego un byte no hay underflow y se guarda
+		rx_data = p_uart->D;
+		if(p_uart->SFIFO & UART_SFIFO_RXUF_MASK)
+		{
+			// El underflow deja mal los punteros de la FIFO: se vacia (ya esta vacia) como hace el SDK de NXP
+			p_uart->SFIFO = UART_SFIFO_RXUF_MASK;
+			p_uart->CFIFO |= UART_CFIFO_RXFLUSH_MASK;
+		}
+		else
+		{
+			ring = &buffer_in[i];
+			if ((ring->head - ring->tail) != RING_SIZE(ring))
+			{
+				ring->buffer[ring->head & ring->mask] = rx_data;
+				__DMB();
+				ring->head++;
+			}
+			else
+			{
+				rx_overrun[i]++;
+			}
+		}
 	}
 	if(ISR_OR(tmp))
 	{
@@ -265,6 +560,204 @@ void UART_rx_tx_irq_handler(UART_Type * p_uart, uint8_t id)
 	}
 }
 
+void UART_dma_init(UART_Type * p_uart, uint8_t id)
+{
+	uint8_t tx_sources[] = UART_DMA_TX_SOURCES;
+	uint8_t rx_sources[] = UART_DMA_RX_SOURCES;
+	uint8_t tx_ch = UART_DMA_TX_CH(id), rx_ch = UART_DMA_RX_CH(id);
+
+	SIM->SCGC6 |= SIM_SCGC6_DMAMUX_MASK;
+	SIM->SCGC7 |= SIM_SCGC7_DMA_MASK;
+
+	dma_tx_busy[id] = false;
+	dma_tx_callback[id] = NULL;
+	dma_tx_ring_chunk[id] = 0;
+	dma_rx_wraps[id] = 0;
+
+	// Un pedido de DMA por byte
+	p_uart->RWFIFO = UART_RWFIFO_RXWATER(1);
+
+	/********* TX: del buffer del usuario a D ***********/
+	if(id != 4)
+	{
+		DMAMUX->CHCFG[tx_ch] = 0;
+		DMA0->TCD[tx_ch].DADDR = (uint32_t)&p_uart->D;
+		DMA0->TCD[tx_ch].DOFF = 0;
+		DMA0->TCD[tx_ch].DLAST_SGA = 0;
+		DMA0->TCD[tx_ch].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+		DMA0->TCD[tx_ch].NBYTES_MLNO = 1;
+		DMAMUX->CHCFG[tx_ch] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(tx_sources[id]);
+		NVIC_EnableIRQ(DMA0_IRQn + tx_ch);
+		p_uart->C5 |= UART_C5_TDMAS_MASK;
+	}
+	/****************************************************/
+
+	/********* RX: ring circular sobre buffer_in ***********/
+	DMAMUX->CHCFG[rx_ch] = 0;
+	DMA0->TCD[rx_ch].SADDR = (uint32_t)&p_uart->D;
+	DMA0->TCD[rx_ch].SOFF = 0;
+	DMA0->TCD[rx_ch].SLAST = 0;
+	DMA0->TCD[rx_ch].DADDR = (uint32_t)buffer_in[id].buffer;
+	DMA0->TCD[rx_ch].DOFF = 1;
+	DMA0->TCD[rx_ch].DLAST_SGA = -(int32_t)RING_SIZE(&buffer_in[id]); // Vuelve al principio del ring
+	DMA0->TCD[rx_ch].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+	DMA0->TCD[rx_ch].NBYTES_MLNO = 1;
+	DMA0->TCD[rx_ch].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(RING_SIZE(&buffer_in[id]));
+	DMA0->TCD[rx_ch].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(RING_SIZE(&buffer_in[id]));
+	DMA0->TCD[rx_ch].CSR = DMA_CSR_INTMAJOR_MASK; // Sin DREQ: corre para siempre, la interrupcion cuenta vueltas
+	DMAMUX->CHCFG[rx_ch] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(rx_sources[id]);
+	NVIC_EnableIRQ(DMA0_IRQn + rx_ch);
+	DMA0->SERQ = DMA_SERQ_SERQ(rx_ch);
+	p_uart->C5 |= UART_C5_RDMAS_MASK;
+	/****************************************************/
+}
+
+size_t UART_dma_rx_len(uint8_t id)
+{
+	uart_ring_t * ring = &buffer_in[id];
+	uint32_t wraps, written, len, size = RING_SIZE(ring);
+	uint16_t citer;
+	uint8_t ch = UART_DMA_RX_CH(id);
+
+	// Releo si la interrupcion de fin de vuelta cayo en el medio
+	do
+	{
+		wraps = dma_rx_wraps[id];
+		citer = DMA0->TCD[ch].CITER_ELINKNO & DMA_CITER_ELINKNO_CITER_MASK;
+	} while(wraps != dma_rx_wraps[id]);
+
+	// El productor es el DMA: head sale de la cantidad de vueltas y de CITER
+	written = wraps * size + (size - citer);
+	len = written - ring->tail;
+	if((int32_t)len < 0) // CITER ya recargo pero la interrupcion sigue pendiente: quedo antes de tail
+	{
+		written += size;
+		len = written - ring->tail;
+	}
+	ring->head = written;
+	if(len > size) // El DMA piso bytes sin leer: me quedo con los ultimos
+	{
+		rx_overrun[id] += len - size;
+		ring->tail = written - size;
+		len = size;
+	}
+	return len;
+}
+
+void UART_dma_tx_start(uint8_t id, uint32_t saddr, uint16_t cant)
+{
+	UART_Type * ptr_s[] = UART_BASE_PTRS;
+	uint8_t ch = UART_DMA_TX_CH(id);
+
+	dma_tx_busy[id] = true;
+
+	DMA0->TCD[ch].SADDR = saddr;
+	DMA0->TCD[ch].SOFF = 1;
+	DMA0->TCD[ch].SLAST = 0;
+	DMA0->TCD[ch].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(cant);
+	DMA0->TCD[ch].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(cant);
+	DMA0->TCD[ch].CSR = DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK; // Se apaga solo al terminar
+	DMA0->SERQ = DMA_SERQ_SERQ(ch);
+
+	ptr_s[id]->C2 |= UART_C2_TIE_MASK; // Con TDMAS, TDRE pide DMA
+}
+
+void UART_dma_tx_kick(uint8_t id)
+{
+	uart_ring_t * ring = &buffer_out[id];
+	uint32_t tail = ring->tail, chunk;
+
+	if(id == 4)
+		return;
+
+	// El DMA no sabe dar la vuelta al ring: mando hasta el final del buffer y sigo en la proxima
+	chunk = ring->head - tail;
+	if(chunk > RING_SIZE(ring) - (tail & ring->mask))
+		chunk = RING_SIZE(ring) - (tail & ring->mask);
+	if(chunk > UART_DMA_MAX_LEN)
+		chunk = UART_DMA_MAX_LEN;
+	if(chunk == 0)
+		return;
+
+	dma_tx_callback[id] = NULL;
+	dma_tx_ring_chunk[id] = chunk;
+	UART_dma_tx_start(id, (uint32_t)&ring->buffer[tail & ring->mask], chunk);
+}
+
+void UART_dma_irq_handler(uint8_t ch)
+{
+	UART_Type * ptr_s[] = UART_BASE_PTRS;
+	uint8_t id = ch >> 1;
+	uart_callback_t callback;
+
+	DMA0->CINT = DMA_CINT_CINT(ch);
+
+	if(ch == UART_DMA_RX_CH(id))
+	{
+		dma_rx_wraps[id]++;
+	}
+	else
+	{
+		ptr_s[id]->C2 &= ~UART_C2_TIE_MASK;
+		callback = dma_tx_callback[id];
+		if(dma_tx_ring_chunk[id] != 0)
+		{
+			__DMB(); // El DMA termino de leer antes de liberar el lugar
+			buffer_out[id].tail += dma_tx_ring_chunk[id];
+			dma_tx_ring_chunk[id] = 0;
+		}
+		dma_tx_busy[id] = false;
+		UART_dma_tx_kick(id); // Lo que quedo encolado con UART_write_msg
+		if(callback != NULL)
+			callback(id);
+	}
+}
+
+__ISR__ DMA0_IRQHandler (void)
+{
+	UART_dma_irq_handler(0);
+}
+
+__ISR__ DMA1_IRQHandler (void)
+{
+	UART_dma_irq_handler(1);
+}
+
+__ISR__ DMA2_IRQHandler (void)
+{
+	UART_dma_irq_handler(2);
+}
+
+__ISR__ DMA3_IRQHandler (void)
+{
+	UART_dma_irq_handler(3);
+}
+
+__ISR__ DMA4_IRQHandler (void)
+{
+	UART_dma_irq_handler(4);
+}
+
+__ISR__ DMA5_IRQHandler (void)
+{
+	UART_dma_irq_handler(5);
+}
+
+__ISR__ DMA6_IRQHandler (void)
+{
+	UART_dma_irq_handler(6);
+}
+
+__ISR__ DMA7_IRQHandler (void)
+{
+	UART_dma_irq_handler(7);
+}
+
+__ISR__ DMA9_IRQHandler (void)
+{
+	UART_dma_irq_handler(9);
+}
+
 __ISR__ UART0_RX_TX_IRQHandler (void)
 {
 	UART_rx_tx_irq_handler(UART0, 0);
@@ -13,13 +13,52 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
 
 
 /*******************************************************************************
  * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
  ******************************************************************************/
 
-#define UART_CANT_IDS   4
+#define UART_CANT_IDS   5
+
+#define UART_MAX_BAUDRATE	1500000U
+
+// Largo de los buffers de cada UART. Tienen que ser potencia de 2; se pueden pisar desde el build
+#ifndef UART_DEFAULT_BUFFER_LEN
+#define UART_DEFAULT_BUFFER_LEN	128
+#endif
+
+#ifndef UART0_RX_BUFFER_LEN
+#define UART0_RX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART0_TX_BUFFER_LEN
+#define UART0_TX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART1_RX_BUFFER_LEN
+#define UART1_RX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART1_TX_BUFFER_LEN
+#define UART1_TX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART2_RX_BUFFER_LEN
+#define UART2_RX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART2_TX_BUFFER_LEN
+#define UART2_TX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART3_RX_BUFFER_LEN
+#define UART3_RX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART3_TX_BUFFER_LEN
+#define UART3_TX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART4_RX_BUFFER_LEN
+#define UART4_RX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
+#ifndef UART4_TX_BUFFER_LEN
+#define UART4_TX_BUFFER_LEN	UART_DEFAULT_BUFFER_LEN
+#endif
 
 
 /*******************************************************************************
@@ -50,11 +89,24 @@ typedef enum uart_error_t{
 	UART_FULLBUFFER_ERROR
 }uart_error_t;
 
+typedef enum uart_mode_t {
+	UART_MODE_IRQ,	// Bytes movidos por la CPU en la interrupcion
+	UART_MODE_DMA	// Bytes movidos por eDMA. UART4 solo tiene DMA en RX
+} uart_mode_t;
+
+typedef void (*uart_callback_t)(uint8_t id);
+
+typedef struct {
+	uint8_t * data;
+	size_t len;
+} uart_span_t; // Region contigua de un buffer del driver
+
 typedef struct {
     uint32_t baudrate;
     uart_parity_t parity;
     uart_data_bits_t databits;
     uart_stop_bits_t stop;
+    uart_mode_t mode;
 } uart_cfg_t;
 
 
@@ -72,9 +124,11 @@ void UART_Send_Data(unsigned char tx_data);
 /**
  * @brief Initialize UART driver
  * @param id UART's number
- * @param config UART's configuration (baudrate, parity, etc.)
+ * @param config UART's configuration (baudrate, parity, etc.). Baudrate 0 is the 9600 default
+ * @return false if the baudrate can't be reached with the UART's clock. The UART is left untouched
+ *         and UART_get_baudrate reports 0 with -1000000 ppm
 */
-void UART_init (uint8_t id, uart_cfg_t config);
+bool UART_init (uint8_t id, uart_cfg_t config);
 
 /**
  * @brief Check if a new byte was received
@@ -88,7 +142,7 @@ bool UART_is_rx_msg(uint8_t id);
  * @param id UART's number
  * @return Quantity of received bytes
 */
-uint8_t UART_get_rx_msg_length(uint8_t id);
+size_t UART_get_rx_msg_length(uint8_t id);
 
 /**
  * @brief Read a received message. Non-Blocking
@@ -97,7 +151,7 @@ uint8_t UART_get_rx_msg_length(uint8_t id);
  * @param cant Desired quantity of bytes to be pasted
  * @return Real quantity of pasted bytes
 */
-uint8_t UART_read_msg(uint8_t id, char* msg, uint8_t cant);
+size_t UART_read_msg(uint8_t id, char* msg, size_t cant);
 
 /**
  * @brief Write a message to be transmitted. Non-Blocking
@@ -106,7 +160,85 @@ uint8_t UART_read_msg(uint8_t id, char* msg, uint8_t cant);
  * @param cant Desired quantity of bytes to be transfered
  * @return Real quantity of bytes to be transfered
  */
-uint8_t UART_write_msg(uint8_t id, const char* msg, uint8_t cant);
+size_t UART_write_msg(uint8_t id, const char* msg, size_t cant);
+
+/**
+ * @brief Get the baudrate really configured on a UART
+ * @param id UART's number
+ * @param error_ppm Where to store the error against the requested baudrate, in ppm. May be NULL
+ * @return Achieved baudrate
+*/
+uint32_t UART_get_baudrate(uint8_t id, int32_t * error_ppm);
+
+/**
+ * @brief Compute the SBR/BRFA pair closest to a baudrate. Doesn't touch any register
+ * @param clock UART's module clock in Hz
+ * @param baudrate Desired baudrate, up to UART_MAX_BAUDRATE
+ * @param sbr Where to store the SBR value. May be NULL
+ * @param brfa Where to store the BRFA value. May be NULL
+ * @return Achieved baudrate, 0 if it can't be reached with this clock
+*/
+uint32_t UART_compute_baudrate(uint32_t clock, uint32_t baudrate, uint16_t * sbr, uint8_t * brfa);
+
+/**
+ * @brief Get how many times the UART's interrupt was entered per kilobyte moved (RX + TX)
+ * @param id UART's number
+ * @return ISR entries every 1024 bytes, 0 if no bytes were moved yet
+*/
+uint32_t UART_get_isr_per_kb(uint8_t id);
+
+/**
+ * @brief Restart the ISR entries and bytes counters
+ * @param id UART's number
+*/
+void UART_reset_isr_stats(uint8_t id);
+
+/**
+ * @brief Transmit straight from the caller's buffer using eDMA. Non-Blocking
+ * @param id UART's number, initialized with UART_MODE_DMA (not available on UART4)
+ * @param msg Buffer with the bytes to be transfered. Must remain valid until the callback
+ * @param cant Quantity of bytes to be transfered, up to 32767
+ * @param callback Called from interrupt context when the transfer is complete. May be NULL
+ * @return The transfer was started (false if a previous one is still running)
+*/
+bool UART_write_dma(uint8_t id, const uint8_t* msg, uint16_t cant, uart_callback_t callback);
+
+/**
+ * @brief Get how many received bytes were lost because the RX buffer was full
+ * @param id UART's number
+ * @return Lost bytes since UART_init
+*/
+uint32_t UART_get_rx_overrun(uint8_t id);
+
+/**
+ * @brief Look at the received bytes in place, without copying them. Non-Blocking
+ * @param id UART's number
+ * @param spans Filled with up to two contiguous regions, in order. spans[1].len is 0 when the data doesn't wrap
+ * @return Quantity of received bytes (spans[0].len + spans[1].len)
+*/
+size_t UART_rx_peek(uint8_t id, uart_span_t spans[2]);
+
+/**
+ * @brief Release bytes already seen through UART_rx_peek
+ * @param id UART's number
+ * @param cant Quantity of bytes to release, from the start of spans[0]
+*/
+void UART_rx_commit(uint8_t id, size_t cant);
+
+/**
+ * @brief Get the free space of the TX buffer to write a message in place. Non-Blocking
+ * @param id UART's number
+ * @param spans Filled with up to two contiguous regions, in order. spans[1].len is 0 when the space doesn't wrap
+ * @return Quantity of free bytes (spans[0].len + spans[1].len)
+*/
+size_t UART_tx_reserve(uint8_t id, uart_span_t spans[2]);
+
+/**
+ * @brief Send bytes written in the regions given by UART_tx_reserve
+ * @param id UART's number
+ * @param cant Quantity of bytes written, from the start of spans[0]
+*/
+void UART_tx_commit(uint8_t id, size_t cant);
 
 /**
  * @brief Check if all bytes were transfered
@@ -9,9 +9,10 @@
  ******************************************************************************/
 #include "board.h"
 #include "uart.h"
+#include "frame.h"
+#include "bridge.h"
 #include "Timer.h"
 #include "Led.h"
-#include "i2c.h"
 #include <stdbool.h>
 /*******************************************************************************
  * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
@@ -27,7 +28,11 @@
  * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
  ******************************************************************************/
 void send_msg(void);
+void on_frame(uint8_t type, const uint8_t * payload, uint8_t len);
+void esp_send(const uint8_t * data, size_t len);
+void on_play(uint8_t topic_id, const uint8_t * payload, uint8_t len);
 int idtimer = 0;
+static frame_decoder_t esp_decoder;
 /*******************************************************************************
  *******************************************************************************
                         FUNCTION DEFINITIONS
@@ -41,48 +46,50 @@ void App_Init(void)
 	//UART_init(0, config);
 	Led_Init();
 	UART_init(3, config);
+	frame_decoder_init(&esp_decoder);
+	bridge_init(esp_send, NULL);
+	bridge_on_topic("play", on_play);
+	bridge_request_binds(); // Si el ESP arranco antes, que vuelva a mandar sus topics
 	Timer_Init();
 	idtimer = Timer_AddCallback(&send_msg, 5000, false);
 	send_msg();
-	i2cInit(I2C_0);
-
 }
 
 /* Función que se llama constantemente en un ciclo infinito */
 void App_Run(void)
 {
-	static char msg[105] = {0};
-
-	/*
-	if(UART_is_rx_msg(3))
+	uart_span_t spans[2];
+	size_t mlen = UART_rx_peek(3, spans);
+	if(mlen != 0)
 	{
-		//const char men[] = "Recibi: ";
-		uint8_t mlen =  UART_read_msg(3,(char *)&msg, 100);
-		//for(uint8_t i = 0; i < mlen; i++){msg[i]+='0';}
-		//msg[mlen] = '\r';
-		//msg[mlen+1] = '\n';
+		// Decodifico directo sobre el buffer del driver, sin copiarlo
+		frame_decode(&esp_decoder, spans[0].data, spans[0].len, on_frame);
+		frame_decode(&esp_decoder, spans[1].data, spans[1].len, on_frame);
+		UART_rx_commit(3, mlen);
+	}
+}
+
 
-		if(msg[mlen-1] == 0x03)
-		{
-			Led_Toggle(LED_RED);
-			Timer_Resume(idtimer);
-			Timer_Reset(idtimer);
-		}
-		//UART_write_msg(0, &men, sizeof(men)/sizeof(men[0]));
-		//mlen = UART_write_msg(0, &msg, mlen+2);
+void on_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	if(type == FRAME_TYPE_ACK)
+	{
+		Led_Toggle(LED_RED);
+		Timer_Resume(idtimer);
+		Timer_Reset(idtimer);
+	}
+	else
+	{
+		bridge_handle_frame(type, payload, len);
 	}
-	*/
-	I2C_com_control_t i2c_testing;
-	testing.callback=toggle_led;
-	uint8_t data [3]={1,2,3};
-	testing.data = data;
-	testing.data_size = 3;
-	testing.register_address=0x0E;
-	testing.slave_address = 0x1D;
 }
 
+void esp_send(const uint8_t * data, size_t len)
+{
+	UART_write_msg(3, (const char *)data, len);
+}
 
-void toggle_led(void)
+void on_play(uint8_t topic_id, const uint8_t * payload, uint8_t len)
 {
 	Led_Toggle(LED_RED);
 }
@@ -93,8 +100,9 @@ void toggle_led(void)
  *******************************************************************************/
 void send_msg(void)
 {
-	static const char espmsg[1] = {0x04};
-	UART_write_msg(3, (const char *)&espmsg, 1);
+	uint8_t espmsg[FRAME_ENCODED_LEN(0)];
+	size_t len = frame_encode(FRAME_TYPE_POLL, NULL, 0, espmsg, sizeof(espmsg));
+	UART_write_msg(3, (const char *)espmsg, len);
 	//UART_write_msg(0, "Mande mensaje\r\n", 15);
 	Timer_Pause(idtimer);
 }
@@ -0,0 +1,201 @@
+/***************************************************************************//**
+  @file     bench_uart_ring.c
+  @brief    Bytes/s through the UART_MODE_IRQ rings vs the old 101-byte modulo buffers
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "uart.h"
+#include "hardware.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/*
+ * Los dos lados mueven un byte por interrupcion, asi se comparan los buffers con la misma cantidad de ISRs:
+ *   TX: write_msg desde el programa, la ISR saca de a un byte hacia D
+ *   RX: la ISR mete de a un byte leido de D, read_msg desde el programa
+ * "ring TX, FIFO" deja que cada interrupcion llene la FIFO, como en la placa.
+ * El codigo viejo es el de uart.c antes de los rings, copiado tal cual (old_*).
+ * Corre en la PC: compara las dos versiones en la misma maquina, no da tiempos de la Kinetis.
+ */
+
+#define CHUNK		64	// Entra en los dos buffers (el viejo guarda hasta 99 bytes)
+#define FIFO_DEPTH	8	// PFIFO TXFIFOSIZE/RXFIFOSIZE = 2
+
+// Los registros de solo lectura del UART los escribe el benchmark
+#define SET_REG(reg, value)	(*(volatile uint8_t *)&(reg) = (value))
+
+void UART0_RX_TX_IRQHandler(void);
+
+/*******************************************************************************
+ * Buffers viejos
+ ******************************************************************************/
+
+#define MAX_BUFFER_LEN 101
+#define MSG_LEN(x,y,z) (((x)+(z)-(y)) % ((z) - 1 )) // MSG_LEN(rear, front, max_len)
+
+static uint8_t buffer_out[MAX_BUFFER_LEN];
+static uint8_t p_out_rear, p_out_front;
+static uint8_t buffer_in[MAX_BUFFER_LEN];
+static uint8_t p_in_rear, p_in_front;
+
+static uint8_t old_read_msg(char* msg, uint8_t cant)
+{
+	uint8_t i,len_read = MSG_LEN(p_in_rear, p_in_front, MAX_BUFFER_LEN);
+	if(len_read > cant)
+		len_read = cant;
+
+	for(i = 0; i<len_read; i++)
+	{
+		msg[i] = buffer_in[p_in_front];
+		p_in_front = (p_in_front + 1) % (MAX_BUFFER_LEN - 1 );
+	}
+	return len_read;
+}
+
+static uint8_t old_write_msg(UART_Type * p_uart, const char* msg, uint8_t cant)
+{
+	uint8_t len_write = 0;
+
+	while((cant > len_write) && (((p_out_rear + 2) % (MAX_BUFFER_LEN - 1)) != p_out_front)) // Buffer full
+	{
+		p_out_rear = (p_out_rear + 1) % (MAX_BUFFER_LEN - 1); // Incremento circular
+		buffer_out[p_out_rear] = msg[len_write];
+		len_write++;
+	}
+	p_uart->C2 |= UART_C2_TIE_MASK; // Enable tie interrupts
+	return len_write;
+}
+
+static void old_irq_handler(UART_Type * p_uart)
+{
+	unsigned char tmp, rx_data, tx_data;
+	tmp=p_uart->S1;
+	if(tmp & UART_S1_TDRE_MASK)
+	{
+		uint8_t msg_len = MSG_LEN(p_out_rear, p_out_front, MAX_BUFFER_LEN);
+		if(msg_len != 0) // Si tengo caracteres en la cola lo mando
+		{
+			tx_data = buffer_out[p_out_front];
+			p_out_front = (p_out_front + 1) % (MAX_BUFFER_LEN - 1 );
+			p_uart->D = tx_data; // Transmito
+
+			if(msg_len == 1) //Clear tie interrupt when buffer is empty
+				p_uart->C2 = (p_uart->C2 & ~UART_C2_TIE_MASK);
+		}
+	}
+	if(tmp & UART_S1_RDRF_MASK)
+	{
+		rx_data=p_uart->D;
+		if (((p_in_rear + 2) % (MAX_BUFFER_LEN - 1)) != p_in_front) // Buffer full
+		{
+			p_in_rear = (p_in_rear + 1) % (MAX_BUFFER_LEN - 1); // Incremento circular
+			buffer_in[p_in_rear] = rx_data;
+		}
+	}
+}
+
+/*******************************************************************************
+ * Medicion
+ ******************************************************************************/
+
+static double seconds(void)
+{
+	struct timespec t;
+
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return t.tv_sec + t.tv_nsec * 1e-9;
+}
+
+static void report(const char * what, size_t bytes, double elapsed)
+{
+	printf("  %-16s %8.1f MB/s\n", what, bytes / elapsed / 1e6);
+}
+
+static void bench_new(size_t total)
+{
+	uart_cfg_t cfg = {115200, UART_PARITY_NONE, UART_DATA_BITS_8, UART_STOP_BITS_1, UART_MODE_IRQ};
+	char msg[CHUNK] = {0};
+	size_t done, i;
+	double t;
+
+	memset(&host_uart[0], 0, sizeof(host_uart[0]));
+	SET_REG(host_uart[0].PFIFO, UART_PFIFO_TXFIFOSIZE(2) | UART_PFIFO_RXFIFOSIZE(2));
+	UART_init(0, cfg);
+
+	SET_REG(host_uart[0].S1, UART_S1_TDRE_MASK | UART_S1_TC_MASK);
+	SET_REG(host_uart[0].TCFIFO, FIFO_DEPTH - 1);
+	t = seconds();
+	for(done = 0; done < total; done += CHUNK)
+	{
+		UART_write_msg(0, msg, CHUNK);
+		while(host_uart[0].C2 & UART_C2_TIE_MASK)
+			UART0_RX_TX_IRQHandler();
+	}
+	report("ring TX", done, seconds() - t);
+
+	// Con la FIFO vacia cada interrupcion mete FIFO_DEPTH bytes, que es para lo que esta el driver nuevo
+	SET_REG(host_uart[0].TCFIFO, 0);
+	t = seconds();
+	for(done = 0; done < total; done += CHUNK)
+	{
+		UART_write_msg(0, msg, CHUNK);
+		while(host_uart[0].C2 & UART_C2_TIE_MASK)
+			UART0_RX_TX_IRQHandler();
+	}
+	report("ring TX, FIFO", done, seconds() - t);
+
+	SET_REG(host_uart[0].S1, UART_S1_IDLE_MASK);
+	SET_REG(host_uart[0].RCFIFO, 0);
+	t = seconds();
+	for(done = 0; done < total; done += CHUNK)
+	{
+		for(i = 0; i < CHUNK; i++)
+		{
+			host_uart[0].SFIFO = 0;
+			UART0_RX_TX_IRQHandler();
+		}
+		UART_read_msg(0, msg, CHUNK);
+	}
+	report("ring RX", done, seconds() - t);
+}
+
+static void bench_old(size_t total)
+{
+	UART_Type * p_uart = &host_uart[1];
+	char msg[CHUNK] = {0};
+	size_t done, i;
+	double t;
+
+	memset(p_uart, 0, sizeof(*p_uart));
+	SET_REG(p_uart->S1, UART_S1_TDRE_MASK);
+	t = seconds();
+	for(done = 0; done < total; done += CHUNK)
+	{
+		old_write_msg(p_uart, msg, CHUNK);
+		while(p_uart->C2 & UART_C2_TIE_MASK)
+			old_irq_handler(p_uart);
+	}
+	report("modulo TX", done, seconds() - t);
+
+	SET_REG(p_uart->S1, UART_S1_RDRF_MASK);
+	t = seconds();
+	for(done = 0; done < total; done += CHUNK)
+	{
+		for(i = 0; i < CHUNK; i++)
+			old_irq_handler(p_uart);
+		old_read_msg(msg, CHUNK);
+	}
+	report("modulo RX", done, seconds() - t);
+}
+
+int main(int argc, char * argv[])
+{
+	size_t mb = (argc > 1)? strtoul(argv[1], NULL, 0) : 16;
+
+	printf("%zu MB, %d-byte writes/reads\n", mb, CHUNK);
+	bench_new(mb << 20);
+	bench_old(mb << 20);
+	return 0;
+}
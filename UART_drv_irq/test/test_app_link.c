@@ -0,0 +1,148 @@
+/***************************************************************************//**
+  @file     test_app_link.c
+  @brief    App.c against a simulated ESP on UART3: POLL/ACK and bridge frames through the RX ring
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "uart.h"
+#include "frame.h"
+#include "Timer.h"
+#include "Led.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define FIFO_DEPTH	8	// PFIFO TXFIFOSIZE/RXFIFOSIZE = 2
+
+// Los registros de solo lectura del UART los escribe el test
+#define SET_REG(reg, value)	(*(volatile uint8_t *)&(reg) = (value))
+
+void App_Init(void);
+void App_Run(void);
+void UART3_RX_TX_IRQHandler(void);
+
+// Timer y Led de mentira: solo registran lo que App.c les pide
+static void (*timer_callback)(void);
+static bool timer_paused;
+static int timer_resets, led_toggles;
+
+// Lo que App.c manda al ESP, ya decodificado
+static frame_decoder_t wire_dec;
+static int polls, bind_requests;
+
+bool Timer_Init (void) { return true; }
+int Timer_AddCallback(void (*newCallback)(void), int period, bool callOnce) { timer_callback = newCallback; return 1; }
+TimerError Timer_Pause(int timerID) { timer_paused = true; return TimerNoError; }
+TimerError Timer_Resume(int timerID) { timer_paused = false; return TimerNoError; }
+TimerError Timer_Reset(int timerID) { timer_resets++; return TimerNoError; }
+
+bool Led_Init (void) { return true; }
+void Led_Toggle(LedID ledID) { led_toggles++; }
+
+static void on_wire_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	polls += (type == FRAME_TYPE_POLL);
+	bind_requests += (type == FRAME_TYPE_BIND_REQUEST);
+}
+
+// Con un solo lugar libre en la FIFO cada interrupcion escribe un byte en D
+static void drain_tx(void)
+{
+	uint8_t byte;
+
+	SET_REG(host_uart[3].S1, UART_S1_TDRE_MASK | UART_S1_TC_MASK);
+	SET_REG(host_uart[3].TCFIFO, FIFO_DEPTH - 1);
+	while(host_uart[3].C2 & UART_C2_TIE_MASK)
+	{
+		UART3_RX_TX_IRQHandler();
+		byte = host_uart[3].D;
+		frame_decode(&wire_dec, &byte, 1, on_wire_frame);
+	}
+}
+
+// Lo que contesta el ESP entra byte a byte por la interrupcion de IDLE
+static void receive(const uint8_t * data, size_t len)
+{
+	SET_REG(host_uart[3].S1, UART_S1_IDLE_MASK);
+	SET_REG(host_uart[3].RCFIFO, 0);
+	while(len--)
+	{
+		host_uart[3].SFIFO = 0;
+		host_uart[3].D = *data++;
+		UART3_RX_TX_IRQHandler();
+	}
+}
+
+static void receive_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	uint8_t buf[FRAME_ENCODED_LEN(FRAME_MAX_PAYLOAD)];
+
+	receive(buf, frame_encode(type, payload, len, buf, sizeof(buf)));
+}
+
+static void test_handshake(void)
+{
+	uint8_t buf[FRAME_ENCODED_LEN(0)];
+	size_t len;
+
+	memset(&host_uart[3], 0, sizeof(host_uart[3]));
+	SET_REG(host_uart[3].PFIFO, UART_PFIFO_TXFIFOSIZE(2) | UART_PFIFO_RXFIFOSIZE(2));
+	frame_decoder_init(&wire_dec);
+
+	App_Init();
+	drain_tx();
+	check(bind_requests == 1 && polls == 1, "BIND_REQUEST and POLL sent on init");
+	check(timer_paused, "POLL timer paused until the ACK");
+
+	// ACK corrupto: no reanuda nada
+	len = frame_encode(FRAME_TYPE_ACK, NULL, 0, buf, sizeof(buf));
+	buf[1] ^= 0x40;
+	receive(buf, len);
+	App_Run();
+	check(timer_paused && led_toggles == 0, "corrupted ACK ignored");
+
+	// ACK partido en dos llamadas a App_Run
+	len = frame_encode(FRAME_TYPE_ACK, NULL, 0, buf, sizeof(buf));
+	receive(buf, 2);
+	App_Run();
+	check(timer_paused, "half an ACK does nothing");
+	receive(&buf[2], len - 2);
+	App_Run();
+	check(!timer_paused && timer_resets == 1 && led_toggles == 1, "ACK resumes the POLL timer");
+	check(!UART_is_rx_msg(3), "RX ring released after decoding");
+
+	// Siguiente vuelta: el timer vuelve a mandar POLL y se pausa
+	timer_callback();
+	drain_tx();
+	check(polls == 2 && timer_paused, "next POLL after the period");
+	receive_frame(FRAME_TYPE_ACK, NULL, 0);
+	App_Run();
+	check(!timer_paused && timer_resets == 2, "second ACK");
+}
+
+// El ESP anuncia "play" con su id y despues publica en ese id: App.c lo despacha a on_play
+static void test_play(void)
+{
+	uint8_t payload[] = {5, 'p', 'l', 'a', 'y'};
+	int toggles;
+
+	receive_frame(FRAME_TYPE_BIND, payload, sizeof(payload));
+	payload[1] = '1';
+	receive_frame(FRAME_TYPE_PUBLISH, payload, 2);
+	toggles = led_toggles;
+	App_Run();
+	check(led_toggles == toggles + 1, "PUBLISH on play reaches on_play");
+
+	payload[0] = 6;
+	receive_frame(FRAME_TYPE_PUBLISH, payload, 2);
+	App_Run();
+	check(led_toggles == toggles + 1, "PUBLISH on an unknown id ignored");
+}
+
+int main(void)
+{
+	test_handshake();
+	test_play();
+
+	return check_report();
+}
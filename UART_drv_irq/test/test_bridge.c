@@ -0,0 +1,163 @@
+/***************************************************************************//**
+  @file     test_bridge.c
+  @brief    Topic-id bridge: BIND/PUBLISH on the wire, dispatch by id and BIND_REQUEST recovery
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "bridge.h"
+#include "check.h"
+#include <string.h>
+
+// Lo que el bridge manda al cable, ya decodificado
+static frame_decoder_t wire_dec;
+static int sent, sent_type, sent_len;
+static uint8_t sent_payload[FRAME_MAX_PAYLOAD];
+static int sent_binds, sent_requests;
+
+// Lo que el bridge despacha
+static int handled, defaulted;
+static uint8_t handled_id, handled_len;
+static uint8_t handled_payload[FRAME_MAX_PAYLOAD];
+
+static void on_wire_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	sent++;
+	sent_type = type;
+	sent_len = len;
+	memcpy(sent_payload, payload, len);
+	sent_binds += (type == FRAME_TYPE_BIND);
+	sent_requests += (type == FRAME_TYPE_BIND_REQUEST);
+}
+
+static void send(const uint8_t * data, size_t len)
+{
+	frame_decode(&wire_dec, data, len, on_wire_frame);
+}
+
+static void handler(uint8_t topic_id, const uint8_t * payload, uint8_t len)
+{
+	handled++;
+	handled_id = topic_id;
+	handled_len = len;
+	memcpy(handled_payload, payload, len);
+}
+
+static void default_handler(uint8_t topic_id, const uint8_t * payload, uint8_t len)
+{
+	defaulted++;
+	handled_id = topic_id;
+	handled_len = len;
+}
+
+static void reset_counters(void)
+{
+	sent = sent_binds = sent_requests = 0;
+	handled = defaulted = 0;
+}
+
+// Trama que manda el otro lado
+static void receive(uint8_t type, uint8_t id, const char * data)
+{
+	uint8_t payload[FRAME_MAX_PAYLOAD];
+	uint8_t len = strlen(data);
+
+	payload[0] = id;
+	memcpy(&payload[1], data, len);
+	bridge_handle_frame(type, payload, len + 1);
+}
+
+static void test_local(void)
+{
+	uint8_t payload[BRIDGE_MAX_PAYLOAD + 1] = {0};
+	uint8_t play, level;
+
+	reset_counters();
+	play = bridge_bind("play");
+	check(play == 0 && sent == 1 && sent_type == FRAME_TYPE_BIND, "BIND sent");
+	check(sent_len == 5 && sent_payload[0] == play && !memcmp(&sent_payload[1], "play", 4), "BIND payload");
+	level = bridge_bind("level");
+	check(level == 1 && bridge_bind("play") == play && sent_binds == 3, "bind again keeps the id and re-announces");
+	check(bridge_find("level") == level && bridge_find("nada") == BRIDGE_INVALID_ID, "bridge_find");
+	check(bridge_bind("un nombre de topic demasiado largo") == BRIDGE_INVALID_ID, "long topic name rejected");
+
+	reset_counters();
+	check(bridge_publish(level, (const uint8_t *)"42", 2), "publish");
+	check(sent == 1 && sent_type == FRAME_TYPE_PUBLISH && sent_len == 3 && sent_payload[0] == level &&
+			!memcmp(&sent_payload[1], "42", 2), "PUBLISH on the wire");
+	check(bridge_publish(play, payload, BRIDGE_MAX_PAYLOAD) && sent_len == FRAME_MAX_PAYLOAD, "largest payload");
+	reset_counters();
+	check(!bridge_publish(play, payload, BRIDGE_MAX_PAYLOAD + 1), "payload above BRIDGE_MAX_PAYLOAD accepted");
+	check(!bridge_publish(7, payload, 1), "unbound local id accepted");
+	check(sent == 0, "rejected publish reached the wire");
+}
+
+static void test_remote(void)
+{
+	reset_counters();
+	check(bridge_on_topic("speed", handler), "subscription before the BIND");
+	receive(FRAME_TYPE_BIND, 3, "speed");
+	check(bridge_remote_name(3) != NULL && !strcmp(bridge_remote_name(3), "speed"), "remote name");
+	receive(FRAME_TYPE_PUBLISH, 3, "12");
+	check(handled == 1 && handled_id == 3 && handled_len == 2 && !memcmp(handled_payload, "12", 2), "dispatch by id");
+
+	// Sin suscripcion va al handler por defecto, hasta que se suscribe
+	receive(FRAME_TYPE_BIND, 4, "angle");
+	receive(FRAME_TYPE_PUBLISH, 4, "90");
+	check(defaulted == 1 && handled_id == 4, "default handler");
+	bridge_on_topic("angle", handler);
+	receive(FRAME_TYPE_PUBLISH, 4, "91");
+	check(handled == 2 && handled_id == 4, "subscription after the BIND");
+	check(sent == 0, "nothing sent while dispatching");
+
+	receive(FRAME_TYPE_PUBLISH, BRIDGE_MAX_TOPICS, "x");
+	bridge_handle_frame(FRAME_TYPE_PUBLISH, NULL, 0);
+	check(handled == 2 && defaulted == 1 && sent == 0, "invalid ids ignored");
+}
+
+static void test_missed_bind(void)
+{
+	reset_counters();
+	// PUBLISH de un id que nunca se anuncio: se pide el BIND una sola vez
+	receive(FRAME_TYPE_PUBLISH, 5, "a");
+	receive(FRAME_TYPE_PUBLISH, 5, "b");
+	receive(FRAME_TYPE_PUBLISH, 5, "c");
+	check(sent_requests == 1 && sent == 1, "one BIND_REQUEST per missing id");
+	check(handled == 0 && defaulted == 0, "unbound PUBLISH dropped");
+
+	receive(FRAME_TYPE_BIND, 5, "speed");
+	receive(FRAME_TYPE_PUBLISH, 5, "d");
+	check(handled == 1 && handled_id == 5, "PUBLISH after the late BIND");
+
+	receive(FRAME_TYPE_PUBLISH, 6, "e");
+	check(sent_requests == 2, "another missing id asks again");
+
+	// El otro lado pide los BIND: se anuncian todos los topics locales
+	reset_counters();
+	bridge_handle_frame(FRAME_TYPE_BIND_REQUEST, NULL, 0);
+	check(sent_binds == 2 && sent == 2, "BIND_REQUEST answered with every local topic");
+}
+
+static void test_init_forgets(void)
+{
+	bridge_init(send, NULL);
+	reset_counters();
+	check(bridge_find("play") == BRIDGE_INVALID_ID && bridge_remote_name(3) == NULL, "init forgets every topic");
+	receive(FRAME_TYPE_PUBLISH, 5, "f");
+	check(sent_requests == 1, "init clears the pending requests");
+}
+
+int main(void)
+{
+	uint8_t delimiter = FRAME_DELIMITER;
+
+	frame_decoder_init(&wire_dec);
+	frame_decode(&wire_dec, &delimiter, 1, NULL);
+	bridge_init(send, default_handler);
+
+	test_local();
+	test_remote();
+	test_missed_bind();
+	test_init_forgets();
+
+	return check_report();
+}
@@ -0,0 +1,113 @@
+/***************************************************************************//**
+  @file     test_frame.c
+  @brief    COBS + CRC16 frames: random round trips fed in chunks, corruption and buffer limits
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "frame.h"
+#include "check.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Cada falla dice en que vuelta fue
+#define check_round(ok, what, round)	check(ok, "%s (round %d)", what, round)
+
+#define ROUNDS	100000
+
+static int frames;
+static uint8_t got_type, got_len, got_payload[FRAME_MAX_PAYLOAD];
+
+static void on_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	frames++;
+	got_type = type;
+	got_len = len;
+	memcpy(got_payload, payload, len);
+}
+
+static void test_limits(void)
+{
+	uint8_t payload[FRAME_MAX_PAYLOAD + 1] = {0};
+	uint8_t out[FRAME_ENCODED_LEN(FRAME_MAX_PAYLOAD + 1)];
+
+	check_round(frame_crc16(0xFFFF, (const uint8_t *)"123456789", 9) == 0x29B1, "CRC16-CCITT check value", 0);
+	check_round(frame_encode(FRAME_TYPE_DATA, payload, FRAME_MAX_PAYLOAD + 1, out, sizeof(out)) == 0,
+			"payload above FRAME_MAX_PAYLOAD accepted", 0);
+	check_round(frame_encode(FRAME_TYPE_DATA, payload, FRAME_MAX_PAYLOAD, out, FRAME_ENCODED_LEN(FRAME_MAX_PAYLOAD)) != 0,
+			"FRAME_ENCODED_LEN isn't enough", 0);
+	check_round(frame_encode(FRAME_TYPE_DATA, payload, FRAME_MAX_PAYLOAD, out, FRAME_ENCODED_LEN(FRAME_MAX_PAYLOAD) - 1) == 0,
+			"frame written past out_size", 0);
+	check_round(frame_encode(FRAME_TYPE_POLL, NULL, 0, out, FRAME_ENCODED_LEN(0)) != 0, "empty frame", 0);
+}
+
+// Un decoder que arranca a mitad de una trama pierde solo esa
+static void test_start(void)
+{
+	frame_decoder_t dec;
+	uint8_t payload[4] = {1, 2, 3, 4};
+	uint8_t out[FRAME_ENCODED_LEN(4)];
+	size_t n = frame_encode(FRAME_TYPE_DATA, payload, sizeof(payload), out, sizeof(out));
+
+	frame_decoder_init(&dec);
+	frames = 0;
+	frame_decode(&dec, &out[3], n - 3, on_frame);
+	check_round(frames == 0 && dec.frames_error == 1, "partial first frame rejected", 0);
+	frame_decode(&dec, out, n, on_frame);
+	check_round(frames == 1 && dec.frames_ok == 1, "next frame after a partial one", 0);
+}
+
+int main(void)
+{
+	frame_decoder_t dec;
+	uint8_t out[FRAME_ENCODED_LEN(FRAME_MAX_PAYLOAD)], payload[FRAME_MAX_PAYLOAD];
+	size_t n, k, chunk, i;
+	int round, len;
+
+	test_limits();
+	test_start();
+
+	// Sin delimitador previo: la primera trama despues de iniciar tambien vale
+	frame_decoder_init(&dec);
+	srand(1);
+	for(round = 0; round < ROUNDS; round++)
+	{
+		// Muchos ceros para ejercitar los bloques de COBS
+		len = rand() % (FRAME_MAX_PAYLOAD + 1);
+		for(i = 0; i < (size_t)len; i++)
+			payload[i] = (rand() % 4 == 0)?(0):(rand());
+
+		n = frame_encode(round & 0xFF, payload, len, out, sizeof(out));
+		check_round(n != 0 && n <= FRAME_ENCODED_LEN(len), "encoded length", round);
+		if(n == 0)
+			continue;
+		check_round(memchr(out, FRAME_DELIMITER, n - 1) == NULL && out[n - 1] == FRAME_DELIMITER, "delimiter only at the end",
+				round);
+
+		// El stream llega en pedazos de cualquier largo
+		frames = 0;
+		for(k = 0; k < n; k += chunk)
+		{
+			chunk = 1 + rand() % 5;
+			if(k + chunk > n)
+				chunk = n - k;
+			frame_decode(&dec, &out[k], chunk, on_frame);
+		}
+		check_round(frames == 1 && got_type == (round & 0xFF) && got_len == len && !memcmp(got_payload, payload, len),
+				"round trip", round);
+
+		// Un byte cambiado (sin meter delimitadores) lo descarta el CRC o el COBS
+		if(round % 7 == 0)
+		{
+			out[rand() % (n - 1)] ^= 1 + rand() % 254;
+			for(i = 0; i < n - 1; i++)
+				if(out[i] == FRAME_DELIMITER)
+					out[i] = 5;
+			frames = 0;
+			frame_decode(&dec, out, n, on_frame);
+			check_round(frames == 0, "corrupted frame accepted", round);
+		}
+	}
+	check_round(dec.frames_ok == ROUNDS && dec.frames_error == (ROUNDS + 6) / 7, "decoder counters", ROUNDS);
+
+	return check_report();
+}
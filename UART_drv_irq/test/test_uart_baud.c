@@ -0,0 +1,103 @@
+/***************************************************************************//**
+  @file     test_uart_baud.c
+  @brief    UART_compute_baudrate and the BDH/BDL/C4 values written by UART_init
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "uart.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+// Cada falla dice con que clock y baudrate fue
+#define check_rate(ok, what, clock, baud)	check(ok, "%s (clock %lu baud %lu)", what, (unsigned long)(clock), (unsigned long)(baud))
+
+// baud = clock / (16 * (SBR + BRFA/32)), el divisor en 1/32 va de 32 a 0x1FFF*32 + 31
+static void test_rate(uint32_t clock, uint32_t baud)
+{
+	uint16_t sbr = 0;
+	uint8_t brfa = 0;
+	uint32_t achieved, div;
+	double exact = 2.0 * clock / baud, rel;
+
+	achieved = UART_compute_baudrate(clock, baud, &sbr, &brfa);
+
+	if(baud > UART_MAX_BAUDRATE || exact < 31.5 || exact >= 0x1FFF * 32 + 31.5)
+	{
+		check_rate(achieved == 0, "out of range accepted", clock, baud);
+		return;
+	}
+	check_rate(achieved != 0, "in range rejected", clock, baud);
+	if(achieved == 0)
+		return;
+
+	div = (uint32_t)sbr * 32 + brfa;
+	check_rate(sbr >= 1 && sbr <= 0x1FFF && brfa < 32, "SBR/BRFA out of their fields", clock, baud);
+	check_rate(achieved == (uint32_t)((2.0 * clock) / div + 0.5), "achieved doesn't match SBR/BRFA", clock, baud);
+	check_rate(div + 0.5 >= exact && div - 0.5 <= exact, "divisor isn't the closest", clock, baud);
+	rel = ((double)achieved - baud) / baud;
+	// Medio paso de BRFA, mas el redondeo del baudrate a entero
+	check_rate(rel <= 0.5 / div + 1.0 / baud && rel >= -0.5 / div - 1.0 / baud, "error above half a BRFA step", clock, baud);
+}
+
+static void test_init(uint8_t id, uint32_t baud, uint32_t expected)
+{
+	UART_Type * uart = &host_uart[id];
+	uint32_t clock = (id < 2)?(__CORE_CLOCK__):(__CORE_CLOCK__ >> 1);
+	uint16_t sbr;
+	uint8_t brfa;
+	int32_t ppm;
+	uart_cfg_t cfg = {baud, UART_PARITY_NONE, UART_DATA_BITS_8, UART_STOP_BITS_1, UART_MODE_IRQ};
+
+	check_rate(UART_init(id, cfg), "UART_init rejected", clock, baud);
+	check_rate(UART_compute_baudrate(clock, expected, &sbr, &brfa) == UART_get_baudrate(id, &ppm), "UART_get_baudrate",
+			clock, baud);
+	check_rate(((uart->BDH & UART_BDH_SBR_MASK) << 8 | uart->BDL) == sbr, "BDH/BDL", clock, baud);
+	check_rate((uart->C4 & UART_C4_BRFA_MASK) == brfa, "C4 BRFA", clock, baud);
+	check_rate(ppm == (int32_t)(((int64_t)UART_get_baudrate(id, NULL) - expected) * 1000000 / expected), "error ppm",
+			clock, baud);
+}
+
+// Fuera de rango UART_init falla sin tocar el UART y el error se informa contra lo pedido
+static void test_out_of_range(uint8_t id, uint32_t baud)
+{
+	UART_Type * uart = &host_uart[id];
+	uint32_t clock = (id < 2)?(__CORE_CLOCK__):(__CORE_CLOCK__ >> 1);
+	uart_cfg_t cfg = {baud, UART_PARITY_NONE, UART_DATA_BITS_8, UART_STOP_BITS_1, UART_MODE_IRQ};
+	int32_t ppm;
+
+	memset(uart, 0, sizeof(*uart));
+	check_rate(!UART_init(id, cfg), "out of range accepted by UART_init", clock, baud);
+	check_rate(UART_get_baudrate(id, &ppm) == 0 && ppm == -1000000, "out of range reported as 0 baud, -1000000 ppm",
+			clock, baud);
+	check_rate(uart->BDH == 0 && uart->BDL == 0 && uart->C2 == 0, "UART touched after a rejected baudrate", clock, baud);
+}
+
+int main(void)
+{
+	static const uint32_t clocks[] = {__CORE_CLOCK__, __CORE_CLOCK__ >> 1};
+	static const uint32_t common[] = {300, 1200, 9600, 19200, 38400, 57600, 115200, 230400, 460800, 921600,
+			1000000, 1500000, 2000000};
+	uint32_t baud;
+	unsigned int c, i;
+
+	for(c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+	{
+		for(i = 0; i < sizeof(common) / sizeof(common[0]); i++)
+			test_rate(clocks[c], common[i]);
+		for(baud = 1; baud < 2000000; baud += baud / 97 + 1)
+			test_rate(clocks[c], baud);
+		// 1.5 Mbaud con menos de 1% de error en los dos clocks
+		baud = UART_compute_baudrate(clocks[c], UART_MAX_BAUDRATE, NULL, NULL);
+		check_rate(baud > 1485000 && baud < 1515000, "1.5 Mbaud above 1% error", clocks[c], UART_MAX_BAUDRATE);
+	}
+
+	test_init(0, 1500000, 1500000);		// core clock
+	test_init(2, 1500000, 1500000);		// bus clock
+	test_init(1, 115200, 115200);
+	test_init(3, 0, 9600);				// 0 es el default
+	test_out_of_range(4, 3000000);
+	test_out_of_range(0, 100);			// SBR no llega
+
+	return check_report();
+}
@@ -0,0 +1,227 @@
+/***************************************************************************//**
+  @file     test_uart_dma.c
+  @brief    UART_MODE_DMA: RX ring fed by a simulated eDMA channel, TX chunks and UART4 TX by interrupt
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "uart.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define RX_SIZE		UART0_RX_BUFFER_LEN
+#define TX_SIZE		UART0_TX_BUFFER_LEN
+
+// Los registros de solo lectura del UART los escribe el test
+#define SET_REG(reg, value)	(*(volatile uint8_t *)&(reg) = (value))
+
+void DMA0_IRQHandler(void);
+void DMA1_IRQHandler(void);
+void DMA9_IRQHandler(void);
+void UART4_RX_TX_IRQHandler(void);
+
+static uint8_t * rx_base;		// buffer_in del driver, el destino del canal de RX
+static uint32_t rx_pos;
+static uint8_t next_byte;
+static int callbacks;
+
+static void init(uint8_t id)
+{
+	uart_cfg_t cfg = {115200, UART_PARITY_NONE, UART_DATA_BITS_8, UART_STOP_BITS_1, UART_MODE_DMA};
+	uart_span_t spans[2];
+
+	memset(&host_uart[id], 0, sizeof(host_uart[id]));
+	UART_init(id, cfg);
+	UART_rx_peek(id, spans);
+	rx_base = spans[1].data; // El segundo tramo siempre arranca al principio del ring
+	rx_pos = 0;
+	next_byte = 0;
+}
+
+// El canal de RX del UART0 mueve n bytes: CITER baja y recarga de BITER al dar la vuelta
+static void dma_rx(uint8_t ch, uint32_t n, bool deliver_irq)
+{
+	volatile uint16_t * citer = &host_dma.TCD[ch].CITER_ELINKNO;
+
+	while(n--)
+	{
+		rx_base[rx_pos++ % RX_SIZE] = next_byte++;
+		if(--*citer == 0)
+		{
+			*citer = host_dma.TCD[ch].BITER_ELINKNO;
+			if(deliver_irq)
+				DMA1_IRQHandler();
+		}
+	}
+}
+
+static void tx_done(uint8_t id)
+{
+	check(id == 0, "callback id");
+	callbacks++;
+}
+
+// Lee cant bytes y verifica que sigan la secuencia que mando dma_rx
+static void read_expect(uint8_t id, size_t cant, uint8_t first)
+{
+	char msg[RX_SIZE * 2];
+	size_t i, len = UART_read_msg(id, msg, cant);
+
+	check(len == cant, "read length");
+	for(i = 0; i < len; i++)
+		if((uint8_t)msg[i] != (uint8_t)(first + i))
+		{
+			check(false, "read data");
+			break;
+		}
+}
+
+static void test_init(void)
+{
+	init(0);
+	check(host_uart[0].C5 == (UART_C5_TDMAS_MASK | UART_C5_RDMAS_MASK), "UART0 C5 TDMAS/RDMAS");
+	check(host_uart[0].C2 == (UART_C2_TE_MASK | UART_C2_RE_MASK | UART_C2_RIE_MASK), "UART0 C2 without ILIE");
+	check(host_dmamux.CHCFG[0] == (DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(3)), "TX channel source");
+	check(host_dmamux.CHCFG[1] == (DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(2)), "RX channel source");
+	check(host_dma.TCD[1].CITER_ELINKNO == RX_SIZE && host_dma.TCD[1].BITER_ELINKNO == RX_SIZE, "RX CITER/BITER");
+	check(host_dma.TCD[1].DLAST_SGA == -RX_SIZE && host_dma.TCD[1].DOFF == 1, "RX ring addressing");
+	check(host_dma.TCD[1].CSR == DMA_CSR_INTMAJOR_MASK, "RX channel never stops");
+	check(host_dma.SERQ == 1, "RX channel enabled");
+	check(NVIC_GetEnableIRQ(DMA0_IRQn) && NVIC_GetEnableIRQ(DMA1_IRQn), "DMA interrupts enabled");
+	check(UART_get_rx_msg_length(0) == 0, "RX empty after init");
+}
+
+static void test_rx(void)
+{
+	init(0);
+	dma_rx(1, 10, true);
+	check(UART_get_rx_msg_length(0) == 10, "RX length");
+	read_expect(0, 10, 0);
+
+	// Tres vueltas del ring leyendo de a 50
+	dma_rx(1, 50, true);
+	read_expect(0, 50, 10);
+	dma_rx(1, 100, true);
+	read_expect(0, 50, 60);
+	read_expect(0, 50, 110);
+	dma_rx(1, 100, true);
+	read_expect(0, 100, 160);
+	dma_rx(1, 100, true);
+	read_expect(0, 100, (uint8_t)260);
+	check(UART_get_rx_overrun(0) == 0, "no overrun while reading");
+
+	// La interrupcion de fin de vuelta todavia no se atendio cuando se consulta el largo
+	dma_rx(1, 30, false);
+	check(UART_get_rx_msg_length(0) == 30, "RX length with the wrap IRQ pending");
+	DMA1_IRQHandler();
+	check(UART_get_rx_msg_length(0) == 30, "RX length after the late wrap IRQ");
+	read_expect(0, 30, (uint8_t)360);
+
+	// Sin leer el DMA pisa lo viejo: quedan los ultimos RX_SIZE bytes
+	dma_rx(1, 300, true);
+	check(UART_get_rx_overrun(0) == 300 - RX_SIZE, "overrun count");
+	read_expect(0, RX_SIZE, (uint8_t)(390 + 300 - RX_SIZE));
+	check(!UART_is_rx_msg(0), "RX empty after overrun");
+}
+
+static void test_tx_ring(void)
+{
+	char msg[TX_SIZE];
+	uart_span_t spans[2];
+	uint8_t * tx_base;
+	unsigned int i;
+
+	init(0);
+	UART_tx_reserve(0, spans);
+	tx_base = spans[1].data;
+	for(i = 0; i < sizeof(msg); i++)
+		msg[i] = i;
+
+	check(UART_write_msg(0, msg, 100) == 100, "TX accepted");
+	check(host_dma.TCD[0].CITER_ELINKNO == 100 && host_dma.TCD[0].BITER_ELINKNO == 100, "TX chunk length");
+	check(host_dma.TCD[0].SADDR == (uint32_t)(uintptr_t)tx_base, "TX chunk source");
+	check(host_dma.TCD[0].CSR == (DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK), "TX channel stops at the end");
+	check(host_dma.SERQ == 0 && (host_uart[0].C2 & UART_C2_TIE_MASK), "TX channel enabled");
+	check(!UART_is_tx_msg_complete(0), "TX busy");
+
+	// Mientras corre el DMA lo nuevo queda en el ring
+	host_dma.TCD[0].CITER_ELINKNO = 0;
+	check(UART_write_msg(0, msg, 60) == TX_SIZE - 100, "TX limited by the free space");
+	check(host_dma.TCD[0].CITER_ELINKNO == 0, "TX not restarted while busy");
+
+	// Fin del primer tramo: sigue con lo encolado hasta el final del buffer
+	DMA0_IRQHandler();
+	check(host_dma.TCD[0].CITER_ELINKNO == TX_SIZE - 100, "TX second chunk stops at the end of the ring");
+	check(host_dma.TCD[0].SADDR == (uint32_t)(uintptr_t)(tx_base + 100), "TX second chunk source");
+	check(UART_write_msg(0, msg, 50) == 50, "TX accepted after the first chunk");
+	DMA0_IRQHandler();
+	check(host_dma.TCD[0].CITER_ELINKNO == 50 && host_dma.TCD[0].SADDR == (uint32_t)(uintptr_t)tx_base,
+			"TX third chunk from the start of the ring");
+	check(!UART_is_tx_msg_complete(0), "TX busy with the third chunk");
+	DMA0_IRQHandler();
+	check(UART_is_tx_msg_complete(0), "TX complete");
+	check(!(host_uart[0].C2 & UART_C2_TIE_MASK), "TIE off when TX is complete");
+}
+
+static void test_tx_user_buffer(void)
+{
+	static const uint8_t msg[] = "mensaje sin copiar";
+
+	init(0);
+	callbacks = 0;
+	check(!UART_write_dma(0, msg, 0, tx_done), "empty transfer rejected");
+	check(UART_write_dma(0, msg, sizeof(msg), tx_done), "user buffer transfer started");
+	check(host_dma.TCD[0].SADDR == (uint32_t)(uintptr_t)msg && host_dma.TCD[0].CITER_ELINKNO == sizeof(msg),
+			"user buffer TCD");
+	check(!UART_write_dma(0, msg, sizeof(msg), tx_done), "second transfer rejected while busy");
+	DMA0_IRQHandler();
+	check(callbacks == 1, "callback called once");
+	check(UART_is_tx_msg_complete(0), "TX complete after the callback");
+	check(UART_write_dma(0, msg, sizeof(msg), NULL), "transfer accepted again");
+	DMA0_IRQHandler();
+	check(callbacks == 1, "NULL callback");
+}
+
+// UART4 no tiene fuente de DMA para TX: en modo DMA transmite por interrupcion y recibe por DMA
+static void test_uart4(void)
+{
+	static const char msg[] = "UART4 por interrupcion";
+	char sent[sizeof(msg)];
+	unsigned int len = 0, calls = 0;
+
+	memset(&host_dmamux, 0, sizeof(host_dmamux));
+	init(4);
+	check(host_uart[4].C5 == UART_C5_RDMAS_MASK, "UART4 C5 without TDMAS");
+	check(host_dmamux.CHCFG[8] == 0, "UART4 without TX channel");
+	check(host_dmamux.CHCFG[9] == (DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(10)), "UART4 RX channel source");
+	check(!UART_write_dma(4, (const uint8_t *)msg, sizeof(msg), NULL), "UART4 user buffer transfer rejected");
+
+	host_dma.SERQ = 0xFF;
+	memset(rx_base, 0xEE, UART4_RX_BUFFER_LEN);
+	check(UART_write_msg(4, msg, sizeof(msg)) == sizeof(msg), "UART4 TX accepted");
+	check(host_dma.SERQ == 0xFF, "UART4 TX doesn't start a DMA channel");
+	check(host_uart[4].C2 & UART_C2_TIE_MASK, "UART4 TX uses TIE");
+
+	// FIFO de un lugar (PFIFO en 0): un byte por interrupcion. IDLE y RDRF son del DMA
+	SET_REG(host_uart[4].S1, UART_S1_TDRE_MASK | UART_S1_RDRF_MASK | UART_S1_IDLE_MASK);
+	while((host_uart[4].C2 & UART_C2_TIE_MASK) && calls++ < 2 * sizeof(msg))
+	{
+		UART4_RX_TX_IRQHandler();
+		if(len < sizeof(sent))
+			sent[len++] = host_uart[4].D;
+	}
+	check(len == sizeof(msg) && memcmp(sent, msg, sizeof(msg)) == 0, "UART4 TX data");
+	check(UART_is_tx_msg_complete(4), "UART4 TX complete");
+	check(rx_base[0] == 0xEE && UART_get_rx_msg_length(4) == 0, "UART4 ISR doesn't touch the DMA RX ring");
+}
+
+int main(void)
+{
+	test_init();
+	test_rx();
+	test_tx_ring();
+	test_tx_user_buffer();
+	test_uart4();
+
+	return check_report();
+}
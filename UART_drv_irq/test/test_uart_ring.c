@@ -0,0 +1,171 @@
+/***************************************************************************//**
+  @file     test_uart_ring.c
+  @brief    UART_MODE_IRQ rings: wrap, full, overrun and the zero-copy spans, moved by the ISR
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "uart.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define RX_SIZE		UART0_RX_BUFFER_LEN
+#define TX_SIZE		UART0_TX_BUFFER_LEN
+#define FIFO_DEPTH	8	// PFIFO TXFIFOSIZE/RXFIFOSIZE = 2
+
+// Los registros de solo lectura del UART los escribe el test
+#define SET_REG(reg, value)	(*(volatile uint8_t *)&(reg) = (value))
+
+void UART0_RX_TX_IRQHandler(void);
+
+static uint8_t tx_next, rx_next;	// Proximo byte esperado en el cable y proximo a recibir
+
+static void init(void)
+{
+	uart_cfg_t cfg = {115200, UART_PARITY_NONE, UART_DATA_BITS_8, UART_STOP_BITS_1, UART_MODE_IRQ};
+
+	memset(&host_uart[0], 0, sizeof(host_uart[0]));
+	SET_REG(host_uart[0].PFIFO, UART_PFIFO_TXFIFOSIZE(2) | UART_PFIFO_RXFIFOSIZE(2));
+	UART_init(0, cfg);
+	tx_next = rx_next = 0;
+}
+
+static size_t write_seq(size_t cant)
+{
+	char msg[TX_SIZE * 2];
+	size_t i, len;
+
+	for(i = 0; i < cant; i++)
+		msg[i] = (char)(tx_next + i);
+	len = UART_write_msg(0, msg, cant);
+	tx_next += len;
+	return len;
+}
+
+// Con un solo lugar libre en la FIFO cada interrupcion escribe un byte en D
+static size_t drain_tx(size_t cant, uint8_t first)
+{
+	size_t sent = 0;
+
+	SET_REG(host_uart[0].S1, UART_S1_TDRE_MASK | UART_S1_TC_MASK);
+	SET_REG(host_uart[0].TCFIFO, FIFO_DEPTH - 1);
+	while(sent < cant && (host_uart[0].C2 & UART_C2_TIE_MASK))
+	{
+		UART0_RX_TX_IRQHandler();
+		if(host_uart[0].D != (uint8_t)(first + sent))
+		{
+			check(false, "TX data order");
+			break;
+		}
+		sent++;
+	}
+	return sent;
+}
+
+// Un byte que llega solo despues del watermark: lo levanta la interrupcion de IDLE
+static void receive(size_t cant)
+{
+	SET_REG(host_uart[0].S1, UART_S1_IDLE_MASK);
+	SET_REG(host_uart[0].RCFIFO, 0);
+	while(cant--)
+	{
+		host_uart[0].SFIFO = 0;
+		host_uart[0].D = rx_next++;
+		UART0_RX_TX_IRQHandler();
+	}
+}
+
+static void read_expect(size_t cant, uint8_t first)
+{
+	char msg[RX_SIZE * 2];
+	size_t i, len = UART_read_msg(0, msg, sizeof(msg));
+
+	check(len == cant, "read length");
+	for(i = 0; i < len; i++)
+		if((uint8_t)msg[i] != (uint8_t)(first + i))
+		{
+			check(false, "RX data order");
+			break;
+		}
+}
+
+static void test_tx(void)
+{
+	uart_span_t spans[2];
+	size_t i, free;
+
+	init();
+	check(write_seq(TX_SIZE) == TX_SIZE, "TX ring takes all its slots");
+	check(write_seq(1) == 0, "TX ring full");
+	check(host_uart[0].C2 & UART_C2_TIE_MASK, "TIE on after a write");
+	check(drain_tx(50, 0) == 50, "TX drained by the ISR");
+
+	// Lo nuevo da la vuelta al buffer
+	check(write_seq(80) == 50, "TX write limited to the free space");
+	check(drain_tx(2 * TX_SIZE, 50) == TX_SIZE, "TX drained after the wrap");
+	check(!(host_uart[0].C2 & UART_C2_TIE_MASK) && UART_is_tx_msg_complete(0), "TIE off when the ring is empty");
+
+	// Con la FIFO vacia una sola interrupcion la llena entera
+	write_seq(20);
+	SET_REG(host_uart[0].TCFIFO, 0);
+	UART0_RX_TX_IRQHandler();
+	check(UART_tx_reserve(0, spans) == TX_SIZE - (20 - FIFO_DEPTH), "ISR fills the whole TX FIFO");
+	check(drain_tx(20, tx_next - (20 - FIFO_DEPTH)) == 20 - FIFO_DEPTH, "TX rest after the FIFO fill");
+
+	// Escribir directo en el ring: los dos tramos cubren todo el lugar libre, partidos en el final del buffer
+	free = UART_tx_reserve(0, spans);
+	check(free == TX_SIZE && spans[0].len + spans[1].len == free, "reserve spans");
+	check(spans[0].len == TX_SIZE - ((tx_next) % TX_SIZE), "reserve first span ends at the end of the buffer");
+	for(i = 0; i < 30; i++)
+		*(i < spans[0].len ? &spans[0].data[i] : &spans[1].data[i - spans[0].len]) = (uint8_t)(tx_next + i);
+	UART_tx_commit(0, 30);
+	check(drain_tx(2 * TX_SIZE, tx_next) == 30, "TX from the reserved spans");
+	tx_next += 30;
+	UART_tx_commit(0, 2 * TX_SIZE);
+	check(UART_tx_reserve(0, spans) == 0, "commit limited to the free space");
+}
+
+static void test_rx(void)
+{
+	uart_span_t spans[2];
+	size_t len;
+
+	init();
+	check(host_uart[0].C2 & UART_C2_ILIE_MASK, "ILIE on in IRQ mode");
+	receive(RX_SIZE);
+	check(UART_get_rx_msg_length(0) == RX_SIZE && UART_get_rx_overrun(0) == 0, "RX ring takes all its slots");
+	receive(3);
+	check(UART_get_rx_overrun(0) == 3, "RX overrun counted");
+	read_expect(RX_SIZE, 0);
+	rx_next = RX_SIZE; // Los 3 de mas se perdieron
+
+	// IDLE con la FIFO vacia: la lectura de D da underflow y no se guarda nada
+	SET_REG(host_uart[0].S1, UART_S1_IDLE_MASK);
+	host_uart[0].SFIFO = UART_SFIFO_RXUF_MASK;
+	host_uart[0].CFIFO = 0;
+	UART0_RX_TX_IRQHandler();
+	check(!UART_is_rx_msg(0), "RX underflow not stored");
+	check(host_uart[0].CFIFO & UART_CFIFO_RXFLUSH_MASK, "RX FIFO flushed after the underflow");
+	host_uart[0].CFIFO = 0;
+
+	// Mirar sin copiar a traves de la vuelta del buffer
+	receive(100);
+	read_expect(100, RX_SIZE);
+	receive(50);
+	len = UART_rx_peek(0, spans);
+	check(len == 50 && spans[0].len == RX_SIZE - 100 && spans[1].len == 50 - (RX_SIZE - 100), "peek spans");
+	check(spans[0].data[0] == (uint8_t)(RX_SIZE + 100) && spans[1].data[0] == (uint8_t)(2 * RX_SIZE),
+			"peek data");
+	UART_rx_commit(0, 10);
+	check(UART_get_rx_msg_length(0) == 40, "partial commit");
+	UART_rx_commit(0, 2 * RX_SIZE);
+	check(!UART_is_rx_msg(0), "commit limited to the received bytes");
+}
+
+int main(void)
+{
+	test_tx();
+	test_rx();
+
+	return check_report();
+}
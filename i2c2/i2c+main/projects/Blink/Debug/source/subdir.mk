@@ -6,6 +6,7 @@
 C_SRCS += \
 ../source/AccelMagn_drv.c \
 ../source/App.c \
+../source/FixedAngle.c \
 ../source/SensorsPosition.c \
 ../source/SysTick.c \
 ../source/Timer.c \
@@ -15,6 +16,7 @@ C_SRCS += \
 OBJS += \
 ./source/AccelMagn_drv.o \
 ./source/App.o \
+./source/FixedAngle.o \
 ./source/SensorsPosition.o \
 ./source/SysTick.o \
 ./source/Timer.o \
@@ -24,6 +26,7 @@ OBJS += \
 C_DEPS += \
 ./source/AccelMagn_drv.d \
 ./source/App.d \
+./source/FixedAngle.d \
 ./source/SensorsPosition.d \
 ./source/SysTick.d \
 ./source/Timer.d \
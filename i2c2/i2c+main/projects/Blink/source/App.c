@@ -9,6 +9,7 @@
  ******************************************************************************/
 
 #include "SensorsPosition.h"
+#include "FixedAngle.h"
 #include "Timer.h"
 
 
@@ -23,9 +24,13 @@ uint8_t fsm = ROLL_REFRESH;
 int idtimer1 = 0;
 int idtimer2 = 0;
 
-roll_t roll_app;
-pitching_t pitching_app;
-orientation_t orientation_app;
+int16_t roll_app;
+int16_t pitching_app;
+int16_t orientation_app;
+
+#if FIXED_ANGLE_BENCH
+FixedAngleCycles angle_cycles; // Se lee con el debugger
+#endif
 
 
 /*******************************************************************************
@@ -45,15 +50,15 @@ void periodicRefresh(void)
 	// Cada 1 segundo refresca uno de los parámetros
 	switch (fsm) {
 		case ROLL_REFRESH:
-			roll_app = Position_GetRoll();
+			roll_app = SensorsPosition_GetRollAngle();
 			// ENVIAR A PC NUEVO DATO POR UART
 			break;
 		case PITCH_REFRESH:
-			pitching_app = Position_GetPitch();
+			pitching_app = SensorsPosition_GetPitchAngle();
 			// Enviar a PC NUEVO DATO POR UART
 			break;
 		case ORIENT_REFRESH:
-			orientation_app = Position_GetOrientation();
+			orientation_app = SensorsPosition_GetYawAngle();
 			// ENVIAR A PC NUEVO DATO POR UART
 			break;
 	}
@@ -82,8 +87,11 @@ void periodicRefresh(void)
 /* Función que se llama 1 vez, al comienzo del programa */
 void App_Init (void)
 {
+#if FIXED_ANGLE_BENCH
+	 FixedAngle_MeasureCycles(&angle_cycles); // Antes de que arranquen las interrupciones del I2C
+#endif
 
-	 Position_InitDrv(test);
+	 SensorsPosition_Init(test);
 
 	 /*
 	 timerInit();
@@ -96,7 +104,7 @@ void App_Init (void)
 */
 	// timerInit();
 	bool timOK = Timer_Init();
-	idtimer1 = Timer_AddCallback(&Position_Update,200,false);
+	idtimer1 = Timer_AddCallback(&SensorsPosition_ReadData,200,false);
 	idtimer2 = Timer_AddCallback(&periodicRefresh,1000,false);
 	Timer_Resume(idtimer1);
 	Timer_Resume(idtimer2);
@@ -114,6 +122,8 @@ void App_Init (void)
 /* Función que se llama constantemente en un ciclo infinito */
 void App_Run (void)
 {
+	// La cuenta de los angulos y test() corren aca, fuera de la ISR del I2C
+	SensorsPosition_Process();
 	//UART_write_msg(0,"test\n",5);
 }
 
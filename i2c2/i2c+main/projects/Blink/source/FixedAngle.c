@@ -0,0 +1,179 @@
+/*
+ * FixedAngle.c
+ *
+ *  Created on: 10 Dec 2020
+ *      Author: Grupo 2 - Labo de Micros
+ */
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+#include "FixedAngle.h"
+#if FIXED_ANGLE_BENCH
+#include "hardware.h"
+#endif
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+// atan(z) = z*(C1 + z^2*(C3 + z^2*(C5 + z^2*(C7 + z^2*C9)))), 0 <= z <= 1, error 1e-5 rad.
+// Coeficientes divididos por pi (el resultado sale en angulo binario) y en Q20
+#define ATAN_C1		333727		//  0.9998660 / pi
+#define ATAN_C3		(-110244)	// -0.3302995 / pi
+#define ATAN_C5		60127		//  0.1801410 / pi
+#define ATAN_C7		(-28415)	// -0.0851330 / pi
+#define ATAN_C9		6954		//  0.0208351 / pi
+
+// sin(z*pi/2) = z*(S1 + z^2*(S3 + z^2*(S5 + z^2*(S7 + z^2*S9)))), -1 <= z <= 1. Q20
+#define SIN_S1		1647099		//  pi/2
+#define SIN_S3		(-677342)	// -(pi/2)^3 / 3!
+#define SIN_S5		83564		//  (pi/2)^5 / 5!
+#define SIN_S7		(-4909)		// -(pi/2)^7 / 7!
+#define SIN_S9		168			//  (pi/2)^9 / 9!
+
+#define Q15_MAX		32767
+
+#define MUL_Q15(a, b)	FIXED_ANGLE_MUL_Q15(a, b)
+
+#define BENCH_STEP	509 // Paso del barrido de atan2: primo, para no caer siempre en los mismos cocientes
+
+/*******************************************************************************
+ *******************************************************************************
+                        GLOBAL FUNCTION DEFINITIONS
+ *******************************************************************************
+ ******************************************************************************/
+
+int16_t FixedAngle_Atan2(int32_t y, int32_t x)
+{
+	int32_t ax = (x < 0) ? -x : x;
+	int32_t ay = (y < 0) ? -y : y;
+	int32_t z, z2, poly, angle;
+
+	if (ax == 0 && ay == 0)
+		return 0;
+
+	// Reduce al primer octante: z = min/max en Q15, entre 0 y 1
+	if (ay <= ax)
+		z = (ay << 15) / ax;
+	else
+		z = (ax << 15) / ay;
+
+	z2 = MUL_Q15(z, z);
+	poly = ATAN_C9;
+	poly = ATAN_C7 + MUL_Q15(poly, z2);
+	poly = ATAN_C5 + MUL_Q15(poly, z2);
+	poly = ATAN_C3 + MUL_Q15(poly, z2);
+	poly = ATAN_C1 + MUL_Q15(poly, z2);
+	angle = (int32_t)(((int64_t)poly * z + (1 << 19)) >> 20); // Q20 * Q15 -> Q15 redondeado
+
+	// Vuelve al cuadrante original
+	if (ay > ax)
+		angle = FIXED_ANGLE_HALF_PI - angle;
+	if (x < 0)
+		angle = FIXED_ANGLE_PI - angle;
+	if (y < 0)
+		angle = -angle;
+
+	return (int16_t)angle; // +180 queda como -180, es el mismo angulo
+}
+
+int16_t FixedAngle_Sin(int32_t angle)
+{
+	int32_t x = (int16_t)angle; // Una vuelta completa: -180 a +180
+	int32_t z, z2, poly, value;
+
+	// sin(180 - a) = sin(a): lleva todo a -90..+90
+	if (x > FIXED_ANGLE_HALF_PI)
+		x = FIXED_ANGLE_PI - x;
+	else if (x < -FIXED_ANGLE_HALF_PI)
+		x = -FIXED_ANGLE_PI - x;
+
+	z = x << 1; // Q15 con 1.0 = 90 grados
+	z2 = MUL_Q15(z, z);
+	poly = SIN_S9;
+	poly = SIN_S7 + MUL_Q15(poly, z2);
+	poly = SIN_S5 + MUL_Q15(poly, z2);
+	poly = SIN_S3 + MUL_Q15(poly, z2);
+	poly = SIN_S1 + MUL_Q15(poly, z2);
+	value = (int32_t)(((int64_t)poly * z + (1 << 19)) >> 20);
+
+	if (value > Q15_MAX)
+		value = Q15_MAX;
+	else if (value < -Q15_MAX)
+		value = -Q15_MAX;
+	return (int16_t)value;
+}
+
+int16_t FixedAngle_Cos(int32_t angle)
+{
+	return FixedAngle_Sin(angle + FIXED_ANGLE_HALF_PI);
+}
+
+int16_t FixedAngle_ToDegrees(int32_t angle)
+{
+	return (int16_t)((angle * 180 + (FIXED_ANGLE_PI / 2)) >> 15);
+}
+
+#if FIXED_ANGLE_BENCH
+// Extremos de las entradas: cocientes de SDIV largos y cortos
+static const int32_t benchEdges[] = {0, 1, -1, 2, 255, -256, 4095, -4096, 32767, -32767, 32768, -32768};
+#define BENCH_EDGES_COUNT	(sizeof(benchEdges) / sizeof(benchEdges[0]))
+
+static void benchUpdate(uint32_t elapsed, uint32_t * min, uint32_t * max)
+{
+	if (elapsed < *min)
+		*min = elapsed;
+	if (elapsed > *max)
+		*max = elapsed;
+}
+
+void FixedAngle_MeasureCycles(FixedAngleCycles * cycles)
+{
+	volatile int16_t result;
+	uint32_t primask = __get_PRIMASK();
+	uint32_t start, overhead;
+	int32_t x, y;
+	unsigned int i, j;
+
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+	__disable_irq();
+
+	// Lo que cuesta leer CYCCNT dos veces se descuenta de cada medicion
+	start = DWT->CYCCNT;
+	overhead = DWT->CYCCNT - start;
+
+	cycles->atan2Min = cycles->sinMin = UINT32_MAX;
+	cycles->atan2Max = cycles->sinMax = 0;
+	for (i = 0; i < BENCH_EDGES_COUNT; i++)
+	{
+		for (j = 0; j < BENCH_EDGES_COUNT; j++)
+		{
+			start = DWT->CYCCNT;
+			result = FixedAngle_Atan2(benchEdges[i], benchEdges[j]);
+			benchUpdate(DWT->CYCCNT - start - overhead, &cycles->atan2Min, &cycles->atan2Max);
+		}
+	}
+	for (y = -32768; y <= 32768; y += BENCH_STEP)
+	{
+		for (x = -32768; x <= 32768; x += BENCH_STEP)
+		{
+			start = DWT->CYCCNT;
+			result = FixedAngle_Atan2(y, x);
+			benchUpdate(DWT->CYCCNT - start - overhead, &cycles->atan2Min, &cycles->atan2Max);
+		}
+	}
+	for (x = -32768; x <= 32767; x++)
+	{
+		start = DWT->CYCCNT;
+		result = FixedAngle_Sin(x);
+		benchUpdate(DWT->CYCCNT - start - overhead, &cycles->sinMin, &cycles->sinMax);
+	}
+	(void)result;
+
+	__set_PRIMASK(primask);
+}
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
@@ -0,0 +1,82 @@
+/*
+ * FixedAngle.h
+ *
+ *  Created on: 10 Dec 2020
+ *      Author: Grupo 2 - Labo de Micros
+ */
+
+#ifndef FIXED_ANGLE_H_
+#define FIXED_ANGLE_H_
+
+#include <stdint.h>
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+// Angulos binarios Q15: 32768 = 180 grados. Sumar/restar da la vuelta sola al desbordar int16
+#define FIXED_ANGLE_PI		32768
+#define FIXED_ANGLE_HALF_PI	16384
+
+// Producto de un valor por un Q15 (seno, coseno)
+#define FIXED_ANGLE_MUL_Q15(a, b)	((int32_t)(((int64_t)(a) * (b)) >> 15))
+
+// 1: compila FixedAngle_MeasureCycles, que mide las funciones con DWT->CYCCNT en la placa
+#ifndef FIXED_ANGLE_BENCH
+#define FIXED_ANGLE_BENCH	0
+#endif
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef struct {
+	uint32_t atan2Min;
+	uint32_t atan2Max;
+	uint32_t sinMin;
+	uint32_t sinMax;
+} FixedAngleCycles;
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+/**
+ * @brief atan2(y, x) using only integer operations: one division and a 5-term polynomial.
+ * 		  No loops, so the time is bounded, but not constant: the Cortex-M4 SDIV takes 2 to 12
+ * 		  cycles depending on the operands. FixedAngle_MeasureCycles gives the bound on the board.
+ * 		  Error below 0.01 degrees.
+ * @param y Any value between -32768 and +32768 (int16 values and their negation)
+ * @param x Any value between -32768 and +32768
+ * @return Angle in Q15 binary units, -32768 to 32767 (-180 to +180 degrees). 0 if x = y = 0
+ */
+int16_t FixedAngle_Atan2(int32_t y, int32_t x);
+
+/**
+ * @brief Sine of a Q15 binary angle, 9th order polynomial. Error below 1e-4
+ * @return Q15 value, -32767 to 32767
+ */
+int16_t FixedAngle_Sin(int32_t angle);
+
+/**
+ * @brief Cosine of a Q15 binary angle.
+ * @return Q15 value, -32767 to 32767
+ */
+int16_t FixedAngle_Cos(int32_t angle);
+
+/**
+ * @brief Converts a Q15 binary angle to degrees, rounding to the nearest one.
+ * @return -180 to +180
+ */
+int16_t FixedAngle_ToDegrees(int32_t angle);
+
+#if FIXED_ANGLE_BENCH
+/**
+ * @brief Measures FixedAngle_Atan2 and FixedAngle_Sin with DWT->CYCCNT over a sweep of inputs,
+ * 		  with interrupts masked. Takes about 0.1 s at 100 MHz.
+ * @param cycles Minimum and maximum core cycles of each function, call overhead included
+ */
+void FixedAngle_MeasureCycles(FixedAngleCycles * cycles);
+#endif
+
+#endif /* FIXED_ANGLE_H_ */
@@ -10,7 +10,25 @@
 #include "SensorsPosition.h"
 #include "AccelMagn_drv.h"
 #include "timer.h"
-#include <math.h>
+#include "FixedAngle.h"
+#include <stdlib.h>
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+#define CALIBRATION_SEED		0xA5A5
+#define CALIBRATION_MIN_SPAN	200 // Rango minimo por eje para aceptar una calibracion
+#define ATAN2_LIMIT				32768 // FixedAngle_Atan2 acepta hasta +/-32768
+#define SAMPLE_QUEUE_LEN		4 // Potencia de 2. Muestras pendientes entre la ISR y SensorsPosition_Process
+#define SAMPLE_QUEUE_MASK		(SAMPLE_QUEUE_LEN - 1)
+
+// 1: la ISR solo encola la muestra y la cuenta se hace en SensorsPosition_Process
+// 0: la cuenta y los callbacks corren dentro de la ISR del I2C (para comparar con I2C_GetMaxIsrCycles)
+// Peor caso de la ISR con 0 y con 1: SIN MEDIR, no hubo placa para correrlo. Para medirlo, compilar con
+// cada valor, dejar andar el muestreo un rato con I2C_ResetIsrStats al arrancar y leer I2C_GetMaxIsrCycles
+#ifndef POSITION_DEFERRED_MATH
+#define POSITION_DEFERRED_MATH	1
+#endif
+
 /*******************************************************************************
  * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
  ******************************************************************************/
@@ -20,6 +38,11 @@ typedef struct
 	bool valueChanged;
 }SensorsPosition_AngleData_t;
 
+typedef struct
+{
+	SRAWDATA accel, magn;
+}SensorsPosition_Sample_t;
+
 
 
 /*******************************************************************************
@@ -33,8 +56,20 @@ SensorsPosition_AngleData_t pitch ={.currentValue = 0, .previousValue = 0, .valu
 SensorsPosition_AngleData_t yaw ={.currentValue = 0, .previousValue = 0, .valueChanged = false};
 
 
+static int16_t heading; // Q15, ultimo rumbo calculado
+static SensorsPosition_Calibration_t calibration = {.offsetX = 0, .offsetY = 0, .offsetZ = 0, .checksum = CALIBRATION_SEED};
+static bool isCalibrating = false;
+static SRAWDATA magnetometerMin, magnetometerMax;
+
 static read_data sensorsData;
-static bool isReading = false;
+static volatile bool isReading = false;
+
+// La ISR escribe aca y copia a la cola; la cuenta usa accelerometerCoordinates/magnetometerCoordinates
+static SRAWDATA accelerometerRaw, magnetometerRaw;
+// Cola de un productor (ISR) y un consumidor (App_Run): cada indice lo escribe un solo lado
+static SensorsPosition_Sample_t sampleQueue[SAMPLE_QUEUE_LEN];
+static volatile uint8_t sampleHead, sampleTail;
+static volatile uint32_t droppedSamples;
 
 void (*_onAngleChangedCallback)(void);
 
@@ -47,6 +82,12 @@ static void Position_CalculateRoll(void);
 static void Position_CalculatePitch(void);
 static void Position_CalculateYaw(void);
 static void callback_updatePos (void);
+static void Position_Update(void);
+static int16_t Position_AtanDegrees(int16_t num, int16_t den);
+static int16_t Position_TiltCompensatedHeading(void);
+static int16_t Position_Atan2(int32_t y, int32_t x);
+static void Position_TrackCalibration(void);
+static uint16_t Position_CalibrationChecksum(const SensorsPosition_Calibration_t * cal);
 
 /*******************************************************************************
  *******************************************************************************
@@ -57,20 +98,53 @@ void SensorsPosition_Init(void (*onAngleChangedCallback)(void)){
 	AccelMagn_init();
 	_onAngleChangedCallback = onAngleChangedCallback;
 	sensorsData.callback = callback_updatePos;
-	sensorsData.pAccelData = &accelerometerCoordinates;
-	sensorsData.pMagnData = &magnetometerCoordinates;
+	sensorsData.pAccelData = &accelerometerRaw;
+	sensorsData.pMagnData = &magnetometerRaw;
 }
 
+// Corre en la ISR del I2C: solo encola la muestra
 static void callback_updatePos (void)
 {
-	if (sensorsData.error != I2C_OK)
+	if (sensorsData.error == I2C_OK)
 	{
-		isReading = false;
-		return;
+#if POSITION_DEFERRED_MATH
+		uint8_t next = (sampleHead + 1) & SAMPLE_QUEUE_MASK;
+		if (next == sampleTail)
+		{
+			droppedSamples++; // App_Run no llego a vaciar la cola
+		}
+		else
+		{
+			sampleQueue[sampleHead].accel = accelerometerRaw;
+			sampleQueue[sampleHead].magn = magnetometerRaw;
+			__DMB(); // La muestra queda escrita antes de que App_Run vea el nuevo head
+			sampleHead = next;
+		}
+#else
+		accelerometerCoordinates = accelerometerRaw;
+		magnetometerCoordinates = magnetometerRaw;
+		Position_Update();
+#endif
+	}
+	isReading = false;
+}
+
+void SensorsPosition_Process(void)
+{
+	while (sampleTail != sampleHead)
+	{
+		__DMB(); // Leo la muestra recien despues de haber visto head
+		accelerometerCoordinates = sampleQueue[sampleTail].accel;
+		magnetometerCoordinates = sampleQueue[sampleTail].magn;
+		__DMB(); // Termino de leerla antes de liberar el lugar
+		sampleTail = (sampleTail + 1) & SAMPLE_QUEUE_MASK;
+		Position_Update();
 	}
-	Position_CalculateRoll();
-	Position_CalculatePitch();
-	Position_CalculateYaw();
+}
+
+uint32_t SensorsPosition_GetDroppedSamples(void)
+{
+	return droppedSamples;
 }
 
 SensorsPosition_EulerAngles_t SensorsPosition_GetEulerAngles(void)
@@ -102,6 +176,49 @@ int16_t SensorsPosition_GetYawAngle(void)
 	return yaw.currentValue;
 }
 
+int16_t SensorsPosition_GetHeading(void)
+{
+	int16_t degrees = FixedAngle_ToDegrees(heading);
+	return (degrees < 0) ? degrees + 360 : degrees;
+}
+
+void SensorsPosition_StartCalibration(void)
+{
+	magnetometerMin = (SRAWDATA){.x = INT16_MAX, .y = INT16_MAX, .z = INT16_MAX};
+	magnetometerMax = (SRAWDATA){.x = INT16_MIN, .y = INT16_MIN, .z = INT16_MIN};
+	isCalibrating = true;
+}
+
+bool SensorsPosition_FinishCalibration(SensorsPosition_Calibration_t * result)
+{
+	SensorsPosition_Calibration_t newCalibration;
+
+	isCalibrating = false;
+	if ((magnetometerMax.x - magnetometerMin.x) < CALIBRATION_MIN_SPAN ||
+		(magnetometerMax.y - magnetometerMin.y) < CALIBRATION_MIN_SPAN ||
+		(magnetometerMax.z - magnetometerMin.z) < CALIBRATION_MIN_SPAN)
+		return false;
+
+	// El hard-iron corre la esfera de mediciones: el centro es el offset
+	newCalibration.offsetX = (magnetometerMax.x + magnetometerMin.x) / 2;
+	newCalibration.offsetY = (magnetometerMax.y + magnetometerMin.y) / 2;
+	newCalibration.offsetZ = (magnetometerMax.z + magnetometerMin.z) / 2;
+	newCalibration.checksum = Position_CalibrationChecksum(&newCalibration);
+	calibration = newCalibration;
+
+	if (result != NULL)
+		*result = newCalibration;
+	return true;
+}
+
+bool SensorsPosition_SetCalibration(const SensorsPosition_Calibration_t * newCalibration)
+{
+	if (newCalibration->checksum != Position_CalibrationChecksum(newCalibration))
+		return false;
+	calibration = *newCalibration;
+	return true;
+}
+
 SensorsPosition_Angles_t SensorsPosition_GetChangedAngle(void)
 {
 	if(roll.valueChanged)
@@ -122,16 +239,21 @@ SensorsPosition_Angles_t SensorsPosition_GetChangedAngle(void)
 	return -1;
 }
 
+static void Position_Update(void)
+{
+	if (isCalibrating)
+		Position_TrackCalibration();
+	Position_CalculateRoll();
+	Position_CalculatePitch();
+	Position_CalculateYaw();
+}
+
 static void Position_CalculateRoll(void)
 {
 	roll.previousValue = roll.currentValue;
-	if (accelerometerCoordinates.x != 0)
-		roll.currentValue = (int)180*atan((float)accelerometerCoordinates.z/ (float)accelerometerCoordinates.x)/M_PI;
-	else
-		roll.currentValue = 90;
+	roll.currentValue = Position_AtanDegrees(accelerometerCoordinates.z, accelerometerCoordinates.x);
 
-
-	int diference = fabsf((fabsf(roll.previousValue) - fabsf(roll.currentValue)));
+	int diference = abs(abs(roll.previousValue) - abs(roll.currentValue));
 
 	if(diference > 5)
 	{
@@ -143,12 +265,9 @@ static void Position_CalculateRoll(void)
 static void Position_CalculatePitch(void)
 {
 	pitch.previousValue = pitch.currentValue;
-	if (accelerometerCoordinates.y != 0)
-		pitch.currentValue = (int)180*atan((float)accelerometerCoordinates.z/ (float)accelerometerCoordinates.y)/M_PI;
-	else
-		pitch.currentValue = 90;
+	pitch.currentValue = Position_AtanDegrees(accelerometerCoordinates.z, accelerometerCoordinates.y);
 
-	int diference = fabsf(fabsf(pitch.previousValue) - fabsf(pitch.currentValue));
+	int diference = abs(abs(pitch.previousValue) - abs(pitch.currentValue));
 
 	if(diference > 5)
 	{
@@ -160,12 +279,10 @@ static void Position_CalculatePitch(void)
 static void Position_CalculateYaw(void)
 {
 	yaw.previousValue = yaw.currentValue;
-	if (magnetometerCoordinates.y != 0)
-		yaw.currentValue =  (int)180*atan((float)magnetometerCoordinates.y/ (float)magnetometerCoordinates.x)/M_PI;
-	else
-		yaw.currentValue = 90;
+	heading = Position_TiltCompensatedHeading();
+	yaw.currentValue = FixedAngle_ToDegrees(heading);
 
-	int diference = fabsf(fabsf(yaw.previousValue) - fabsf(yaw.currentValue));
+	int diference = abs(abs(yaw.previousValue) - abs(yaw.currentValue));
 
 	if(diference > 5)
 	{
@@ -174,5 +291,75 @@ static void Position_CalculateYaw(void)
 	}
 }
 
+// atan(num/den) en grados, -90 a +90, como la atan de un argumento. 90 si den = 0
+static int16_t Position_AtanDegrees(int16_t num, int16_t den)
+{
+	if (den == 0)
+		return 90;
+	if (den < 0)
+		return FixedAngle_ToDegrees(FixedAngle_Atan2(-(int32_t)num, -(int32_t)den));
+	return FixedAngle_ToDegrees(FixedAngle_Atan2(num, den));
+}
+
+// Rumbo con compensacion de inclinacion (AN4248): se calculan roll y pitch con el acelerometro
+// y se rota el campo magnetico al plano horizontal antes del atan2
+static int16_t Position_TiltCompensatedHeading(void)
+{
+	int32_t gx = accelerometerCoordinates.x;
+	int32_t gy = accelerometerCoordinates.y;
+	int32_t gz = accelerometerCoordinates.z;
+	int32_t bx = magnetometerCoordinates.x - calibration.offsetX;
+	int32_t by = magnetometerCoordinates.y - calibration.offsetY;
+	int32_t bz = magnetometerCoordinates.z - calibration.offsetZ;
+	int32_t sinRoll, cosRoll, sinPitch, cosPitch;
+	int32_t gzRotated, bzRotated, bxHorizontal, byHorizontal;
+	int16_t rollQ15, pitchQ15;
+
+	rollQ15 = Position_Atan2(gy, gz);
+	sinRoll = FixedAngle_Sin(rollQ15);
+	cosRoll = FixedAngle_Cos(rollQ15);
+
+	// pitch entre -90 y +90: el denominador siempre positivo
+	gzRotated = FIXED_ANGLE_MUL_Q15(gy, sinRoll) + FIXED_ANGLE_MUL_Q15(gz, cosRoll);
+	if (gzRotated < 0)
+		pitchQ15 = Position_Atan2(gx, -gzRotated);
+	else
+		pitchQ15 = Position_Atan2(-gx, gzRotated);
+	sinPitch = FixedAngle_Sin(pitchQ15);
+	cosPitch = FixedAngle_Cos(pitchQ15);
+
+	byHorizontal = FIXED_ANGLE_MUL_Q15(bz, sinRoll) - FIXED_ANGLE_MUL_Q15(by, cosRoll);
+	bzRotated = FIXED_ANGLE_MUL_Q15(by, sinRoll) + FIXED_ANGLE_MUL_Q15(bz, cosRoll);
+	bxHorizontal = FIXED_ANGLE_MUL_Q15(bx, cosPitch) + FIXED_ANGLE_MUL_Q15(bzRotated, sinPitch);
+
+	return Position_Atan2(byHorizontal, bxHorizontal);
+}
+
+// atan2 para cualquier par int32: achica los dos hasta entrar en el rango de FixedAngle_Atan2
+static int16_t Position_Atan2(int32_t y, int32_t x)
+{
+	while (y > ATAN2_LIMIT || y < -ATAN2_LIMIT || x > ATAN2_LIMIT || x < -ATAN2_LIMIT)
+	{
+		y >>= 1;
+		x >>= 1;
+	}
+	return FixedAngle_Atan2(y, x);
+}
+
+static void Position_TrackCalibration(void)
+{
+	if (magnetometerCoordinates.x < magnetometerMin.x) magnetometerMin.x = magnetometerCoordinates.x;
+	if (magnetometerCoordinates.y < magnetometerMin.y) magnetometerMin.y = magnetometerCoordinates.y;
+	if (magnetometerCoordinates.z < magnetometerMin.z) magnetometerMin.z = magnetometerCoordinates.z;
+	if (magnetometerCoordinates.x > magnetometerMax.x) magnetometerMax.x = magnetometerCoordinates.x;
+	if (magnetometerCoordinates.y > magnetometerMax.y) magnetometerMax.y = magnetometerCoordinates.y;
+	if (magnetometerCoordinates.z > magnetometerMax.z) magnetometerMax.z = magnetometerCoordinates.z;
+}
+
+static uint16_t Position_CalibrationChecksum(const SensorsPosition_Calibration_t * cal)
+{
+	return CALIBRATION_SEED ^ (uint16_t)cal->offsetX ^ (uint16_t)(cal->offsetY << 1) ^ (uint16_t)(cal->offsetZ << 2);
+}
+
 /*******************************************************************************
  ******************************************************************************/
@@ -9,6 +9,7 @@
 #define SENSORS_POSITION_H_
 
 #include <stdint.h>
+#include <stdbool.h>
 /*******************************************************************************
  * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
  ******************************************************************************/
@@ -18,6 +19,13 @@ typedef struct
 {
 	int16_t roll, pitch, yaw;
 }SensorsPosition_EulerAngles_t;
+
+// Calibracion hard-iron del magnetometro. Se puede guardar tal cual en memoria no volatil
+typedef struct
+{
+	int16_t offsetX, offsetY, offsetZ; // en cuentas del magnetometro
+	uint16_t checksum;
+}SensorsPosition_Calibration_t;
 /*******************************************************************************
  * FUNCTION PROTOTYPES WITH GLOBAL SCOPE
  ******************************************************************************/
@@ -39,6 +47,17 @@ SensorsPosition_EulerAngles_t SensorsPosition_GetEulerAngles(void);
  */
 void SensorsPosition_ReadData(void);
 
+/**
+ * @brief Processes the samples read so far: updates the angles and calls onAngleChangedCallback.
+ * Must be called from the main loop (App_Run); the I2C interrupt only queues the samples.
+ */
+void SensorsPosition_Process(void);
+
+/**
+ * @brief Returns how many samples were dropped because SensorsPosition_Process wasn't called often enough.
+ */
+uint32_t SensorsPosition_GetDroppedSamples(void);
+
 /**
  * @brief Returns the "roll" angle.
  * @return roll angle. -180 to +180
@@ -52,11 +71,35 @@ int16_t SensorsPosition_GetRollAngle(void);
 int16_t SensorsPosition_GetPitchAngle(void);
 
 /**
- * @brief Returns the "yaw" angle.
+ * @brief Returns the "yaw" angle, the tilt-compensated heading.
  * @return yaw angle. -180 to +180
  */
 int16_t SensorsPosition_GetYawAngle(void);
 
+/**
+ * @brief Returns the tilt-compensated compass heading, using the accelerometer to undo roll and pitch.
+ * @return heading. 0 to 359, clockwise
+ */
+int16_t SensorsPosition_GetHeading(void);
+
+/**
+ * @brief Starts a hard-iron calibration. Keep reading data while the board is rotated in every direction.
+ */
+void SensorsPosition_StartCalibration(void);
+
+/**
+ * @brief Ends the calibration and applies it.
+ * @param calibration Where to copy the result so it can be saved. May be NULL
+ * @return false if the board wasn't rotated enough. The previous calibration is kept
+ */
+bool SensorsPosition_FinishCalibration(SensorsPosition_Calibration_t * calibration);
+
+/**
+ * @brief Applies a saved calibration.
+ * @return false if its checksum doesn't match (e.g. erased memory). Nothing is applied
+ */
+bool SensorsPosition_SetCalibration(const SensorsPosition_Calibration_t * calibration);
+
 /**
  * @brief returns the angle that has changed. A change is determined by a difference of at least 5 degrees from the last measurement.
  * @return SensorsPosition_Angles_t angle.
@@ -5,6 +5,7 @@
 
 #include "i2c.h"
 #include "board.h"
+#include "hardware.h"
 
 
 /*******************************************************************************
@@ -44,11 +45,13 @@ static IRQn_Type i2c_irqs[] = I2C_IRQS;
 static I2C_Type* i2c;
 static I2C_COM_CONTROL * i2c_com;
 static I2C_ChannelType channel_;
+static uint32_t isr_max_cycles; // peor duracion de I2C_Handler, en ciclos del core
 
 /*******************************************************************************
  * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
  ******************************************************************************/
 void I2C_Handler(void);
+static void I2C_MeasuredHandler(void);
 static void I2C_StartCommunication(I2C_COM_CONTROL * i2c_comm);
 static void I2C_EndCommunication(I2C_FAULT fault);
 
@@ -110,9 +113,27 @@ void I2C_Init(I2C_ChannelType channel)
 	 i2c->C1 |= I2C_C1_IICIE_MASK; 					// Enables I2C interrupt requests
 	 i2c->S = I2C_S_TCF_MASK | I2C_S_IICIF_MASK;
 	 i2c->F = I2C_F_MULT(0) | I2C_F_ICR(0); 		// I2C baud rate
+	 // DWT->CYCCNT para medir la duracion de la ISR
+	 CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	 DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
 	 NVIC_EnableIRQ(i2c_irqs[channel]);
 }
 
+uint32_t I2C_GetMaxIsrCycles(void)
+{
+	return isr_max_cycles;
+}
+
+uint32_t I2C_GetMaxIsrMicroseconds(void)
+{
+	return isr_max_cycles / (__CORE_CLOCK__ / 1000000U);
+}
+
+void I2C_ResetIsrStats(void)
+{
+	isr_max_cycles = 0;
+}
+
 
 void I2C_WriteMessage(I2C_COM_CONTROL * i2c_comm)
 {
@@ -434,17 +455,29 @@ void I2C_EndCommunication(I2C_FAULT fault)
 
 void I2C0_IRQHandler(void)
 {
-	I2C_Handler();
+	I2C_MeasuredHandler();
 }
 
 void I2C1_IRQHandler(void)
 {
-	I2C_Handler();
+	I2C_MeasuredHandler();
 }
 
 void I2C2_IRQHandler(void)
 {
+	I2C_MeasuredHandler();
+}
+
+// Incluye el callback del usuario, que corre dentro de la ISR
+static void I2C_MeasuredHandler(void)
+{
+	uint32_t start = DWT->CYCCNT;
 	I2C_Handler();
+	uint32_t elapsed = DWT->CYCCNT - start;
+	if (elapsed > isr_max_cycles)
+	{
+		isr_max_cycles = elapsed;
+	}
 }
 
 void I2C_Handler(void)
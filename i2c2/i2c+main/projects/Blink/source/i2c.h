@@ -94,6 +94,23 @@ void I2C_ReadMessage(I2C_COM_CONTROL * i2c_comm);
 void I2C_WriteMessage(I2C_COM_CONTROL * i2c_comm);
 
 
+/**
+ * @brief Worst-case duration of the I2C interrupt handler since init or the last reset, callbacks included
+ * @return core cycles
+*/
+uint32_t I2C_GetMaxIsrCycles(void);
+
+/**
+ * @brief Same as I2C_GetMaxIsrCycles
+ * @return microseconds
+*/
+uint32_t I2C_GetMaxIsrMicroseconds(void);
+
+/**
+ * @brief Clears the worst-case ISR duration
+*/
+void I2C_ResetIsrStats(void);
+
 I2C_FAULT i2cReadMsgBlocking (uint8_t * buffer, uint8_t data_size,	uint8_t register_address, uint8_t slave_address );
 
 I2C_FAULT i2cWriteMsgBlocking (uint8_t * msg, uint8_t data_size,	uint8_t register_address, uint8_t slave_address );
@@ -0,0 +1,96 @@
+/***************************************************************************//**
+  @file     test_fixed_angle.c
+  @brief    FixedAngle_Atan2, Sin, Cos and ToDegrees against libm
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "FixedAngle.h"
+#include "check.h"
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+
+#define ATAN2_MAX_ERROR		(0.01 * FIXED_ANGLE_PI / 180)	// 0.01 grados, en angulo binario
+#define SIN_MAX_ERROR		(1e-4 * 32768)					// En Q15
+
+static double atan2_error, sin_error;
+
+static void test_atan2_point(int32_t y, int32_t x)
+{
+	double ref = atan2(y, x) * FIXED_ANGLE_PI / M_PI;
+	double error = fabs(FixedAngle_Atan2(y, x) - ref);
+
+	if(error > FIXED_ANGLE_PI) // -180 y +180 son el mismo angulo
+		error = 2 * FIXED_ANGLE_PI - error;
+	if(error > atan2_error)
+		atan2_error = error;
+}
+
+static void test_atan2(void)
+{
+	static const int32_t edges[] = {-32768, -32767, -1, 0, 1, 32767, 32768};
+	int32_t x, y;
+	unsigned int i, j;
+
+	for(y = -32768; y <= 32768; y += 7)
+		for(x = -32768; x <= 32768; x += 13)
+			if(x != 0 || y != 0)
+				test_atan2_point(y, x);
+	for(i = 0; i < sizeof(edges) / sizeof(edges[0]); i++)
+		for(j = 0; j < sizeof(edges) / sizeof(edges[0]); j++)
+			if(edges[i] != 0 || edges[j] != 0)
+				test_atan2_point(edges[i], edges[j]);
+
+	printf("  atan2 max error %.3f units = %.5f deg\n", atan2_error, atan2_error * 180 / FIXED_ANGLE_PI);
+	check(atan2_error < ATAN2_MAX_ERROR, "atan2 error above 0.01 degrees");
+	check(FixedAngle_Atan2(0, 0) == 0, "atan2(0, 0)");
+	check(FixedAngle_Atan2(0, -100) == -FIXED_ANGLE_PI, "atan2 on the negative x axis");
+	check(FixedAngle_Atan2(100, 0) == FIXED_ANGLE_HALF_PI && FixedAngle_Atan2(-100, 0) == -FIXED_ANGLE_HALF_PI,
+			"atan2 on the y axis");
+}
+
+static void test_sin_cos(void)
+{
+	int32_t angle;
+	double error;
+	int16_t s, c;
+
+	// Un poco mas que una vuelta para cubrir el desborde del angulo
+	for(angle = -40000; angle <= 40000; angle++)
+	{
+		s = FixedAngle_Sin(angle);
+		c = FixedAngle_Cos(angle);
+		error = fabs(s - sin(angle * M_PI / FIXED_ANGLE_PI) * 32768);
+		if(error > sin_error)
+			sin_error = error;
+		error = fabs(c - cos(angle * M_PI / FIXED_ANGLE_PI) * 32768);
+		if(error > sin_error)
+			sin_error = error;
+		if(s < -32767 || s > 32767 || c < -32767 || c > 32767)
+		{
+			check(false, "sin/cos out of the Q15 range");
+			break;
+		}
+	}
+
+	printf("  sin/cos max error %.2f Q15 = %.6f\n", sin_error, sin_error / 32768);
+	check(sin_error < SIN_MAX_ERROR, "sin/cos error above 1e-4");
+	check(FixedAngle_Sin(0) == 0 && FixedAngle_Cos(FIXED_ANGLE_HALF_PI) == 0, "sin/cos zeros");
+}
+
+static void test_degrees(void)
+{
+	check(FixedAngle_ToDegrees(FIXED_ANGLE_HALF_PI) == 90, "90 degrees");
+	check(FixedAngle_ToDegrees(-FIXED_ANGLE_PI) == -180, "-180 degrees");
+	check(FixedAngle_ToDegrees(100) == 1 && FixedAngle_ToDegrees(-100) == -1, "rounding to the nearest degree");
+	check(FixedAngle_ToDegrees(0) == 0, "0 degrees");
+}
+
+int main(void)
+{
+	test_atan2();
+	test_sin_cos();
+	test_degrees();
+
+	return check_report();
+}
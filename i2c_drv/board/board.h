@@ -41,6 +41,14 @@
 #define I2C_SDA			PORTNUM2PIN(PE,25)//(PB,3) //PTE25
 #define I2C_SCL			PORTNUM2PIN(PE,24)//(PB,2) //PTE24
 
+#define ACCEL_INT1		PORTNUM2PIN(PC,6) //PTC6, compartido con SW2
+
+//I2C1 e I2C2 (headers de expansion)
+#define I2C1_SDA		PORTNUM2PIN(PC,11) //PTC11 ALT2
+#define I2C1_SCL		PORTNUM2PIN(PC,10) //PTC10 ALT2
+#define I2C2_SDA		PORTNUM2PIN(PA,13) //PTA13 ALT5
+#define I2C2_SCL		PORTNUM2PIN(PA,12) //PTA12 ALT5
+
 /*******************************************************************************
  ******************************************************************************/
 
@@ -4,34 +4,122 @@
 #include "AccelMagn_drv.h"
 #include "i2c.h"
 #include "Led.h"
+#include "board.h"
+#include "MK64F12.h"
+#include <string.h>
 
 // FXOS8700CQ I2C address
 #define FXOS8700CQ_SLAVE_ADDR 	0x1D//0x1E // with pins SA0=0, SA1=0
+#define FXOS8700CQ_I2C_CH		I2C_0 // bus donde esta conectado
+#define FXOS8700CQ_SCL_HZ		I2C_FAST_MODE
 
 // FXOS8700CQ internal register addresses
-#define FXOS8700CQ_STATUS 		0x00
+#define FXOS8700CQ_STATUS 		0x00 // F_STATUS con la FIFO activa
+#define FXOS8700CQ_F_SETUP 		0x09
 #define FXOS8700CQ_WHOAMI 		0x0D
 #define FXOS8700CQ_XYZ_DATA_CFG 0x0E
 #define FXOS8700CQ_CTRL_REG1 	0x2A
+#define FXOS8700CQ_CTRL_REG2 	0x2B
+#define FXOS8700CQ_CTRL_REG4 	0x2D
+#define FXOS8700CQ_CTRL_REG5 	0x2E
 #define FXOS8700CQ_M_CTRL_REG1 	0x5B
 #define FXOS8700CQ_M_CTRL_REG2 	0x5C
 #define FXOS8700CQ_WHOAMI_VAL 	0xC7
 
 // number of bytes to be read from the FXOS8700CQ
 #define FXOS8700CQ_READ_LEN 13 // status plus 6 channels = 13 bytes
+#define FXOS8700CQ_ACCEL_READ_LEN 7 // status plus the 3 accelerometer channels, without magnetometer
+
+// number of configuration writes done by AccelMagn_startBatch
+#define FXOS8700CQ_CFG_WRITES 7
+#define FXOS8700CQ_MAX_WRITES 10 // maximo de escrituras en un grupo
+
+// batch mode: F_STATUS plus 6 bytes per FIFO sample
+#define FXOS8700CQ_SAMPLE_LEN 6
+#define FXOS8700CQ_BATCH_LEN(n) (1 + FXOS8700CQ_SAMPLE_LEN * (n))
+#define FXOS8700CQ_F_OVF_MASK 0x80
+#define FXOS8700CQ_ACTIVE_MASK 0x01 // CTRL_REG1
+#define FXOS8700CQ_FS_MASK 0x03 // XYZ_DATA_CFG
+#define FXOS8700CQ_M_HMS_MASK 0x03 // M_CTRL_REG1: 00 solo acelerometro
+
+// ciclos del core por microsegundo, para medir latencias con DWT->CYCCNT
+#define CYCLES_PER_US	(__CORE_CLOCK__ / 1000000U)
 
 
 I2C_COM_CONTROL i2c_com;
 static read_data * r_data;
-static bool finish = false;
+static volatile bool finish = false;
+static volatile bool reading = false;
+
+// Modo data-ready: cada flanco de INT1 dispara una lectura
+static read_data * drdy_data = NULL;
+static uint32_t drdy_cycles; // DWT->CYCCNT en el flanco
+static bool drdy_stamped = false;
+static uint32_t latency_hist[ACCELMAGN_HIST_BINS];
+static uint32_t missed_samples;
 uint8_t Buffer[FXOS8700CQ_READ_LEN]; // read buffer
 
+// Modo batch: la FIFO del acelerometro avisa por INT1 al llegar a la marca de agua
+static uint8_t batch_buffer[FXOS8700CQ_BATCH_LEN(ACCELMAGN_FIFO_LEN)];
+static uint8_t batch_watermark;
+static SRAWDATA * batch_samples;
+static batchcallbackp batch_callback = NULL;
+
+// Copia de los registros de configuracion, para escribir solo los que cambian
+enum {SH_CTRL_REG1, SH_CTRL_REG2, SH_CTRL_REG4, SH_CTRL_REG5, SH_XYZ_DATA_CFG, SH_F_SETUP,
+	SH_M_CTRL_REG1, SH_M_CTRL_REG2, SHADOW_CANT};
+
+static const uint8_t shadow_regs[SHADOW_CANT] = {FXOS8700CQ_CTRL_REG1, FXOS8700CQ_CTRL_REG2,
+		FXOS8700CQ_CTRL_REG4, FXOS8700CQ_CTRL_REG5, FXOS8700CQ_XYZ_DATA_CFG, FXOS8700CQ_F_SETUP,
+		FXOS8700CQ_M_CTRL_REG1, FXOS8700CQ_M_CTRL_REG2};
+static uint8_t shadow[SHADOW_CANT];
+static bool shadow_valid = false;
+
+/*
+CTRL_REG1
+ [7-6]: aslp_rate=00
+ [5-3]: dr: 000=800Hz 001=400Hz ... 101=12.5Hz (accelerometer only); the rate is halved in hybrid mode
+ [2]: lnoise=1 for low noise mode (only +/-2g and +/-4g)
+ [1]: f_read=0 for normal 16 bit reads
+ [0]: active=1 to take the part out of standby and enable sampling
+CTRL_REG2
+ [1-0]: mods: 00=normal 01=low noise low power 10=high resolution 11=low power
+CTRL_REG4 / CTRL_REG5
+ [0]: int_en_drdy / int_cfg_drdy: data-ready interrupt routed to INT1 (active low, push-pull)
+XYZ_DATA_CFG
+ [1-0]: fs: 00=+/-2g 01=+/-4g (0.488mg/LSB) 10=+/-8g
+F_SETUP
+ [7-6]: f_mode=00 FIFO disabled
+M_CTRL_REG1
+ [7]: m_acal=0: auto calibration disabled
+ [6]: m_rst=0: no one-shot magnetic reset
+ [5]: m_ost=0: no one-shot magnetic measurement
+ [4-2]: m_os: oversampling to reduce magnetometer noise
+ [1-0]: m_hms: 00=accelerometer only 11=hybrid mode with accel and magnetometer active
+M_CTRL_REG2
+ [5]: hyb_autoinc_mode=1 to map the magnetometer registers to follow the accelerometer registers
+ [1-0]: m_rst_cnt=00 to enable magnetic reset each cycle
+*/
+static const uint8_t profiles[ACCEL_CANT_PROFILES][SHADOW_CANT] = {
+	// ACCEL_PROFILE_LOW_POWER: 12.5Hz accelerometer only, +/-4g, low power oversampling
+	{0x29, 0x03, 0x01, 0x01, 0x01, 0x00, 0x00, 0x00},
+	// ACCEL_PROFILE_BALANCED: 200Hz hybrid mode, +/-4g low noise, 8x magnetometer oversampling
+	{0x0D, 0x00, 0x01, 0x01, 0x01, 0x00, 0x9F, 0x20},
+	// ACCEL_PROFILE_HIGH_RATE: 800Hz accelerometer only, +/-8g, high resolution
+	{0x01, 0x02, 0x01, 0x01, 0x02, 0x00, 0x00, 0x00},
+};
+
 
 /*******************************************************************************
                         LOCAL SCOPE FUNCTION PROTOTYPES
  *******************************************************************************/
 void AccelMagn_readSensors(SRAWDATA *pAccelData, SRAWDATA *pMagnData);
 void callback_init (void);
+static void AccelMagn_dataReady (void);
+static void AccelMagn_fifoReady (void);
+static void AccelMagn_readBatch (void);
+static I2C_STATUS AccelMagn_writeRegs (const uint8_t * regs, const uint8_t * values, uint8_t count);
+static void shadow_update (uint8_t reg, uint8_t value);
 
 /*******************************************************************************
                         GLOBAL SCOPE FUNCTION DEFINITIONS
@@ -45,11 +133,11 @@ void callback_init (void);
 I2C_STATUS _mqx_ints_FXOS8700CQ_start(void)
 {
 	//Led_Toggle(LED_RED);
-	i2cInit(I2C_0);
+	i2cInit(FXOS8700CQ_I2C_CH, FXOS8700CQ_SCL_HZ);
 	uint8_t databyte;
 
 	// read and check the FXOS8700CQ WHOAMI register
-	if (i2cReadMsgBlocking(&databyte, 1, FXOS8700CQ_WHOAMI, FXOS8700CQ_SLAVE_ADDR)!= I2C_NO_FAULT)
+	if (i2cReadMsgBlocking(FXOS8700CQ_I2C_CH, &databyte, 1, FXOS8700CQ_WHOAMI, FXOS8700CQ_SLAVE_ADDR)!= I2C_NO_FAULT)
 	{
 		//Led_Toggle(LED_RED);
 		return (I2C_ERROR);
@@ -61,120 +149,123 @@ I2C_STATUS _mqx_ints_FXOS8700CQ_start(void)
 	}
 	//Led_Toggle(LED_RED);
 
-	// write 0000 0000 = 0x00 to accelerometer control register 1 to place FXOS8700CQ into standby
-	// [7-1] = 0000 000
-	// [0]: active=0
-	databyte = 0x00;
-	finish = false;
-	i2c_com.callback = callback_init;
-	i2c_com.data = &databyte;
-	i2c_com.data_size = 1;
-	i2c_com.slave_address =FXOS8700CQ_SLAVE_ADDR;
-	i2c_com.register_address = FXOS8700CQ_CTRL_REG1;
+	shadow_valid = false; // Escribe todos los registros del perfil
+	return AccelMagn_configure(ACCEL_PROFILE_BALANCED);
+}
 
-	i2cWriteMsg(&i2c_com);
 
-	int test = 1;
-	while (finish == false)
+I2C_STATUS AccelMagn_configure(ACCEL_PROFILE profile)
+{
+	uint8_t regs[FXOS8700CQ_MAX_WRITES];
+	uint8_t values[FXOS8700CQ_MAX_WRITES];
+	const uint8_t * target;
+	uint8_t count = 0;
+	uint8_t i;
+
+	if(profile >= ACCEL_CANT_PROFILES)
 	{
-		if (test){
-			//Led_Toggle(LED_RED);
-			test = 0;
-		}
-		if(i2c_com.fault != I2C_NO_FAULT)
-		{
-			//Led_Toggle(LED_RED);
-			return (I2C_ERROR);
-		}
+		return (I2C_ERROR);
 	}
+	target = profiles[profile];
 
+	if(shadow_valid && memcmp(shadow, target, SHADOW_CANT) == 0)
+	{
+		return (I2C_OK); // Ya esta configurado: ni una escritura
+	}
 
-	// write 0001 1111 = 0x1F to magnetometer control register 1
-	// [7]: m_acal=0: auto calibration disabled
-	// [6]: m_rst=0: no one-shot magnetic reset
-	// [5]: m_ost=0: no one-shot magnetic measurement
-	// [4-2]: m_os=111=7: 8x oversampling (for 200Hz) to reduce magnetometer noise
-	// [1-0]: m_hms=11=3: select hybrid mode with accel and magnetometer active
-	databyte = 0x9F;//0x1F;
-	finish = false;
-	i2c_com.register_address = FXOS8700CQ_M_CTRL_REG1;
-	i2cWriteMsg(&i2c_com);
-	while (finish == false)
+	// Casi todos los registros solo se pueden cambiar en standby
+	if(!shadow_valid || (shadow[SH_CTRL_REG1] & FXOS8700CQ_ACTIVE_MASK))
 	{
-		if(i2c_com.fault != I2C_NO_FAULT)
+		regs[count] = FXOS8700CQ_CTRL_REG1;
+		values[count++] = shadow_valid ? (shadow[SH_CTRL_REG1] & ~FXOS8700CQ_ACTIVE_MASK) : 0x00;
+	}
+
+	// Solo los registros que cambian. CTRL_REG1 va al final porque es el que activa
+	for(i = SH_CTRL_REG1 + 1; i < SHADOW_CANT; i++)
+	{
+		if(!shadow_valid || shadow[i] != target[i])
 		{
-			//Led_Toggle(LED_RED);
-			return (I2C_ERROR);
+			regs[count] = shadow_regs[i];
+			values[count++] = target[i];
 		}
 	}
+	regs[count] = FXOS8700CQ_CTRL_REG1;
+	values[count++] = target[SH_CTRL_REG1];
 
+	if(batch_callback != NULL)
+	{
+		AccelMagn_disableDataReady(); // Los perfiles apagan la FIFO
+	}
 
-	// write 0010 0000 = 0x20 to magnetometer control register 2
-	// [7]: reserved
-	// [6]: reserved
-	// [5]: hyb_autoinc_mode=1 to map the magnetometer registers to follow the accelerometer registers
-	// [4]: m_maxmin_dis=0 to retain default min/max latching even though not used
-	// [3]: m_maxmin_dis_ths=0
-	// [2]: m_maxmin_rst=0
-	// [1-0]: m_rst_cnt=00 to enable magnetic reset each cycle
-	databyte = 0x20;
-	finish = false;
-	i2c_com.register_address = FXOS8700CQ_M_CTRL_REG2;
-	i2cWriteMsg(&i2c_com);
-	while (finish == false)
+	if(AccelMagn_writeRegs(regs, values, count) != I2C_OK)
 	{
-		if(i2c_com.fault != I2C_NO_FAULT)
-		{
-			//Led_Toggle(LED_RED);
-			return (I2C_ERROR);
-		}
+		return (I2C_ERROR);
 	}
+	shadow_valid = true;
+	return (I2C_OK);
+}
 
 
-	// write 0000 0001= 0x01 to XYZ_DATA_CFG register
-	// [7]: reserved
-	// [6]: reserved
-	// [5]: reserved
-	// [4]: hpf_out=0
-	// [3]: reserved
-	// [2]: reserved
-	// [1-0]: fs=01 for accelerometer range of +/-4g range with 0.488mg/LSB
-	databyte = 0x01;
-	finish = false;
-	i2c_com.register_address = FXOS8700CQ_XYZ_DATA_CFG;
-	i2cWriteMsg(&i2c_com);
-	while (finish == false)
+uint8_t AccelMagn_getRange(void)
+{
+	return 2 << (shadow[SH_XYZ_DATA_CFG] & FXOS8700CQ_FS_MASK);
+}
+
+
+I2C_STATUS AccelMagn_startBatch(uint8_t watermark, SRAWDATA * samples, batchcallbackp callback)
+{
+	uint8_t cfg_data[FXOS8700CQ_CFG_WRITES];
+	static const uint8_t cfg_regs[FXOS8700CQ_CFG_WRITES] = {FXOS8700CQ_CTRL_REG1, FXOS8700CQ_M_CTRL_REG1,
+			FXOS8700CQ_M_CTRL_REG2, FXOS8700CQ_F_SETUP, FXOS8700CQ_CTRL_REG4, FXOS8700CQ_CTRL_REG5,
+			FXOS8700CQ_CTRL_REG1};
+
+	if(watermark == 0 || watermark > ACCELMAGN_FIFO_LEN || samples == NULL || callback == NULL)
 	{
-		if(i2c_com.fault != I2C_NO_FAULT)
-		{
-			//Led_Toggle(LED_RED);
-			return (I2C_ERROR);
-		}
+		return (I2C_ERROR);
 	}
 
+	AccelMagn_disableDataReady(); // INT1 pasa a ser la interrupcion de la FIFO
+	while(reading);
 
-	// write 0000 1101 = 0x0D to accelerometer control register 1
-	// [7-6]: aslp_rate=00
-	// [5-3]: dr=001 for 200Hz data rate (when in hybrid mode)
-	// [2]: lnoise=1 for low noise mode
-	// [1]: f_read=0 for normal 16 bit reads
-	// [0]: active=1 to take the part out of standby and enable sampling
-	databyte = 0x0D;
-	finish = false;
+	// standby
+	cfg_data[0] = 0x00;
+
+	// [1-0]: m_hms=00: accelerometer only, the FIFO doesn't store magnetometer data
+	cfg_data[1] = 0x00;
 
-	i2c_com.register_address = FXOS8700CQ_CTRL_REG1;
+	// [5]: hyb_autoinc_mode=0 so a burst read wraps from OUT_Z_LSB back to OUT_X_MSB
+	cfg_data[2] = 0x00;
 
-	i2cWriteMsg(&i2c_com);
+	// write F_SETUP
+	// [7-6]: f_mode=01 circular buffer, the oldest sample is dropped on overflow
+	// [5-0]: f_wmrk=watermark
+	cfg_data[3] = 0x40 | watermark;
 
-	while (finish == false)
+	// [6]: int_en_fifo=1 FIFO interrupt enabled, data-ready disabled
+	cfg_data[4] = 0x40;
+
+	// [6]: int_cfg_fifo=1 FIFO interrupt routed to INT1
+	cfg_data[5] = 0x40;
+
+	// [5-3]: dr=001 for 400Hz data rate (accelerometer only), lnoise=1, active=1
+	cfg_data[6] = 0x0D;
+
+	if(AccelMagn_writeRegs(cfg_regs, cfg_data, FXOS8700CQ_CFG_WRITES) != I2C_OK)
 	{
-		if(i2c_com.fault != I2C_NO_FAULT)
-		{
-			//Led_Toggle(LED_RED);
-			return (I2C_ERROR);
-		}
+		return (I2C_ERROR);
 	}
-	// normal return
+
+	batch_watermark = watermark;
+	batch_samples = samples;
+	batch_callback = callback;
+
+	gpioMode(ACCEL_INT1, INPUT_PULLUP);
+	gpioIRQ(ACCEL_INT1, GPIO_IRQ_MODE_FALLING_EDGE, AccelMagn_fifoReady);
+	if(gpioRead(ACCEL_INT1) == LOW)
+	{
+		AccelMagn_fifoReady(); // La marca ya estaba superada: no va a haber flanco
+	}
+
 	return (I2C_OK);
 }
 
@@ -182,14 +273,25 @@ I2C_STATUS _mqx_ints_FXOS8700CQ_start(void)
 
 void AccelMagn_getData(read_data * data)
 {
-	// read FXOS8700CQ_READ_LEN=13 bytes (status byte and the six channels of data)
+	// read FXOS8700CQ_READ_LEN=13 bytes (status byte and the six channels of data),
+	// or FXOS8700CQ_ACCEL_READ_LEN=7 when the magnetometer is off
+
+	if(reading)
+	{
+		missed_samples++; // La lectura anterior sigue en curso y comparte i2c_com
+		return;
+	}
+	reading = true;
 
 	r_data = data;
 	i2c_com.callback = AccelMagn_readSensors;
 	i2c_com.data = Buffer;
-	i2c_com.data_size = FXOS8700CQ_READ_LEN;
+	// Sin magnetometro sus registros no tienen nada nuevo: solo se lee el acelerometro
+	i2c_com.data_size = (shadow_valid && !(shadow[SH_M_CTRL_REG1] & FXOS8700CQ_M_HMS_MASK)) ?
+			FXOS8700CQ_ACCEL_READ_LEN : FXOS8700CQ_READ_LEN;
 	i2c_com.register_address = FXOS8700CQ_STATUS;
 	i2c_com.slave_address =FXOS8700CQ_SLAVE_ADDR;
+	i2c_com.channel = FXOS8700CQ_I2C_CH;
 
 	i2cReadMsg(&i2c_com);
 
@@ -197,6 +299,63 @@ void AccelMagn_getData(read_data * data)
 	return;
 }
 
+
+bool AccelMagn_enableDataReady(read_data * data)
+{
+	// DWT->CYCCNT como base de tiempo para el histograma
+	CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+	DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+
+	drdy_data = data;
+	gpioMode(ACCEL_INT1, INPUT_PULLUP);
+	if(!gpioIRQ(ACCEL_INT1, GPIO_IRQ_MODE_FALLING_EDGE, AccelMagn_dataReady))
+	{
+		drdy_data = NULL;
+		return false;
+	}
+
+	if(gpioRead(ACCEL_INT1) == LOW)
+	{
+		AccelMagn_dataReady(); // Ya habia una muestra esperando: no va a haber flanco
+	}
+	return true;
+}
+
+
+void AccelMagn_disableDataReady(void)
+{
+	gpioIRQ(ACCEL_INT1, GPIO_IRQ_MODE_DISABLE, NULL);
+	drdy_data = NULL;
+	batch_callback = NULL;
+}
+
+
+void AccelMagn_getLatencyHistogram(uint32_t * hist, uint32_t * missed)
+{
+	uint8_t i;
+
+	for(i = 0; i < ACCELMAGN_HIST_BINS; i++)
+	{
+		hist[i] = latency_hist[i];
+	}
+	if(missed != NULL)
+	{
+		*missed = missed_samples;
+	}
+}
+
+
+void AccelMagn_resetLatencyHistogram(void)
+{
+	uint8_t i;
+
+	for(i = 0; i < ACCELMAGN_HIST_BINS; i++)
+	{
+		latency_hist[i] = 0;
+	}
+	missed_samples = 0;
+}
+
 /*******************************************************************************
                         LOCAL SCOPE FUNCTION DEFINITIONS
  *******************************************************************************/
@@ -214,16 +373,28 @@ reading of all accelerometer and magnetometer data in a single-burst, read opera
 void AccelMagn_readSensors(SRAWDATA *pAccelData, SRAWDATA *pMagnData)
 {
 	// read FXOS8700CQ_READ_LEN=13 bytes (status byte and the six channels of data)
+	reading = false;
+
+	if(drdy_stamped)
+	{
+		uint32_t bin = (DWT->CYCCNT - drdy_cycles) / (CYCLES_PER_US * ACCELMAGN_HIST_BIN_US);
+		latency_hist[(bin < ACCELMAGN_HIST_BINS) ? bin : (ACCELMAGN_HIST_BINS - 1)]++;
+		drdy_stamped = false;
+	}
+
 	if(i2c_com.fault == I2C_NO_FAULT)
 	{
 		// copy the 14 bit accelerometer byte data into 16 bit words
 		r_data->pAccelData->x = (int16_t)(((Buffer[1] << 8) | Buffer[2]))>> 2;
 		r_data->pAccelData->y = (int16_t)(((Buffer[3] << 8) | Buffer[4]))>> 2;
 		r_data->pAccelData->z = (int16_t)(((Buffer[5] << 8) | Buffer[6]))>> 2;
-		// copy the magnetometer byte data into 16 bit words
-		r_data->pMagnData->x = (Buffer[7] << 8) | Buffer[8];
-		r_data->pMagnData->y = (Buffer[9] << 8) | Buffer[10];
-		r_data->pMagnData->z = (Buffer[11] << 8) | Buffer[12];
+		// copy the magnetometer byte data into 16 bit words. Accelerometer only profiles leave it untouched
+		if(i2c_com.data_size == FXOS8700CQ_READ_LEN)
+		{
+			r_data->pMagnData->x = (Buffer[7] << 8) | Buffer[8];
+			r_data->pMagnData->y = (Buffer[9] << 8) | Buffer[10];
+			r_data->pMagnData->z = (Buffer[11] << 8) | Buffer[12];
+		}
 
 		r_data->error = I2C_OK;
 		r_data->callback();
@@ -232,6 +403,12 @@ void AccelMagn_readSensors(SRAWDATA *pAccelData, SRAWDATA *pMagnData)
 	{
 		r_data->error = I2C_ERROR;
 	}
+
+	// INT1 sigue en bajo si llego otra muestra mientras leia: sin flanco nuevo hay que leerla ya
+	if(drdy_data != NULL && gpioRead(ACCEL_INT1) == LOW)
+	{
+		AccelMagn_dataReady();
+	}
 }
 
 void callback_init (void)
@@ -240,5 +417,142 @@ void callback_init (void)
 }
 
 
+// Encola las escrituras como un solo grupo y espera a que termine el ultimo
+static I2C_STATUS AccelMagn_writeRegs (const uint8_t * regs, const uint8_t * values, uint8_t count)
+{
+	static uint8_t cfg_data[FXOS8700CQ_MAX_WRITES];
+	static I2C_COM_CONTROL cfg[FXOS8700CQ_MAX_WRITES];
+	uint8_t i;
+
+	if(count == 0 || count > FXOS8700CQ_MAX_WRITES)
+	{
+		return (I2C_ERROR);
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		cfg_data[i] = values[i];
+		cfg[i].data = &cfg_data[i];
+		cfg[i].data_size = 1;
+		cfg[i].slave_address = FXOS8700CQ_SLAVE_ADDR;
+		cfg[i].register_address = regs[i];
+		cfg[i].mode = I2C_MODE_WRITE;
+		cfg[i].channel = FXOS8700CQ_I2C_CH;
+		cfg[i].callback = NULL;
+	}
+	cfg[count-1].callback = callback_init; // Solo interesa el final del grupo
+
+	finish = false;
+	if(i2cSubmit(cfg, count) != I2C_NO_FAULT)
+	{
+		return (I2C_ERROR);
+	}
+	while (finish == false);
+
+	for(i = 0; i < count; i++)
+	{
+		if(cfg[i].fault != I2C_NO_FAULT)
+		{
+			//Led_Toggle(LED_RED);
+			shadow_valid = false; // No se sabe que quedo escrito
+			return (I2C_ERROR);
+		}
+	}
+
+	for(i = 0; i < count; i++)
+	{
+		shadow_update(regs[i], values[i]);
+	}
+
+	// normal return
+	return (I2C_OK);
+}
+
+
+static void shadow_update (uint8_t reg, uint8_t value)
+{
+	uint8_t i;
+
+	for(i = 0; i < SHADOW_CANT; i++)
+	{
+		if(shadow_regs[i] == reg)
+		{
+			shadow[i] = value;
+		}
+	}
+}
+
+
+static void AccelMagn_fifoReady (void)
+{
+	if(reading)
+	{
+		return; // Al terminar la lectura en curso se revisa INT1
+	}
+	reading = true;
+
+	i2c_com.callback = AccelMagn_readBatch;
+	i2c_com.data = batch_buffer;
+	i2c_com.data_size = FXOS8700CQ_BATCH_LEN(batch_watermark);
+	i2c_com.register_address = FXOS8700CQ_STATUS;
+	i2c_com.slave_address = FXOS8700CQ_SLAVE_ADDR;
+	i2c_com.channel = FXOS8700CQ_I2C_CH;
+
+	i2cReadMsg(&i2c_com);
+}
+
+
+// F_STATUS y despues watermark muestras de 6 bytes en una sola rafaga
+static void AccelMagn_readBatch (void)
+{
+	const uint8_t * sample = &batch_buffer[1];
+	uint8_t i;
+
+	reading = false;
+	if(batch_callback == NULL)
+	{
+		return;
+	}
+
+	if(i2c_com.fault == I2C_NO_FAULT)
+	{
+		if(batch_buffer[0] & FXOS8700CQ_F_OVF_MASK)
+		{
+			missed_samples++; // La FIFO se lleno y piso muestras
+		}
+		for(i = 0; i < batch_watermark; i++, sample += FXOS8700CQ_SAMPLE_LEN)
+		{
+			// copy the 14 bit accelerometer byte data into 16 bit words
+			batch_samples[i].x = (int16_t)((sample[0] << 8) | sample[1]) >> 2;
+			batch_samples[i].y = (int16_t)((sample[2] << 8) | sample[3]) >> 2;
+			batch_samples[i].z = (int16_t)((sample[4] << 8) | sample[5]) >> 2;
+		}
+		batch_callback(batch_samples, batch_watermark);
+	}
+	else
+	{
+		batch_callback(batch_samples, 0);
+	}
+
+	if(gpioRead(ACCEL_INT1) == LOW)
+	{
+		AccelMagn_fifoReady();
+	}
+}
+
+
+static void AccelMagn_dataReady (void)
+{
+	if(reading)
+	{
+		missed_samples++;
+		return;
+	}
+	drdy_cycles = DWT->CYCCNT;
+	drdy_stamped = true;
+	AccelMagn_getData(drdy_data);
+}
+
+
 
 
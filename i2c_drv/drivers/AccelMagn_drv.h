@@ -6,9 +6,16 @@
 
 #include <hardware.h>
 #include <stdint.h>
+#include <stdbool.h>
 
 // the actual I2C address may be 0x1C, 0x1D, 0x1E or 0x1F
 
+// histograma de latencia entre el flanco de data-ready y el fin de la lectura
+#define ACCELMAGN_HIST_BINS		16
+#define ACCELMAGN_HIST_BIN_US	100 // el ultimo bin acumula todo lo que supera 1.5 ms
+
+#define ACCELMAGN_FIFO_LEN		32 // muestras de la FIFO del acelerometro
+
 /*******************************************************************************
  * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
  ******************************************************************************/
@@ -21,8 +28,19 @@ typedef struct
 
 typedef enum {I2C_ERROR, I2C_OK} I2C_STATUS;
 
+typedef enum
+{
+	ACCEL_PROFILE_LOW_POWER,	// 12.5 Hz, solo acelerometro, +/-4g
+	ACCEL_PROFILE_BALANCED,		// 200 Hz hibrido, +/-4g (el de _mqx_ints_FXOS8700CQ_start)
+	ACCEL_PROFILE_HIGH_RATE,	// 800 Hz, solo acelerometro, +/-8g
+	ACCEL_CANT_PROFILES
+} ACCEL_PROFILE;
+
 typedef void (*callbackp)(void);
 
+// count = 0 si la lectura fallo
+typedef void (*batchcallbackp)(const SRAWDATA * samples, uint8_t count);
+
 typedef struct {
 	SRAWDATA * pMagnData;
 	SRAWDATA * pAccelData;
@@ -37,8 +55,30 @@ typedef struct {
 
 I2C_STATUS _mqx_ints_FXOS8700CQ_start(void);
 //I2C_STATUS AccelMagn_init(void);
+// En los perfiles solo acelerometro no se lee el magnetometro y pMagnData queda como estaba
 void AccelMagn_getData(read_data * data);
 
+// Cambia de perfil escribiendo solo los registros que difieren, en una sola cola de escrituras.
+// Bloqueante hasta que termina la ultima escritura: no llamar desde una interrupcion
+I2C_STATUS AccelMagn_configure(ACCEL_PROFILE profile);
+
+// Rango actual del acelerometro en g (2, 4 u 8)
+uint8_t AccelMagn_getRange(void);
+
+// Lee automaticamente cada muestra nueva usando la linea INT1 (data-ready) del sensor.
+// data->callback se llama al terminar cada lectura. Devuelve false si no se pudo configurar la interrupcion
+bool AccelMagn_enableDataReady(read_data * data);
+void AccelMagn_disableDataReady(void); // tambien detiene el modo batch
+
+// Pone el acelerometro en modo FIFO a 400 Hz (sin magnetometro) con marca de agua en watermark muestras.
+// En cada interrupcion de la FIFO lee las watermark muestras en una sola rafaga y llama a callback con samples,
+// que tiene que tener lugar para watermark elementos. Bloqueante mientras configura el sensor
+I2C_STATUS AccelMagn_startBatch(uint8_t watermark, SRAWDATA * samples, batchcallbackp callback);
+
+// Copia ACCELMAGN_HIST_BINS contadores de latencia y la cantidad de muestras perdidas (missed puede ser NULL)
+void AccelMagn_getLatencyHistogram(uint32_t * hist, uint32_t * missed);
+void AccelMagn_resetLatencyHistogram(void);
+
 
 
 #endif /* ACCELMAGN_H_ */
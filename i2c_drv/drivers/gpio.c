@@ -2,6 +2,7 @@
 
 static GPIO_Type* gpioPtrs[] = GPIO_BASE_PTRS;
 static PORT_Type* portPtrs[] = PORT_BASE_PTRS;
+static const IRQn_Type portIrqs[] = {PORTA_IRQn, PORTB_IRQn, PORTC_IRQn, PORTD_IRQn, PORTE_IRQn};
 static uint32_t simMasks[] = {SIM_SCGC5_PORTA_MASK, SIM_SCGC5_PORTB_MASK, SIM_SCGC5_PORTC_MASK, SIM_SCGC5_PORTD_MASK, SIM_SCGC5_PORTE_MASK };
 static SIM_Type* sim_ptr = SIM;
 static pinIrqFun_t isr_Matrix [PORTS_CNT][PINS_CNT];
@@ -165,12 +166,29 @@ void gpioEnableInterrupts(pin_t pin){
 
 bool gpioIRQ(pin_t pin, uint8_t irqMode, pinIrqFun_t irqFun){
 
-	PORT_Type *port = portPtrs[PIN2PORT(pin)];
+	uint32_t port_name = PIN2PORT(pin);
+	PORT_Type *port = portPtrs[port_name];
+
+	if(irqMode >= GPIO_IRQ_CANT_MODES || (irqFun == NULL && irqMode != GPIO_IRQ_MODE_DISABLE))
+	{
+		return false;
+	}
+
+	if(irqMode == GPIO_IRQ_MODE_DISABLE)
+	{
+		// IRQC 0 apaga la interrupcion del pin (8 seria interrupcion por nivel bajo)
+		port->PCR[PIN2NUM(pin)] &= ~PORT_PCR_IRQC_MASK;
+		PORT_ClearInterruptFlag(pin);
+		isr_Matrix[port_name][PIN2NUM(pin)] = irqFun;
+		return true;
+	}
+
+	isr_Matrix[port_name][PIN2NUM(pin)] = irqFun; // Antes de habilitar, por si ya hay un flanco pendiente
 	port->PCR[PIN2NUM(pin)] &= ~PORT_PCR_IRQC_MASK;
-	port->PCR[PIN2NUM(pin)] |= PORT_PCR_IRQC(irqMode+8);
-	isr_Matrix[PIN2PORT(pin)][PIN2NUM(pin)] = irqFun;
+	port->PCR[PIN2NUM(pin)] |= PORT_PCR_IRQC(irqMode+8); // 9 flanco ascendente, 10 descendente, 11 ambos
+	NVIC_EnableIRQ(portIrqs[port_name]);
 
-	return true;
+	return NVIC_GetEnableIRQ(portIrqs[port_name]) != 0;
 }
 
 
@@ -7,6 +7,7 @@
 #include "board.h"
 #include "uart.h"
 #include "MK64F12.h"
+#include "hardware.h"
 
 /*******************************************************************************
  * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
@@ -27,29 +28,101 @@
 #define I2C_CHECK_BUS		  	 (i2c->S & I2C_S_BUSY_MASK)
 #define I2C_GET_TCF				 (i2c->S & I2C_S_TCF_MASK)
 
-#define BUS_BUSY 				 1
-#define TIMEOUT					 100
+#define I2C_CLOCK				 (__CORE_CLOCK__ >> 1) // Los I2C cuelgan del bus clock
+#define I2C_ICR_CANT			 64
+#define I2C_MULT_CANT			 3
+
+#define I2C_DMA_BUS				 I2C_0 // I2C1 e I2C2 comparten el request 19 del DMAMUX: siguen por interrupcion
+#define I2C_DMA_CHANNEL			 12 // Los canales 0 a 9 los usa la UART
+#define I2C_DMA_SOURCE			 18 // Request de I2C0 en el DMAMUX
+
+#define I2C_PIT_CHANNEL(ch)		 (1 + (ch)) // Un canal de PIT por bus para los timeouts
+#define PIT_TICKS_PER_US		 (I2C_CLOCK / 1000000U) // El PIT tambien cuenta con el bus clock
+#define I2C_RECOVERY_HALF_US	 5 // Medio periodo de SCL durante la recuperacion (100 kHz)
+#define I2C_RECOVERY_PULSES		 9
+#define I2C_RECOVERY_STEPS		 (2 * I2C_RECOVERY_PULSES + 3) // Flancos de SCL y el STOP, cada uno seguido de medio periodo
+#define I2C_BUS_POLL_US			 10 // Cada cuanto se mira si ya salio el STOP anterior
 
 /*******************************************************************************
  * VARIABLE PROTOTYPES WITH GLOBAL SCOPE
  ******************************************************************************/
 
 
-static I2C_Type* i2cPtrs [] = I2C_BASE_PTRS;
-static uint32_t simMasks[] = {SIM_SCGC4_I2C0_MASK, SIM_SCGC4_I2C1_MASK, SIM_SCGC1_I2C2_MASK};
-static IRQn_Type i2c_irqs[] = I2C_IRQS;
-static I2C_Type* i2c;
+typedef struct
+{
+	I2C_Type * i2c;
+	I2C_ChannelType ch;
 
-static I2C_COM_CONTROL * i2c_com;
+	I2C_COM_CONTROL * i2c_com; // Transaccion en curso
 
-static I2C_ChannelType ch;
-static uint8_t device_address_r;
-static uint8_t device_address_w;
-static I2C_STAGE stage;
-static I2C_MODE mode;
-static uint8_t data_index;
+	// Cola circular de transacciones. La primera es la que esta en curso
+	I2C_COM_CONTROL * queue[I2C_QUEUE_LEN];
+	uint8_t queue_group[I2C_QUEUE_LEN];
+	uint8_t queue_front, queue_count;
+	uint8_t next_group;
 
-static void finish_com (I2C_FAULT fault);
+	uint8_t device_address_r;
+	uint8_t device_address_w;
+	I2C_STAGE stage;
+	I2C_MODE mode;
+	uint8_t data_index;
+
+	uint32_t wait_ticks; // Consultas de BUSY que quedan antes de dar el bus por ocupado
+	uint8_t recover_step;
+	bool recovered; // Se recupero el bus y todavia no salio un START: no se vuelve a intentar
+
+	uint32_t timeout_us;
+	I2C_FAULT_COUNTERS counters;
+} I2C_HANDLE;
+
+
+static I2C_Type* i2cPtrs [] = I2C_BASE_PTRS;
+static uint32_t simMasks[] = {SIM_SCGC4_I2C0_MASK, SIM_SCGC4_I2C1_MASK, SIM_SCGC1_I2C2_MASK};
+static IRQn_Type i2c_irqs[] = I2C_IRQS;
+static const uint8_t sdaPins[] = {I2C_SDA, I2C1_SDA, I2C2_SDA};
+static const uint8_t sclPins[] = {I2C_SCL, I2C1_SCL, I2C2_SCL};
+static const uint8_t pinMux[] = {5, 2, 5}; // Alternativa I2C de cada par de pines
+static const IRQn_Type pitIrqs[] = {PIT1_IRQn, PIT2_IRQn, PIT3_IRQn};
+
+// Divisor de SCL para cada valor de ICR (tabla "I2C divider and hold values" del manual)
+static const uint16_t sclDividers[I2C_ICR_CANT] = {
+	20,   22,   24,   26,   28,   30,   34,   40,   28,   32,   36,   40,   44,   48,   56,   68,
+	48,   56,   64,   72,   80,   88,   104,  128,  80,   96,   112,  128,  144,  160,  192,  240,
+	160,  192,  224,  256,  288,  320,  384,  480,  320,  384,  448,  512,  576,  640,  768,  960,
+	640,  768,  896,  1024, 1152, 1280, 1536, 1920, 1280, 1536, 1792, 2048, 2304, 2560, 3072, 3840
+};
+
+static I2C_HANDLE handles[I2C_CANT_IDS];
+
+static void irq_handler (I2C_HANDLE * h);
+static void finish_com (I2C_HANDLE * h, I2C_FAULT fault);
+static void start_com (I2C_HANDLE * h, bool repeated);
+static void send_start (I2C_HANDLE * h);
+static void bus_wait_tick (I2C_HANDLE * h);
+static void queue_pop (I2C_HANDLE * h);
+static void pit_start (I2C_HANDLE * h, uint32_t us, bool irq);
+static void timeout_start (I2C_HANDLE * h, bool irq);
+static void timeout_stop (I2C_HANDLE * h);
+static bool timeout_expired (I2C_HANDLE * h);
+static void timeout_irq_handler (I2C_HANDLE * h);
+static void delay_us (I2C_HANDLE * h, uint32_t us);
+static bool sda_stuck (I2C_HANDLE * h);
+static void recover_begin (I2C_HANDLE * h);
+static void recover_step (I2C_HANDLE * h, uint8_t step);
+static bool recover_end (I2C_HANDLE * h);
+static void recover_start (I2C_HANDLE * h);
+static void recover_tick (I2C_HANDLE * h);
+static void count_fault (I2C_HANDLE * h, I2C_FAULT fault);
+static bool blocking_claim (I2C_HANDLE * h);
+static void blocking_release (I2C_HANDLE * h);
+static I2C_FAULT blocking_start (I2C_HANDLE * h, uint8_t address);
+static I2C_FAULT blocking_write (I2C_HANDLE * h, uint8_t data);
+static I2C_FAULT blocking_wait (I2C_HANDLE * h);
+static I2C_FAULT blocking_end (I2C_HANDLE * h, I2C_FAULT fault);
+#if I2C_READ_DMA
+static void dma_start_read (I2C_HANDLE * h);
+static void dma_irq_handler (I2C_HANDLE * h);
+#endif
 
 /*******************************************************************************
  * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
@@ -58,24 +131,43 @@ static void finish_com (I2C_FAULT fault);
 
 void I2C0_IRQHandler(void)
 {
+	irq_handler(&handles[I2C_0]);
+}
+
+
+void I2C1_IRQHandler(void)
+{
+	irq_handler(&handles[I2C_1]);
+}
+
+
+void I2C2_IRQHandler(void)
+{
+	irq_handler(&handles[I2C_2]);
+}
+
+
+static void irq_handler (I2C_HANDLE * h)
+{
+	I2C_Type * i2c = h->i2c;
 	I2C_CLEAR_IRQ_FLAG;
 	uint8_t dummy_data;
-	switch(mode)
+	switch(h->mode)
 	{
 		case(I2C_MODE_READ):
 		{
-			switch(stage)
+			switch(h->stage)
 			{
 				case I2C_STAGE_WRITE_REG_ADDRESS:
 				{
 					if(I2C_GET_RX_ACK == 0)// me llego un ACK
 					{
-						stage = I2C_STAGE_WRITE_DEV_ADDRESS_R;
-						I2C_WRITE_BYTE(i2c_com->register_address);
+						h->stage = I2C_STAGE_WRITE_DEV_ADDRESS_R;
+						I2C_WRITE_BYTE(h->i2c_com->register_address);
 					}
 					else
 					{
-						finish_com(I2C_SLAVE_ERROR);
+						finish_com(h, I2C_SLAVE_ERROR);
 					}
 					break;
 				}
@@ -83,14 +175,14 @@ void I2C0_IRQHandler(void)
 				{
 					if(I2C_GET_RX_ACK == 0)// me llego un ACK
 					{
-						stage = I2C_STAGE_READ_DUMMY_DATA;
+						h->stage = I2C_STAGE_READ_DUMMY_DATA;
 						I2C_REPEAT_START_SIGNAL;
-						I2C_WRITE_BYTE(device_address_r);
+						I2C_WRITE_BYTE(h->device_address_r);
 
 					}
 					else
 					{
-						finish_com(I2C_SLAVE_ERROR);
+						finish_com(h, I2C_SLAVE_ERROR);
 					}
 					break;
 				}
@@ -98,34 +190,40 @@ void I2C0_IRQHandler(void)
 				{
 					if(I2C_GET_RX_ACK == 0)// me llego un ACK
 					{
-						stage = I2C_STAGE_READ_DATA;
+						h->stage = I2C_STAGE_READ_DATA;
 						I2C_SET_RX_MODE;
-						if(data_index == i2c_com->data_size-1) //voy a leer mi último dato
+						if(h->data_index == h->i2c_com->data_size-1) //voy a leer mi último dato
 						{
 							I2C_SET_NACK;
 						}
+#if I2C_READ_DMA
+						if(h->ch == I2C_DMA_BUS && h->i2c_com->data_size >= I2C_DMA_MIN_LEN)
+						{
+							dma_start_read(h); // El DMA lee todo menos los 2 ultimos bytes
+						}
+#endif
 						dummy_data = I2C_READ_BYTE;
 					}
 					else
 					{
-						finish_com(I2C_SLAVE_ERROR);
+						finish_com(h, I2C_SLAVE_ERROR);
 					}
 					break;
 				}
 				case I2C_STAGE_READ_DATA:
 				{
-					if(data_index == i2c_com->data_size-1)
+					if(h->data_index == h->i2c_com->data_size-1)
 					{
-						finish_com(I2C_NO_FAULT);
+						finish_com(h, I2C_NO_FAULT);
 					}
 					else
 					{
-						if(data_index == i2c_com->data_size-2) //voy a leer mi último dato
+						if(h->data_index == h->i2c_com->data_size-2) //voy a leer mi último dato
 						{
 							I2C_SET_NACK;
 						}
-					i2c_com->data[data_index] = I2C_READ_BYTE;
-					data_index++;
+					h->i2c_com->data[h->data_index] = I2C_READ_BYTE;
+					h->data_index++;
 
 					}
 					break;
@@ -137,19 +235,19 @@ void I2C0_IRQHandler(void)
 		}
 		case I2C_MODE_WRITE:
 		{
-			switch(stage)
+			switch(h->stage)
 			{
 				case I2C_STAGE_WRITE_REG_ADDRESS:
 				{
 					if(I2C_GET_RX_ACK == 0)// me llego un ACK
 					{
-						I2C_WRITE_BYTE(i2c_com->register_address);
-						stage = I2C_STAGE_WRITE_DATA;
+						I2C_WRITE_BYTE(h->i2c_com->register_address);
+						h->stage = I2C_STAGE_WRITE_DATA;
 
 					}
 					else
 					{
-						finish_com(I2C_SLAVE_ERROR);
+						finish_com(h, I2C_SLAVE_ERROR);
 					}
 					break;
 				}
@@ -157,20 +255,21 @@ void I2C0_IRQHandler(void)
 				{
 					if(I2C_GET_RX_ACK == 0)// me llego un ACK
 					{
-						if(data_index == i2c_com->data_size)
+						if(h->data_index == h->i2c_com->data_size)
 						{
-							finish_com(I2C_NO_FAULT);
+							finish_com(h, I2C_NO_FAULT);
 						}
 						else
 						{
-							I2C_WRITE_BYTE(i2c_com->data[data_index]);
-							data_index++;
+							I2C_WRITE_BYTE(h->i2c_com->data[h->data_index]);
+							h->data_index++;
 						}
 					}
 					else
 					{
-						finish_com(I2C_SLAVE_ERROR);
+						finish_com(h, I2C_SLAVE_ERROR);
 					}
+					break;
 				}
 				default:
 					break;
@@ -182,400 +281,841 @@ void I2C0_IRQHandler(void)
 }
 
 
-void finish_com (I2C_FAULT fault)
+static void finish_com (I2C_HANDLE * h, I2C_FAULT fault)
 {
-	I2C_STOP_SIGNAL;
-	i2c_com->fault = fault;
+	I2C_Type * i2c = h->i2c;
+	I2C_COM_CONTROL * done = h->i2c_com;
+	uint8_t group = h->queue_group[h->queue_front];
+	bool chain, recover = false;
+
+	timeout_stop(h);
+	count_fault(h, fault);
 
-	if ((mode == I2C_MODE_READ) & (fault == I2C_NO_FAULT))
+	done->fault = fault;
+	queue_pop(h);
+
+	// Si fallo, el resto de su grupo no tiene sentido: lo termino sin tocar el bus
+	while(fault != I2C_NO_FAULT && h->queue_count != 0 && h->queue_group[h->queue_front] == group)
+	{
+		h->queue[h->queue_front]->fault = I2C_ABORTED;
+		count_fault(h, I2C_ABORTED);
+		if(h->queue[h->queue_front]->callback != NULL)
+			h->queue[h->queue_front]->callback();
+		queue_pop(h);
+	}
+
+	chain = (fault == I2C_NO_FAULT) && (h->queue_count != 0);
+
+	if (h->mode == I2C_MODE_READ && fault == I2C_NO_FAULT)
 	{
+		if(chain)
+			I2C_SET_TX_MODE; // En TX, leer D no dispara otra recepcion
+		else
+			I2C_STOP_SIGNAL;
+		I2C_CLEAR_NACK;
+		done->data[h->data_index] = I2C_READ_BYTE;
+	}
+	else if(!chain)
+	{
+		I2C_STOP_SIGNAL;
 		I2C_CLEAR_NACK;
-		i2c_com->data[data_index] = I2C_READ_BYTE;
+		recover = (fault == I2C_TIMEOUT && sda_stuck(h)); // Un esclavo quedo a mitad de un byte sosteniendo SDA
 	}
 
-	stage = I2C_STAGE_NONE;
-	i2c_com->callback();
+	h->stage = I2C_STAGE_NONE;
+	if(recover)
+		recover_start(h); // Al terminar arranca la siguiente, si hay
+	else if(h->queue_count != 0)
+		start_com(h, chain); // La siguiente arranca antes del callback para no dejar el bus quieto
+
+	if(done->callback != NULL)
+		done->callback();
 
 }
 
 
+static void start_com (I2C_HANDLE * h, bool repeated)
+{
+	I2C_Type * i2c = h->i2c;
+	h->i2c_com = h->queue[h->queue_front];
 
-/*******************************************************************************
- *******************************************************************************
-                        GLOBAL FUNCTION DEFINITIONS
- *******************************************************************************
- ******************************************************************************/
+	h->device_address_r = (h->i2c_com->slave_address << 1) | 0b00000001;
+	h->device_address_w = (h->i2c_com->slave_address << 1) & 0b11111110;
+	h->data_index = 0;
 
+	h->i2c_com->fault = I2C_NO_FAULT;
 
+	h->mode = h->i2c_com->mode;
 
+	if(repeated)
+	{
+		h->stage =  I2C_STAGE_WRITE_REG_ADDRESS;
+		i2c->C1 |= I2C_C1_TX_MASK; // Transmit Mode Select (TRANSMIT)
+		I2C_REPEAT_START_SIGNAL;
+		I2C_WRITE_BYTE(h->device_address_w);
+		timeout_start(h, true);
+	}
+	else if(I2C_CHECK_BUS)
+	{
+		// Todavia sale el STOP anterior. Puede ser la ISR: no se espera aca, lo consulta el PIT
+		h->stage = I2C_STAGE_WAIT_BUS;
+		h->wait_ticks = h->timeout_us / I2C_BUS_POLL_US + 1;
+		pit_start(h, I2C_BUS_POLL_US, true);
+	}
+	else
+	{
+		send_start(h);
+	}
+}
 
-void i2cInit (I2C_ChannelType channel)
+
+static void send_start (I2C_HANDLE * h)
 {
-	SIM_Type* sim_ptr = SIM;
-	PORT_Type * portsPtrs [] = PORT_BASE_PTRS;
-	i2c = i2cPtrs[channel];
-	ch = channel;
+	I2C_Type * i2c = h->i2c;
 
-	PORT_Type * port_SDA = portsPtrs[PIN2PORT(I2C_SDA)];
-	uint32_t pin_SDA = PIN2NUM(I2C_SDA);
+	h->stage =  I2C_STAGE_WRITE_REG_ADDRESS;
+	h->recovered = false;
+	i2c->C1 |= I2C_C1_TX_MASK; // Transmit Mode Select (TRANSMIT)
+	i2c->C1 |= I2C_C1_MST_MASK; // Master Mode Select (MASTER) //START signal
+	I2C_WRITE_BYTE(h->device_address_w);
 
-	PORT_Type * port_SCL = portsPtrs[PIN2PORT(I2C_SCL)];
-	uint32_t pin_SCL = PIN2NUM(I2C_SCL);
+	timeout_start(h, true);
+}
 
-	sim_ptr->SCGC5 |= SIM_SCGC5_PORTE_MASK;
 
-	if (channel == I2C_2)
+// Tick del PIT mientras se espera el bus libre
+static void bus_wait_tick (I2C_HANDLE * h)
+{
+	I2C_Type * i2c = h->i2c;
+
+	PIT->CHANNEL[I2C_PIT_CHANNEL(h->ch)].TFLG = PIT_TFLG_TIF_MASK;
+	if(!I2C_CHECK_BUS)
 	{
-		sim_ptr->SCGC1 |= simMasks[channel]; // activo clock gating
+		send_start(h);
 	}
-	else
+	else if(--h->wait_ticks == 0)
 	{
-		sim_ptr->SCGC4 |= simMasks[channel]; // activo clock gating
+		timeout_stop(h);
+		if(sda_stuck(h) && !h->recovered)
+			recover_start(h); // Al terminar vuelve a probar la misma transaccion
+		else
+			finish_com(h, I2C_BUS_BUSY);
 	}
+}
 
 
-	 i2c->C1 = 0x00; // I2C Control Register 1
-	 i2c->C1 |= I2C_C1_IICEN_MASK; // Enables I2C module operation.
-	 i2c->C1 |= I2C_C1_IICIE_MASK; // Enables I2C interrupt requests.
-	 i2c->S = I2C_S_TCF_MASK | I2C_S_IICIF_MASK;
+static void queue_pop (I2C_HANDLE * h)
+{
+	h->queue_front = (h->queue_front + 1) % I2C_QUEUE_LEN;
+	h->queue_count--;
+}
 
 
-	 // I2C Frequency Divider register
+static void pit_start (I2C_HANDLE * h, uint32_t us, bool irq)
+{
+	uint8_t pit_ch = I2C_PIT_CHANNEL(h->ch);
 
-	 //I2C baud rate = I2C module clock speed (Hz)/(mul × SCL divider)
-	 i2c->F = I2C_F_MULT(0) | I2C_F_ICR(0); //  set the I2C baud rate
+	PIT->CHANNEL[pit_ch].TCTRL = 0;
+	PIT->CHANNEL[pit_ch].TFLG = PIT_TFLG_TIF_MASK;
+	PIT->CHANNEL[pit_ch].LDVAL = us * PIT_TICKS_PER_US - 1;
+	PIT->CHANNEL[pit_ch].TCTRL = PIT_TCTRL_TEN_MASK | (irq ? PIT_TCTRL_TIE_MASK : 0);
+}
 
-	 NVIC_EnableIRQ(i2c_irqs[channel]);
+
+static void timeout_start (I2C_HANDLE * h, bool irq)
+{
+	pit_start(h, h->timeout_us, irq);
+}
 
 
-	 port_SDA->PCR[pin_SDA] |= PORT_PCR_MUX(5); // cambia los pines a alternativa i2c
-	 port_SDA->PCR[pin_SDA] |= PORT_PCR_ODE_MASK;
-	 port_SCL->PCR[pin_SCL] |= PORT_PCR_MUX(5);
-	 port_SCL->PCR[pin_SCL] |= PORT_PCR_ODE_MASK;
+static void timeout_stop (I2C_HANDLE * h)
+{
+	uint8_t pit_ch = I2C_PIT_CHANNEL(h->ch);
+
+	PIT->CHANNEL[pit_ch].TCTRL = 0;
+	PIT->CHANNEL[pit_ch].TFLG = PIT_TFLG_TIF_MASK;
 }
 
 
-void i2cReadMsg(I2C_COM_CONTROL * i2c_comm)
+static bool timeout_expired (I2C_HANDLE * h)
 {
+	return PIT->CHANNEL[I2C_PIT_CHANNEL(h->ch)].TFLG & PIT_TFLG_TIF_MASK;
+}
+
 
+static void timeout_irq_handler (I2C_HANDLE * h)
+{
+	I2C_Type * i2c = h->i2c;
 
-	if(I2C_CHECK_BUS != BUS_BUSY)
+	if(h->stage == I2C_STAGE_WAIT_BUS)
+	{
+		bus_wait_tick(h);
+		return;
+	}
+	if(h->stage == I2C_STAGE_RECOVER)
 	{
-		i2c_com = i2c_comm;
+		recover_tick(h);
+		return;
+	}
+
+	timeout_stop(h);
+	if(h->stage == I2C_STAGE_NONE)
+		return;
 
+#if I2C_READ_DMA
+	if(h->ch == I2C_DMA_BUS)
+	{
+		DMA0->CERQ = DMA_CERQ_CERQ(I2C_DMA_CHANNEL);
+		i2c->C1 &= ~I2C_C1_DMAEN_MASK;
+		i2c->C1 |= I2C_C1_IICIE_MASK;
+	}
+#endif
+	I2C_CLEAR_IRQ_FLAG;
 
-		device_address_r = (i2c_com->slave_address << 1) | 0b00000001;
-		device_address_w = (i2c_com->slave_address << 1) & 0b11111110;
-		data_index = 0;
+	finish_com(h, I2C_TIMEOUT);
+}
 
-		i2c_com->fault = I2C_NO_FAULT;
 
+__ISR__ PIT1_IRQHandler (void)
+{
+	timeout_irq_handler(&handles[I2C_0]);
+}
 
-		 stage =  I2C_STAGE_WRITE_REG_ADDRESS;
-		 mode =  I2C_MODE_READ;
+__ISR__ PIT2_IRQHandler (void)
+{
+	timeout_irq_handler(&handles[I2C_1]);
+}
 
+__ISR__ PIT3_IRQHandler (void)
+{
+	timeout_irq_handler(&handles[I2C_2]);
+}
 
-		 i2c->C1 |= I2C_C1_TX_MASK; // Transmit Mode Select (TRANSMIT)
-		 i2c->C1 |= I2C_C1_MST_MASK; // Master Mode Select (MASTER)
-		 I2C_WRITE_BYTE(device_address_w);
 
+// Espera activa medida con el canal de PIT del bus. Lo deja apagado al salir
+static void delay_us (I2C_HANDLE * h, uint32_t us)
+{
+	pit_start(h, us, false);
+	while(!timeout_expired(h));
+	timeout_stop(h);
+}
+
+
+static bool sda_stuck (I2C_HANDLE * h)
+{
+	GPIO_Type * gpioPtrs [] = GPIO_BASE_PTRS;
+	uint8_t sda = sdaPins[h->ch];
+
+	return !(gpioPtrs[PIN2PORT(sda)]->PDIR & (1U << PIN2NUM(sda))); // PDIR lee el pin aunque este en modo I2C
+}
+
+
+/*
+ * Recuperacion del bus: 9 clocks para que el esclavo termine el byte que tenia a medias y
+ * suelte SDA, y un STOP. Cada paso va seguido de medio periodo de SCL. i2cBusRecover los hace
+ * seguidos con delay_us; desde una interrupcion los va haciendo el PIT (recover_start)
+ */
+static void recover_begin (I2C_HANDLE * h)
+{
+	PORT_Type * portsPtrs [] = PORT_BASE_PTRS;
+	GPIO_Type * gpioPtrs [] = GPIO_BASE_PTRS;
+	uint8_t sda = sdaPins[h->ch];
+	uint8_t scl = sclPins[h->ch];
+	PORT_Type * port_SDA = portsPtrs[PIN2PORT(sda)];
+	PORT_Type * port_SCL = portsPtrs[PIN2PORT(scl)];
+	GPIO_Type * gpio_SDA = gpioPtrs[PIN2PORT(sda)];
+	GPIO_Type * gpio_SCL = gpioPtrs[PIN2PORT(scl)];
+	uint32_t sda_mask = 1U << PIN2NUM(sda);
+	uint32_t scl_mask = 1U << PIN2NUM(scl);
+
+	h->i2c->C1 &= ~I2C_C1_IICEN_MASK;
+
+	// Los pines pasan a GPIO open drain (ODE ya esta activo) con las lineas liberadas
+	gpio_SDA->PSOR = sda_mask;
+	gpio_SCL->PSOR = scl_mask;
+	gpio_SDA->PDDR &= ~sda_mask;
+	gpio_SCL->PDDR |= scl_mask;
+	port_SDA->PCR[PIN2NUM(sda)] = (port_SDA->PCR[PIN2NUM(sda)] & ~PORT_PCR_MUX_MASK) | PORT_PCR_MUX(1);
+	port_SCL->PCR[PIN2NUM(scl)] = (port_SCL->PCR[PIN2NUM(scl)] & ~PORT_PCR_MUX_MASK) | PORT_PCR_MUX(1);
+}
+
+
+static void recover_step (I2C_HANDLE * h, uint8_t step)
+{
+	GPIO_Type * gpioPtrs [] = GPIO_BASE_PTRS;
+	GPIO_Type * gpio_SDA = gpioPtrs[PIN2PORT(sdaPins[h->ch])];
+	GPIO_Type * gpio_SCL = gpioPtrs[PIN2PORT(sclPins[h->ch])];
+	uint32_t sda_mask = 1U << PIN2NUM(sdaPins[h->ch]);
+	uint32_t scl_mask = 1U << PIN2NUM(sclPins[h->ch]);
+
+	if(step < 2 * I2C_RECOVERY_PULSES)
+	{
+		if(step % 2 == 0)
+			gpio_SCL->PCOR = scl_mask;
+		else
+			gpio_SCL->PSOR = scl_mask;
+	}
+	else if(step == 2 * I2C_RECOVERY_PULSES)
+	{
+		// STOP: SDA sube mientras SCL esta alto
+		gpio_SCL->PCOR = scl_mask;
+		gpio_SDA->PCOR = sda_mask;
+		gpio_SDA->PDDR |= sda_mask;
+	}
+	else if(step == 2 * I2C_RECOVERY_PULSES + 1)
+	{
+		gpio_SCL->PSOR = scl_mask;
 	}
 	else
 	{
-		i2c_comm->fault = I2C_BUS_BUSY;
-		i2c_comm->callback();
+		gpio_SDA->PSOR = sda_mask;
 	}
+}
 
-	return;
+
+static bool recover_end (I2C_HANDLE * h)
+{
+	PORT_Type * portsPtrs [] = PORT_BASE_PTRS;
+	GPIO_Type * gpioPtrs [] = GPIO_BASE_PTRS;
+	uint8_t sda = sdaPins[h->ch];
+	uint8_t scl = sclPins[h->ch];
+	PORT_Type * port_SDA = portsPtrs[PIN2PORT(sda)];
+	PORT_Type * port_SCL = portsPtrs[PIN2PORT(scl)];
+	GPIO_Type * gpio_SDA = gpioPtrs[PIN2PORT(sda)];
+	GPIO_Type * gpio_SCL = gpioPtrs[PIN2PORT(scl)];
+	uint32_t sda_mask = 1U << PIN2NUM(sda);
+	uint32_t scl_mask = 1U << PIN2NUM(scl);
+	bool released = (gpio_SDA->PDIR & sda_mask) != 0;
+
+	gpio_SDA->PDDR &= ~sda_mask;
+	gpio_SCL->PDDR &= ~scl_mask;
+	port_SDA->PCR[PIN2NUM(sda)] = (port_SDA->PCR[PIN2NUM(sda)] & ~PORT_PCR_MUX_MASK) | PORT_PCR_MUX(pinMux[h->ch]);
+	port_SCL->PCR[PIN2NUM(scl)] = (port_SCL->PCR[PIN2NUM(scl)] & ~PORT_PCR_MUX_MASK) | PORT_PCR_MUX(pinMux[h->ch]);
+
+	h->i2c->C1 |= I2C_C1_IICEN_MASK;
+	h->counters.recoveries++;
+	h->recovered = true;
+
+	return released;
 }
 
 
-void i2cWriteMsg(I2C_COM_CONTROL * i2c_comm)
+static void recover_start (I2C_HANDLE * h)
+{
+	h->stage = I2C_STAGE_RECOVER;
+	h->recover_step = 0;
+	recover_begin(h);
+	pit_start(h, I2C_RECOVERY_HALF_US, true);
+}
+
+
+// Tick del PIT durante la recuperacion. Al terminar sigue la cola, si hay algo
+static void recover_tick (I2C_HANDLE * h)
 {
+	PIT->CHANNEL[I2C_PIT_CHANNEL(h->ch)].TFLG = PIT_TFLG_TIF_MASK;
+	if(h->recover_step < I2C_RECOVERY_STEPS)
+	{
+		recover_step(h, h->recover_step++);
+		return;
+	}
+
+	timeout_stop(h);
+	recover_end(h);
+	h->stage = I2C_STAGE_NONE;
+	if(h->queue_count != 0)
+		start_com(h, false);
+}
+
 
-	if(I2C_CHECK_BUS != BUS_BUSY)
+static void count_fault (I2C_HANDLE * h, I2C_FAULT fault)
+{
+	switch(fault)
 	{
-		i2c_com = i2c_comm;
+		case I2C_BUS_BUSY: 		h->counters.bus_busy++; 	break;
+		case I2C_TIMEOUT: 		h->counters.timeouts++; 	break;
+		case I2C_SLAVE_ERROR: 	h->counters.slave_errors++; break;
+		case I2C_ABORTED: 		h->counters.aborted++; 		break;
+		default: 				break;
+	}
+}
 
-		device_address_r = (i2c_com->slave_address << 1) | 0b00000001;
-		device_address_w = (i2c_com->slave_address << 1) & 0b11111110;
-		data_index = 0;
 
-		i2c_com->fault = I2C_NO_FAULT;
+/*
+ * Pasos de las funciones bloqueantes. Usan el flag IICIF con la interrupcion enmascarada
+ * en el NVIC y el canal de PIT del bus sin interrupcion como timeout de toda la transferencia
+ */
+static bool blocking_claim (I2C_HANDLE * h)
+{
+	NVIC_DisableIRQ(i2c_irqs[h->ch]);
+	NVIC_DisableIRQ(pitIrqs[h->ch]);
+	if(h->queue_count != 0 || h->stage != I2C_STAGE_NONE)
+	{
+		// Hay transacciones no bloqueantes o una recuperacion en curso: su PIT, su IICIF y los contadores no se tocan
+		blocking_release(h);
+		return false;
+	}
+	return true;
+}
 
 
-		 stage =  I2C_STAGE_WRITE_REG_ADDRESS;
-		 mode =  I2C_MODE_WRITE;
+static void blocking_release (I2C_HANDLE * h)
+{
+	NVIC_EnableIRQ(pitIrqs[h->ch]);
+	NVIC_EnableIRQ(i2c_irqs[h->ch]);
+}
 
 
-		 i2c->C1 |= I2C_C1_TX_MASK; // Transmit Mode Select (TRANSMIT)
-		 i2c->C1 |= I2C_C1_MST_MASK; // Master Mode Select (MASTER) //START signal
-		 I2C_WRITE_BYTE(device_address_w);
+static I2C_FAULT blocking_start (I2C_HANDLE * h, uint8_t address)
+{
+	I2C_Type * i2c = h->i2c;
 
+	timeout_start(h, false);
+	while(I2C_CHECK_BUS && !timeout_expired(h));
+	if(I2C_CHECK_BUS)
+	{
+		if(!sda_stuck(h) || !i2cBusRecover(h->ch))
+			return I2C_BUS_BUSY;
+		timeout_start(h, false);
+	}
 
+	I2C_SET_TX_MODE; // Transmit Mode Select (TRANSMIT)
+	I2C_START_SIGNAL; // Master Mode Select (MASTER)
+	return blocking_write(h, address);
+}
+
+
+static I2C_FAULT blocking_write (I2C_HANDLE * h, uint8_t data)
+{
+	I2C_Type * i2c = h->i2c;
+	I2C_FAULT fault;
+
+	I2C_CLEAR_IRQ_FLAG;
+	I2C_WRITE_BYTE(data);
+	fault = blocking_wait(h);
+	if(fault == I2C_NO_FAULT && I2C_GET_RX_ACK)
+		fault = I2C_SLAVE_ERROR;
+	return fault;
+}
+
+
+static I2C_FAULT blocking_wait (I2C_HANDLE * h)
+{
+	I2C_Type * i2c = h->i2c;
+
+	while(!I2C_GET_IRQ_FLAG)
+	{
+		if(timeout_expired(h))
+			return I2C_TIMEOUT;
 	}
-	else
+	I2C_CLEAR_IRQ_FLAG;
+	return I2C_NO_FAULT;
+}
+
+
+static I2C_FAULT blocking_end (I2C_HANDLE * h, I2C_FAULT fault)
+{
+	I2C_Type * i2c = h->i2c;
+
+	if(fault != I2C_BUS_BUSY)
 	{
-		i2c_comm->fault = I2C_BUS_BUSY;
-		i2c_comm->callback();
+		I2C_STOP_SIGNAL;
+		I2C_CLEAR_NACK;
+		I2C_SET_TX_MODE;
+		while(I2C_CHECK_BUS && !timeout_expired(h)); // STOP
+		if(fault == I2C_TIMEOUT && sda_stuck(h))
+		{
+			i2cBusRecover(h->ch);
+		}
 	}
-	return;
+	timeout_stop(h);
+	I2C_CLEAR_IRQ_FLAG;
+	count_fault(h, fault);
 
+	return fault;
 }
 
 
+#if I2C_READ_DMA
+
+/*
+ * El DMA copia los bytes 0..n-3. Los 2 ultimos vuelven por interrupcion: el anteultimo
+ * es el que tiene que activar el NACK, y asi no importa la latencia de la interrupcion del DMA
+ */
+static void dma_start_read (I2C_HANDLE * h)
+{
+	I2C_Type * i2c = h->i2c;
+	uint8_t dma_ch = I2C_DMA_CHANNEL;
+	uint8_t cant = h->i2c_com->data_size - 2;
+
+	DMA0->TCD[dma_ch].DADDR = (uint32_t)h->i2c_com->data;
+	DMA0->TCD[dma_ch].CITER_ELINKNO = DMA_CITER_ELINKNO_CITER(cant);
+	DMA0->TCD[dma_ch].BITER_ELINKNO = DMA_BITER_ELINKNO_BITER(cant);
+	DMA0->TCD[dma_ch].CSR = DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK; // Se apaga solo al terminar
+	DMA0->SERQ = DMA_SERQ_SERQ(dma_ch);
+
+	h->data_index = cant; // Al volver a interrupciones sigo desde el anteultimo
+
+	i2c->C1 &= ~I2C_C1_IICIE_MASK;
+	i2c->C1 |= I2C_C1_DMAEN_MASK; // Cada TCF pide un DMA en vez de una interrupcion
+}
 
 
-I2C_FAULT i2cWriteMsgBlocking (uint8_t * msg, uint8_t data_size,	uint8_t register_address, uint8_t slave_address )
+static void dma_irq_handler (I2C_HANDLE * h)
 {
-	NVIC_DisableIRQ(i2c_irqs[ch]);
+	I2C_Type * i2c = h->i2c;
 
-	I2C_FAULT fault = I2C_NO_FAULT;
+	DMA0->CINT = DMA_CINT_CINT(I2C_DMA_CHANNEL);
 
-	unsigned timeout = TIMEOUT;	// Use timeout for blocking communications
+	i2c->C1 &= ~I2C_C1_DMAEN_MASK;
+	I2C_CLEAR_IRQ_FLAG; // Quedo en 1 por los bytes que movio el DMA
+	i2c->C1 |= I2C_C1_IICIE_MASK;
 
-	if(I2C_CHECK_BUS != BUS_BUSY)
+	if(I2C_GET_TCF)
 	{
-		device_address_w = (slave_address << 1) & 0b11111110;
-		data_index = 0;
+		NVIC_SetPendingIRQ(i2c_irqs[h->ch]); // El anteultimo ya llego antes de limpiar el flag
+	}
+}
 
-		i2c->C1 |= I2C_C1_TX_MASK; // Transmit Mode Select (TRANSMIT)
-		i2c->C1 |= I2C_C1_MST_MASK; // Master Mode Select (MASTER)
-		I2C_WRITE_BYTE(device_address_w);
 
-		while(I2C_GET_TCF == false)
+__ISR__ DMA12_IRQHandler (void)
+{
+	dma_irq_handler(&handles[I2C_DMA_BUS]);
+}
+
+#endif // I2C_READ_DMA
+
+
+
+/*******************************************************************************
+ *******************************************************************************
+                        GLOBAL FUNCTION DEFINITIONS
+ *******************************************************************************
+ ******************************************************************************/
+
+
+
+
+uint32_t i2cComputeDivider (uint32_t clock, uint32_t scl_hz, uint8_t * mult, uint8_t * icr)
+{
+	uint32_t best_rate = 0, rate, min_rate = 0xFFFFFFFF;
+	uint8_t best_mult = 0, best_icr = 0, min_mult = 0, min_icr = 0;
+	uint8_t m, i;
+
+	for(m = 0; m < I2C_MULT_CANT; m++)
+	{
+		for(i = 0; i < I2C_ICR_CANT; i++)
 		{
-			timeout--;
-			if(timeout == 0)
+			rate = clock / ((uint32_t)sclDividers[i] << m); // SCL = clock / (mul * divider), mul = 2^MULT
+			if(rate <= scl_hz && rate > best_rate)
+			{
+				best_rate = rate;
+				best_mult = m;
+				best_icr = i;
+			}
+			if(rate < min_rate)
 			{
-				I2C_STOP_SIGNAL;
-				fault = I2C_TIMEOUT;
+				min_rate = rate;
+				min_mult = m;
+				min_icr = i;
 			}
 		}
+	}
 
-		if(I2C_GET_RX_ACK == 0 && fault == I2C_NO_FAULT)
-		{
+	if(best_rate == 0) // Ni el mas lento alcanza: me quedo con el mas lento
+	{
+		best_rate = min_rate;
+		best_mult = min_mult;
+		best_icr = min_icr;
+	}
 
-			I2C_WRITE_BYTE(register_address);
+	if(mult != NULL)
+		*mult = best_mult;
+	if(icr != NULL)
+		*icr = best_icr;
 
-			while( I2C_GET_TCF == false )
-			{
-				timeout--;
-				if(timeout == 0)
-				{
-					I2C_STOP_SIGNAL;
-					fault = I2C_TIMEOUT;
-				}
-			}
+	return best_rate;
+}
 
-			while((data_index <= data_size) && (fault == I2C_NO_FAULT))
-			{
-				if(I2C_GET_RX_ACK == 0 && fault == I2C_NO_FAULT)
-				{
-					if(data_index == data_size)
-					{
-						I2C_STOP_SIGNAL;
-					}
-					else
-					{
-						I2C_WRITE_BYTE(msg[data_index]);
 
+uint32_t i2cInit (I2C_ChannelType channel, uint32_t scl_hz)
+{
+	uint8_t mult, icr;
+	uint32_t rate;
+	SIM_Type* sim_ptr = SIM;
+	PORT_Type * portsPtrs [] = PORT_BASE_PTRS;
+	I2C_HANDLE * h = &handles[channel];
+	I2C_Type * i2c = i2cPtrs[channel];
 
-						while(I2C_GET_TCF == false)
-						{
-							timeout--;
-							if(timeout == 0)
-							{
-								fault = I2C_TIMEOUT;
-							}
-						}
-					}
+	h->i2c = i2c;
+	h->ch = channel;
+	h->i2c_com = NULL;
+	h->queue_front = 0;
+	h->queue_count = 0;
+	h->stage = I2C_STAGE_NONE;
+	h->recovered = false;
+	h->timeout_us = I2C_TIMEOUT_US;
 
-					data_index++;
-				}
-				else
-				{
-					I2C_STOP_SIGNAL;
-					fault = I2C_SLAVE_ERROR;
-				}
+	PORT_Type * port_SDA = portsPtrs[PIN2PORT(sdaPins[channel])];
+	uint32_t pin_SDA = PIN2NUM(sdaPins[channel]);
 
-			}
+	PORT_Type * port_SCL = portsPtrs[PIN2PORT(sclPins[channel])];
+	uint32_t pin_SCL = PIN2NUM(sclPins[channel]);
 
-		}
-		else
-		{
-			I2C_STOP_SIGNAL;
-			fault =  I2C_SLAVE_ERROR;
-		}
+	sim_ptr->SCGC5 |= SIM_SCGC5_PORTA_MASK << PIN2PORT(sdaPins[channel]); // PORTA..PORTE son bits consecutivos
+	sim_ptr->SCGC5 |= SIM_SCGC5_PORTA_MASK << PIN2PORT(sclPins[channel]);
 
+	if (channel == I2C_2)
+	{
+		sim_ptr->SCGC1 |= simMasks[channel]; // activo clock gating
 	}
 	else
 	{
-		return I2C_BUS_BUSY;
+		sim_ptr->SCGC4 |= simMasks[channel]; // activo clock gating
 	}
 
-	while(I2C_CHECK_BUS == BUS_BUSY)
-	{
-		//STOP
-	};
 
-	NVIC_EnableIRQ(i2c_irqs[ch]);
-	return I2C_NO_FAULT;
+	 i2c->C1 = 0x00; // I2C Control Register 1
+	 i2c->C1 |= I2C_C1_IICEN_MASK; // Enables I2C module operation.
+	 i2c->C1 |= I2C_C1_IICIE_MASK; // Enables I2C interrupt requests.
+	 i2c->S = I2C_S_TCF_MASK | I2C_S_IICIF_MASK;
+
 
+	 // I2C Frequency Divider register
+
+	 //I2C baud rate = I2C module clock speed (Hz)/(mul × SCL divider)
+	 rate = i2cComputeDivider(I2C_CLOCK, scl_hz, &mult, &icr);
+	 i2c->F = I2C_F_MULT(mult) | I2C_F_ICR(icr); //  set the I2C baud rate
+
+	 NVIC_EnableIRQ(i2c_irqs[channel]);
+
+	 sim_ptr->SCGC6 |= SIM_SCGC6_PIT_MASK;
+	 PIT->MCR = 0; // Habilita el PIT
+	 PIT->CHANNEL[I2C_PIT_CHANNEL(channel)].TCTRL = 0;
+	 NVIC_EnableIRQ(pitIrqs[channel]);
+
+#if I2C_READ_DMA
+	 if(channel == I2C_DMA_BUS)
+	 {
+		 sim_ptr->SCGC6 |= SIM_SCGC6_DMAMUX_MASK;
+		 sim_ptr->SCGC7 |= SIM_SCGC7_DMA_MASK;
+
+		 DMAMUX->CHCFG[I2C_DMA_CHANNEL] = 0;
+		 DMA0->TCD[I2C_DMA_CHANNEL].SADDR = (uint32_t)&i2c->D;
+		 DMA0->TCD[I2C_DMA_CHANNEL].SOFF = 0;
+		 DMA0->TCD[I2C_DMA_CHANNEL].SLAST = 0;
+		 DMA0->TCD[I2C_DMA_CHANNEL].DOFF = 1;
+		 DMA0->TCD[I2C_DMA_CHANNEL].DLAST_SGA = 0;
+		 DMA0->TCD[I2C_DMA_CHANNEL].ATTR = DMA_ATTR_SSIZE(0) | DMA_ATTR_DSIZE(0);
+		 DMA0->TCD[I2C_DMA_CHANNEL].NBYTES_MLNO = 1;
+		 DMAMUX->CHCFG[I2C_DMA_CHANNEL] = DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(I2C_DMA_SOURCE);
+
+		 NVIC_EnableIRQ(DMA12_IRQn);
+	 }
+#endif
+
+
+	 port_SDA->PCR[pin_SDA] |= PORT_PCR_MUX(pinMux[channel]); // cambia los pines a alternativa i2c
+	 port_SDA->PCR[pin_SDA] |= PORT_PCR_ODE_MASK;
+	 port_SCL->PCR[pin_SCL] |= PORT_PCR_MUX(pinMux[channel]);
+	 port_SCL->PCR[pin_SCL] |= PORT_PCR_ODE_MASK;
+
+	 return rate;
 }
 
 
+void i2cReadMsg(I2C_COM_CONTROL * i2c_comm)
+{
+	i2c_comm->mode = I2C_MODE_READ;
+	if(i2cSubmit(i2c_comm, 1) != I2C_NO_FAULT)
+	{
+		i2c_comm->fault = I2C_BUS_BUSY;
+		if(i2c_comm->callback != NULL)
+			i2c_comm->callback();
+	}
+
+	return;
+}
 
 
-I2C_FAULT i2cReadMsgBlocking (uint8_t * buffer, uint8_t data_size,	uint8_t register_address, uint8_t slave_address )
+void i2cWriteMsg(I2C_COM_CONTROL * i2c_comm)
 {
-	NVIC_DisableIRQ(i2c_irqs[ch]);
+	i2c_comm->mode = I2C_MODE_WRITE;
+	if(i2cSubmit(i2c_comm, 1) != I2C_NO_FAULT)
+	{
+		i2c_comm->fault = I2C_BUS_BUSY;
+		if(i2c_comm->callback != NULL)
+			i2c_comm->callback();
+	}
+	return;
 
-	I2C_FAULT fault = I2C_NO_FAULT;
+}
+
+
+I2C_FAULT i2cSubmit(I2C_COM_CONTROL * jobs, uint8_t count)
+{
+	uint8_t i;
+	bool idle;
+	I2C_HANDLE * h;
+
+	if(count == 0)
+		return I2C_QUEUE_FULL;
 
-	unsigned timeout = TIMEOUT;	// Use timeout for blocking communications
+	h = &handles[jobs[0].channel]; // Todo el grupo va por el mismo bus
+	NVIC_DisableIRQ(i2c_irqs[h->ch]);
+	NVIC_DisableIRQ(pitIrqs[h->ch]);
 
-	if(I2C_CHECK_BUS != BUS_BUSY)
+	if(count > I2C_QUEUE_LEN - h->queue_count)
 	{
+		NVIC_EnableIRQ(pitIrqs[h->ch]);
+		NVIC_EnableIRQ(i2c_irqs[h->ch]);
+		return I2C_QUEUE_FULL;
+	}
 
-		device_address_r = (slave_address << 1) | 0b00000001;
-		device_address_w = (slave_address << 1) & 0b11111110;
-		data_index = 0;
+	idle = (h->queue_count == 0);
+	for(i = 0; i < count; i++)
+	{
+		jobs[i].fault = I2C_NO_FAULT;
+		h->queue[(h->queue_front + h->queue_count) % I2C_QUEUE_LEN] = &jobs[i];
+		h->queue_group[(h->queue_front + h->queue_count) % I2C_QUEUE_LEN] = h->next_group;
+		h->queue_count++;
+	}
+	h->next_group++;
 
-		i2c->C1 |= I2C_C1_TX_MASK; // Transmit Mode Select (TRANSMIT)
-		i2c->C1 |= I2C_C1_MST_MASK; // Master Mode Select (MASTER)
-		I2C_WRITE_BYTE(device_address_w);
+	if(idle && h->stage == I2C_STAGE_NONE) // Si se esta recuperando el bus, arranca al terminar
+		start_com(h, false);
 
-		while(I2C_GET_TCF == false)
-		{
-			timeout--;
-			if(timeout == 0)
-			{
-				I2C_STOP_SIGNAL;
-				fault = I2C_TIMEOUT;
-			}
-		}
+	NVIC_EnableIRQ(pitIrqs[h->ch]);
+	NVIC_EnableIRQ(i2c_irqs[h->ch]);
+	return I2C_NO_FAULT;
+}
 
-		if(I2C_GET_RX_ACK == 0 && fault == I2C_NO_FAULT)
-		{
 
-			I2C_WRITE_BYTE(register_address);
 
-			while( I2C_GET_TCF == false )
-			{
-				timeout--;
-				if(timeout == 0)
-				{
-					I2C_STOP_SIGNAL;
-					fault = I2C_TIMEOUT;
-				}
-			}
-			if((I2C_GET_RX_ACK) == 0 && fault == I2C_NO_FAULT)
-			{
 
-				I2C_REPEAT_START_SIGNAL;
-				I2C_WRITE_BYTE(device_address_r);
-				while( I2C_GET_TCF == false)
-				{
-					timeout--;
-					if(timeout == 0)
-					{
-						I2C_STOP_SIGNAL;
-						fault = I2C_TIMEOUT;
-					}
-				}
-				if(I2C_GET_RX_ACK == 0 && fault == I2C_NO_FAULT)
-				{
-					for (int i = 100; i>0; i--){};
+void i2cSetTimeout (I2C_ChannelType channel, uint32_t timeout_us)
+{
+	handles[channel].timeout_us = timeout_us;
+}
 
-					I2C_SET_RX_MODE;
 
-					if(data_index == data_size-1) //voy a leer mi último dato
-					{
-						I2C_SET_NACK;
-					}
-					uint8_t dummy_data = I2C_READ_BYTE;
+void i2cGetFaultCounters (I2C_ChannelType channel, I2C_FAULT_COUNTERS * counters)
+{
+	NVIC_DisableIRQ(i2c_irqs[channel]);
+	NVIC_DisableIRQ(pitIrqs[channel]);
+	*counters = handles[channel].counters;
+	NVIC_EnableIRQ(pitIrqs[channel]);
+	NVIC_EnableIRQ(i2c_irqs[channel]);
+}
 
-					while( I2C_GET_TCF == false )
-					{
-						timeout--;
-						if(timeout == 0)
-						{
-							I2C_STOP_SIGNAL;
-							fault = I2C_TIMEOUT;
-						}
 
-					}
+void i2cResetFaultCounters (I2C_ChannelType channel)
+{
+	NVIC_DisableIRQ(i2c_irqs[channel]);
+	NVIC_DisableIRQ(pitIrqs[channel]);
+	handles[channel].counters = (I2C_FAULT_COUNTERS){0};
+	NVIC_EnableIRQ(pitIrqs[channel]);
+	NVIC_EnableIRQ(i2c_irqs[channel]);
+}
 
-					if(fault == I2C_NO_FAULT)
-					{
-						while(data_index < data_size)
-						{
-							if(data_index == data_size-1)
-							{
-								I2C_STOP_SIGNAL;
-								I2C_CLEAR_NACK;
-								buffer[data_index] = I2C_READ_BYTE;
-							}
-
-							else
-							{
-								if(data_index == data_size-2) //voy a leer mi último dato
-								{
-									I2C_SET_NACK;
-								}
-
-								buffer[data_index] = I2C_READ_BYTE;
-								while(I2C_GET_TCF == false)
-								{
-									timeout--;
-									if(timeout == 0)
-									{
-										return I2C_TIMEOUT;
-									}
-								}
-							}
-
-							data_index++;
-						}
-					}
 
+bool i2cBusRecover (I2C_ChannelType channel)
+{
+	I2C_HANDLE * h = &handles[channel];
+	uint8_t step;
 
-				}
-				else
-				{
-					I2C_STOP_SIGNAL;
-					fault = I2C_SLAVE_ERROR;
-				}
+	recover_begin(h);
+	for(step = 0; step < I2C_RECOVERY_STEPS; step++)
+	{
+		recover_step(h, step);
+		delay_us(h, I2C_RECOVERY_HALF_US);
+	}
 
+	return recover_end(h);
+}
 
-			}
 
-			else
-			{
-				I2C_STOP_SIGNAL;
-				fault = I2C_SLAVE_ERROR;
-			}
-		}
-		else
-		{
-			I2C_STOP_SIGNAL;
-			fault =  I2C_SLAVE_ERROR;
-		}
+I2C_FAULT i2cWriteMsgBlocking (I2C_ChannelType channel, uint8_t * msg, uint8_t data_size,	uint8_t register_address, uint8_t slave_address )
+{
+	I2C_HANDLE * h = &handles[channel];
+	I2C_FAULT fault;
+	uint8_t data_index = 0;
+
+	if(!blocking_claim(h))
+		return I2C_BUS_BUSY;
 
+	fault = blocking_start(h, (slave_address << 1) & 0b11111110);
+	if(fault == I2C_NO_FAULT)
+	{
+		fault = blocking_write(h, register_address);
 	}
-	else
+	while(fault == I2C_NO_FAULT && data_index < data_size)
 	{
-		return I2C_BUS_BUSY;
+		fault = blocking_write(h, msg[data_index]);
+		data_index++;
 	}
+	fault = blocking_end(h, fault);
+
+	blocking_release(h);
+	return fault;
+
+}
+
+
 
-	while(I2C_CHECK_BUS == BUS_BUSY)
+
+I2C_FAULT i2cReadMsgBlocking (I2C_ChannelType channel, uint8_t * buffer, uint8_t data_size,	uint8_t register_address, uint8_t slave_address )
+{
+	I2C_HANDLE * h = &handles[channel];
+	I2C_Type * i2c = h->i2c;
+	I2C_FAULT fault;
+	uint8_t data_index;
+	uint8_t dummy_data;
+
+	if(!blocking_claim(h))
+		return I2C_BUS_BUSY;
+
+	fault = blocking_start(h, (slave_address << 1) & 0b11111110);
+	if(fault == I2C_NO_FAULT)
 	{
-		//STOP
-	};
+		fault = blocking_write(h, register_address);
+	}
+	if(fault == I2C_NO_FAULT)
+	{
+		I2C_REPEAT_START_SIGNAL;
+		fault = blocking_write(h, (slave_address << 1) | 0b00000001);
+	}
+	if(fault == I2C_NO_FAULT && data_size > 0)
+	{
+		I2C_SET_RX_MODE;
+		if(data_size == 1) //voy a leer mi último dato
+		{
+			I2C_SET_NACK;
+		}
+		dummy_data = I2C_READ_BYTE; // Arranca la recepcion del primer byte
+		(void)dummy_data;
 
-	NVIC_EnableIRQ(i2c_irqs[ch]);
+		for(data_index = 0; data_index < data_size && fault == I2C_NO_FAULT; data_index++)
+		{
+			fault = blocking_wait(h);
+			if(fault != I2C_NO_FAULT)
+			{
+				break;
+			}
+			if(data_index == data_size-1)
+			{
+				I2C_STOP_SIGNAL; // Antes de leer D, para que no arranque otra recepcion
+				I2C_CLEAR_NACK;
+			}
+			else if(data_index == data_size-2) //voy a leer mi último dato
+			{
+				I2C_SET_NACK;
+			}
+			buffer[data_index] = I2C_READ_BYTE;
+		}
+	}
+	fault = blocking_end(h, fault);
 
-	return I2C_NO_FAULT;
+	blocking_release(h);
+	return fault;
 
 }
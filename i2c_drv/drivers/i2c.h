@@ -14,6 +14,8 @@
  ******************************************************************************/
 
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
 
 
 
@@ -26,6 +28,25 @@
 
 #define ADDRESS_CYCLE_BYTES 2
 
+#define I2C_CANT_IDS	3
+
+#define I2C_STANDARD_MODE	100000U
+#define I2C_FAST_MODE		400000U
+#define I2C_FAST_MODE_PLUS	1000000U
+
+#define I2C_QUEUE_LEN	16	// Cantidad maxima de transacciones encoladas
+
+// Lecturas de al menos I2C_DMA_MIN_LEN bytes por I2C0 mueven los datos por eDMA (canal 12).
+// I2C1 e I2C2 comparten un request del DMAMUX, asi que siempre leen por interrupcion
+#ifndef I2C_READ_DMA
+#define I2C_READ_DMA	1
+#endif
+#define I2C_DMA_MIN_LEN	4
+
+#ifndef I2C_TIMEOUT_US
+#define I2C_TIMEOUT_US	5000	// Timeout por defecto de cada transaccion
+#endif
+
 /*******************************************************************************
  * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
  ******************************************************************************/
@@ -43,6 +64,8 @@ typedef enum
          I2C_STAGE_WRITE_REG_ADDRESS,
          I2C_STAGE_READ_DUMMY_DATA,
          I2C_STAGE_READ_DATA,
+         I2C_STAGE_WAIT_BUS,		// Esperando que salga el STOP anterior, con el PIT
+         I2C_STAGE_RECOVER,		// Recuperando el bus de a medio periodo de SCL, con el PIT
 
 
 } I2C_STAGE;
@@ -61,6 +84,8 @@ typedef enum
          I2C_BUS_BUSY,
          I2C_TIMEOUT,
          I2C_SLAVE_ERROR,
+         I2C_QUEUE_FULL,
+         I2C_ABORTED,		// Otra transaccion del mismo grupo fallo antes
 } I2C_FAULT;
 
 
@@ -70,12 +95,24 @@ typedef struct
 	uint8_t data_size; // en bytes
 	uint8_t register_address;
 	uint8_t slave_address;
-	pfunc callback;
+	pfunc callback; // Puede ser NULL
 	I2C_FAULT fault;
+	I2C_MODE mode; // Lo completan i2cReadMsg/i2cWriteMsg; con i2cSubmit lo completa el llamador
+	I2C_ChannelType channel; // Bus por el que sale la transaccion
 
 }I2C_COM_CONTROL;
 
 
+typedef struct
+{
+	uint32_t bus_busy;
+	uint32_t timeouts;
+	uint32_t slave_errors;
+	uint32_t aborted;
+	uint32_t recoveries; // Veces que se corrio i2cBusRecover
+} I2C_FAULT_COUNTERS;
+
+
 /*******************************************************************************
  * VARIABLE PROTOTYPES WITH GLOBAL SCOPE
  ******************************************************************************/
@@ -86,10 +123,23 @@ typedef struct
 
 /**
  * @brief Initialize i2c driver
- * @param id i2c's number
- * @param config i2c's configuration (baudrate, parity, etc.)
+ * @param channel i2c's number
+ * @param scl_hz Desired SCL frequency, e.g. I2C_FAST_MODE
+ * @return Achieved SCL frequency, the closest one that doesn't exceed scl_hz
 */
-void i2cInit (uint8_t channel); //, uint8_t baud_rate, uint32_t systemClock
+uint32_t i2cInit (I2C_ChannelType channel, uint32_t scl_hz);
+
+
+/**
+ * @brief Search the MULT/ICR pair whose SCL frequency is closest to scl_hz without exceeding it.
+ * 		  Doesn't touch any register
+ * @param clock I2C module clock (bus clock) in Hz
+ * @param scl_hz Desired SCL frequency
+ * @param mult Where to store the MULT field. May be NULL
+ * @param icr Where to store the ICR field. May be NULL
+ * @return Achieved SCL frequency. If scl_hz is below the slowest one, the slowest one is returned
+*/
+uint32_t i2cComputeDivider (uint32_t clock, uint32_t scl_hz, uint8_t * mult, uint8_t * icr);
 
 
 /**
@@ -112,9 +162,66 @@ void i2cReadMsg(I2C_COM_CONTROL * i2c_comm);
 void i2cWriteMsg(I2C_COM_CONTROL * i2c_comm);
 
 
-I2C_FAULT i2cReadMsgBlocking (uint8_t * buffer, uint8_t data_size,	uint8_t register_address, uint8_t slave_address );
+/**
+ * @brief Queue several transactions at once. Non-Blocking
+ * @param jobs Transactions, each one with its mode and callback. They must remain valid until their callback
+ * 		  and all of them must use the same channel
+ * @param count Quantity of transactions
+ * @return I2C_NO_FAULT if all of them were queued, I2C_QUEUE_FULL if none was queued
+ * @note Transactions run in order, chained with a repeated START. If one fails, the rest of the
+ * 		 same call finish with I2C_ABORTED and their callbacks are still called
+*/
+I2C_FAULT i2cSubmit(I2C_COM_CONTROL * jobs, uint8_t count);
+
 
-I2C_FAULT i2cWriteMsgBlocking (uint8_t * msg, uint8_t data_size,	uint8_t register_address, uint8_t slave_address );
+/**
+ * @brief Read registers. Blocking
+ * @param channel i2c's number
+ * @return The real fault of the transfer
+ * @note Fails with I2C_BUS_BUSY while there are non-blocking transactions queued, without touching them
+ * 		 nor counting a fault
+*/
+I2C_FAULT i2cReadMsgBlocking (I2C_ChannelType channel, uint8_t * buffer, uint8_t data_size,	uint8_t register_address, uint8_t slave_address );
+
+/**
+ * @brief Write registers. Blocking
+ * @param channel i2c's number
+ * @return The real fault of the transfer
+ * @note Fails with I2C_BUS_BUSY while there are non-blocking transactions queued, without touching them
+ * 		 nor counting a fault
+*/
+I2C_FAULT i2cWriteMsgBlocking (I2C_ChannelType channel, uint8_t * msg, uint8_t data_size,	uint8_t register_address, uint8_t slave_address );
+
+
+/**
+ * @brief Set the timeout of every transaction, measured with a PIT channel (PIT1..PIT3 for I2C0..I2C2)
+ * @param channel i2c's number
+ * @param timeout_us Timeout in microseconds
+*/
+void i2cSetTimeout (I2C_ChannelType channel, uint32_t timeout_us);
+
+
+/**
+ * @brief Free a bus held by a slave: clocks 9 SCL pulses and issues a STOP. Busy-waits about 100 us.
+ * 		  After a timeout with SDA low the driver does the same from the PIT interrupt, without waiting
+ * @param channel i2c's number
+ * @return true if SDA was released
+*/
+bool i2cBusRecover (I2C_ChannelType channel);
+
+
+/**
+ * @brief Copy the fault counters of a bus
+ * @param channel i2c's number
+ * @param counters Where to copy them
+*/
+void i2cGetFaultCounters (I2C_ChannelType channel, I2C_FAULT_COUNTERS * counters);
+
+/**
+ * @brief Clear the fault counters of a bus
+ * @param channel i2c's number
+*/
+void i2cResetFaultCounters (I2C_ChannelType channel);
 
 
 /*******************************************************************************
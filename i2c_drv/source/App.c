@@ -15,10 +15,13 @@
 #include "Led.h"
 #include "i2c.h"
 #include <stdbool.h>
+#include <stdio.h>
 /*******************************************************************************
  * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
  ******************************************************************************/
 
+#define ACCEL_USE_DRDY	1 // 0: vuelve a leer el sensor con el timer de 200 ms
+
 
 /*******************************************************************************
  * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
@@ -36,6 +39,7 @@ void send_i2c_msg(void);
 void callback_init(void);
 void read(void);
 void Position_Update(void);
+void new_sample(void);
 int idtimer1 = 0;
 int idtimer2 = 0;
 int idtimer = 0;
@@ -61,6 +65,9 @@ orientation_t orientation_app;
 //static bool finish = false;
 //uint8_t Buffer[13];
 static read_data accel_Read;
+static SRAWDATA accel_raw;
+static SRAWDATA magn_raw;
+static volatile bool sample_ready = false;
 //static bool reading = false;
 
 /* Función que se llama 1 vez, al comienzo del programa */
@@ -86,7 +93,14 @@ void App_Init(void)
 	//idtimer = Timer_AddCallback(&read, 5000, false);
 
 
-	idtimer1 = Timer_AddCallback(&Position_Update,200,false);
+	accel_Read.pAccelData = &accel_raw;
+	accel_Read.pMagnData = &magn_raw;
+	accel_Read.callback = new_sample;
+
+#if ACCEL_USE_DRDY
+	if(!AccelMagn_enableDataReady(&accel_Read))
+#endif
+	idtimer1 = Timer_AddCallback(&Position_Update,200,false); // respaldo si no hay data-ready
 	//idtimer2 = Timer_AddCallback(&periodicRefresh,1000,false);
 
 	//i2cInit(I2C_0);
@@ -119,6 +133,19 @@ void App_Init(void)
 void App_Run(void)
 {
 	static char msg[105] = {0};
+	SRAWDATA sample;
+	int len;
+
+	// Ultima muestra del acelerometro por la UART 0. Si la UART no termino, se saltean muestras
+	if(sample_ready && UART_is_tx_msg_complete(0))
+	{
+		__disable_irq();
+		sample = accel_raw;
+		sample_ready = false;
+		__enable_irq();
+		len = snprintf(msg, sizeof(msg), "%d,%d,%d\r\n", sample.x, sample.y, sample.z);
+		UART_write_msg(0, msg, len);
+	}
 
 	/*
 	if(UART_is_rx_msg(3))
@@ -164,6 +191,11 @@ void Position_Update(void){
 
 }
 
+void new_sample(void)
+{
+	sample_ready = true; // Se manda por la UART 0 desde App_Run, fuera de la interrupcion
+}
+
 void toggle_led(void)
 {
 	Led_Toggle(LED_RED);
@@ -0,0 +1,78 @@
+/***************************************************************************//**
+  @file     test_i2c_divider.c
+  @brief    i2cComputeDivider against every MULT/ICR pair, and the F register written by i2cInit
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "i2c.h"
+#include "hardware.h"
+#include "check.h"
+
+// Tabla "I2C divider and hold values" del manual de referencia, SCL divider por ICR
+static const uint16_t dividers[64] = {
+	20,   22,   24,   26,   28,   30,   34,   40,   28,   32,   36,   40,   44,   48,   56,   68,
+	48,   56,   64,   72,   80,   88,   104,  128,  80,   96,   112,  128,  144,  160,  192,  240,
+	160,  192,  224,  256,  288,  320,  384,  480,  320,  384,  448,  512,  576,  640,  768,  960,
+	640,  768,  896,  1024, 1152, 1280, 1536, 1920, 1280, 1536, 1792, 2048, 2304, 2560, 3072, 3840
+};
+
+static uint32_t scl(uint32_t clock, uint8_t mult, uint8_t icr)
+{
+	return clock / ((uint32_t)dividers[icr] << mult);
+}
+
+static void test_rate(uint32_t clock, uint32_t scl_hz)
+{
+	uint8_t mult = 0xFF, icr = 0xFF, m, i;
+	uint32_t achieved, best = 0, rate;
+
+	achieved = i2cComputeDivider(clock, scl_hz, &mult, &icr);
+
+	// La mas rapida que no se pasa
+	for(m = 0; m < 3; m++)
+		for(i = 0; i < 64; i++)
+		{
+			rate = scl(clock, m, i);
+			if(rate <= scl_hz && rate > best)
+				best = rate;
+		}
+	if(best == 0)
+		best = scl(clock, 2, 63); // Ninguna alcanza: la mas lenta
+
+	check(mult <= 2 && icr <= 63 && achieved == scl(clock, mult, icr) && achieved == best,
+			"clock %lu scl %lu: got %lu (mult %u icr %u), best %lu", (unsigned long)clock,
+			(unsigned long)scl_hz, (unsigned long)achieved, mult, icr, (unsigned long)best);
+}
+
+static void test_init(uint32_t scl_hz)
+{
+	uint8_t mult, icr;
+	uint32_t rate = i2cInit(I2C_0, scl_hz);
+
+	check(rate == i2cComputeDivider(__CORE_CLOCK__ >> 1, scl_hz, &mult, &icr) &&
+			host_i2c[0].F == (I2C_F_MULT(mult) | I2C_F_ICR(icr)),
+			"i2cInit %lu: rate %lu, F 0x%02X", (unsigned long)scl_hz, (unsigned long)rate, host_i2c[0].F);
+}
+
+int main(void)
+{
+	static const uint32_t clocks[] = {__CORE_CLOCK__ >> 1, 60000000, 48000000, 20970000};
+	static const uint32_t common[] = {I2C_STANDARD_MODE, I2C_FAST_MODE, I2C_FAST_MODE_PLUS, 10000, 50000};
+	uint32_t scl_hz;
+	unsigned int c, i;
+
+	for(c = 0; c < sizeof(clocks) / sizeof(clocks[0]); c++)
+	{
+		for(i = 0; i < sizeof(common) / sizeof(common[0]); i++)
+			test_rate(clocks[c], common[i]);
+		for(scl_hz = 1; scl_hz < 5000000; scl_hz += scl_hz / 53 + 1)
+			test_rate(clocks[c], scl_hz);
+	}
+
+	// Fast mode a 50 MHz: 390625 Hz (MULT 0, ICR 0x17), sin pasarse de 400 kHz
+	check(i2cComputeDivider(__CORE_CLOCK__ >> 1, I2C_FAST_MODE, NULL, NULL) == 390625, "fast mode at the bus clock");
+	for(i = 0; i < sizeof(common) / sizeof(common[0]); i++)
+		test_init(common[i]);
+
+	return check_report();
+}
@@ -0,0 +1,210 @@
+/***************************************************************************//**
+  @file     test_i2c_dma.c
+  @brief    Long I2C reads: data phase moved by eDMA, last two bytes by interrupt
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "i2c.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define SLAVE		0x1D
+#define SDA_PIN		25		// PTE25
+#define DMA_CH		12		// Canal de I2C0
+
+void I2C0_IRQHandler(void);
+void PIT1_IRQHandler(void);
+void DMA12_IRQHandler(void);
+void I2C1_IRQHandler(void);
+void PIT2_IRQHandler(void);
+
+static I2C_Type * const i2c = &host_i2c[0];
+static int callbacks;
+
+static void done(void)
+{
+	callbacks++;
+}
+
+static void byte_done(void)
+{
+	i2c->S = 0; // ACK
+	I2C0_IRQHandler();
+}
+
+// Lectura ya arrancada hasta el byte de direccion de lectura (el que arranca la fase de datos)
+static void read_header(void)
+{
+	byte_done();
+	byte_done();
+	byte_done();
+}
+
+static void start_read(I2C_COM_CONTROL * com, uint8_t * data, uint8_t size)
+{
+	memset(i2c, 0, sizeof(*i2c));
+	memset(&host_dma, 0, sizeof(host_dma));
+	memset(host_nvic_pending, 0, sizeof(host_nvic_pending));
+	i2cInit(I2C_0, I2C_FAST_MODE);
+	*(volatile uint32_t *)&host_gpio[4].PDIR = 1U << SDA_PIN; // SDA liberada
+	callbacks = 0;
+
+	memset(com, 0, sizeof(*com));
+	com->data = data;
+	com->data_size = size;
+	com->register_address = 0x01;
+	com->slave_address = SLAVE;
+	com->callback = done;
+	com->channel = I2C_0;
+	host_dma.SERQ = 0xFF;
+	i2cReadMsg(com);
+}
+
+static void test_sources(void)
+{
+	i2cInit(I2C_0, I2C_FAST_MODE);
+	i2cInit(I2C_1, I2C_FAST_MODE);
+	i2cInit(I2C_2, I2C_FAST_MODE);
+	// I2C0 es el request 18 del DMAMUX; I2C1 e I2C2 comparten el 19 y no usan DMA
+	check(host_dmamux.CHCFG[12] == (DMAMUX_CHCFG_ENBL_MASK | DMAMUX_CHCFG_SOURCE(18)), "I2C0 DMA source");
+	check(host_dmamux.CHCFG[13] == 0 && host_dmamux.CHCFG[14] == 0, "I2C1/I2C2 without DMA channel");
+	check(host_dma.TCD[12].SADDR == (uint32_t)(uintptr_t)&host_i2c[0].D && host_dma.TCD[12].SOFF == 0 &&
+			host_dma.TCD[12].DOFF == 1, "DMA reads D into the buffer");
+	check(NVIC_GetEnableIRQ(DMA12_IRQn) && !NVIC_GetEnableIRQ(DMA13_IRQn) && !NVIC_GetEnableIRQ(DMA14_IRQn),
+			"only the I2C0 DMA interrupt enabled");
+}
+
+static void test_long_read(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t data[8], expected[] = {1, 2, 3, 4, 5, 6, 7, 8};
+	int i;
+
+	start_read(&com, data, sizeof(data));
+	read_header();
+	check(host_dma.SERQ == DMA_CH, "DMA channel started");
+	check(host_dma.TCD[DMA_CH].DADDR == (uint32_t)(uintptr_t)data, "DMA destination");
+	check(host_dma.TCD[DMA_CH].CITER_ELINKNO == sizeof(data) - 2 && host_dma.TCD[DMA_CH].BITER_ELINKNO == sizeof(data) - 2,
+			"DMA moves all but the last two bytes");
+	check(host_dma.TCD[DMA_CH].CSR == (DMA_CSR_INTMAJOR_MASK | DMA_CSR_DREQ_MASK), "DMA stops at the end");
+	check((i2c->C1 & I2C_C1_DMAEN_MASK) && !(i2c->C1 & I2C_C1_IICIE_MASK), "TCF requests DMA instead of IRQ");
+	check(!(i2c->C1 & I2C_C1_TXAK_MASK), "ACK while the DMA reads");
+
+	// El DMA copia sus bytes; el anteultimo ya llego cuando atiende la interrupcion del DMA
+	for(i = 0; i < (int)sizeof(data) - 2; i++)
+		data[i] = expected[i];
+	i2c->S = I2C_S_TCF_MASK;
+	DMA12_IRQHandler();
+	check(host_dma.CINT == DMA_CH, "DMA interrupt cleared");
+	check(!(i2c->C1 & I2C_C1_DMAEN_MASK) && (i2c->C1 & I2C_C1_IICIE_MASK), "back to interrupts");
+	check((host_nvic_pending[I2C0_IRQn >> 5] >> (I2C0_IRQn & 0x1F)) & 1, "I2C IRQ pended for the byte already in D");
+	check(callbacks == 0, "not finished after the DMA");
+
+	i2c->D = expected[6];
+	byte_done();
+	check(i2c->C1 & I2C_C1_TXAK_MASK, "NACK before the last byte");
+	i2c->D = expected[7];
+	byte_done();
+	check(callbacks == 1 && com.fault == I2C_NO_FAULT && !memcmp(data, expected, sizeof(data)), "long read data");
+	check(!(i2c->C1 & I2C_C1_MST_MASK), "STOP after the read");
+}
+
+static void test_dma_pending_flag(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t data[I2C_DMA_MIN_LEN];
+
+	// Si el anteultimo todavia no llego, la interrupcion del I2C llega sola
+	start_read(&com, data, sizeof(data));
+	read_header();
+	check(host_dma.TCD[DMA_CH].CITER_ELINKNO == I2C_DMA_MIN_LEN - 2, "shortest DMA read");
+	i2c->S = 0;
+	DMA12_IRQHandler();
+	check(host_nvic_pending[I2C0_IRQn >> 5] == 0, "no IRQ pended without TCF");
+}
+
+static void test_short_read(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t data[I2C_DMA_MIN_LEN - 1], expected[] = {9, 8, 7};
+	int i;
+
+	start_read(&com, data, sizeof(data));
+	read_header();
+	check(host_dma.SERQ == 0xFF && !(i2c->C1 & I2C_C1_DMAEN_MASK), "short read without DMA");
+	for(i = 0; i < (int)sizeof(data); i++)
+	{
+		i2c->D = expected[i];
+		byte_done();
+	}
+	check(callbacks == 1 && !memcmp(data, expected, sizeof(data)), "short read data");
+}
+
+static void test_timeout(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t data[16];
+
+	// El esclavo deja de mandar en medio de la fase de DMA
+	start_read(&com, data, sizeof(data));
+	read_header();
+	PIT1_IRQHandler();
+	check(host_dma.CERQ == DMA_CH, "DMA channel stopped on timeout");
+	check(!(i2c->C1 & I2C_C1_DMAEN_MASK) && (i2c->C1 & I2C_C1_IICIE_MASK), "interrupts restored on timeout");
+	check(callbacks == 1 && com.fault == I2C_TIMEOUT, "timeout reported");
+}
+
+// Una lectura larga por I2C1 va entera por interrupcion y su timeout no toca el canal de I2C0
+static void test_other_bus(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t data[8], expected[] = {11, 12, 13, 14, 15, 16, 17, 18};
+	I2C_Type * i2c1 = &host_i2c[1];
+	int i;
+
+	memset(i2c1, 0, sizeof(*i2c1));
+	i2cInit(I2C_1, I2C_FAST_MODE);
+	*(volatile uint32_t *)&host_gpio[2].PDIR = 1U << 11; // SDA de I2C1 (PTC11) liberada
+	callbacks = 0;
+	memset(&com, 0, sizeof(com));
+	com.data = data;
+	com.data_size = sizeof(data);
+	com.register_address = 0x01;
+	com.slave_address = SLAVE;
+	com.callback = done;
+	com.channel = I2C_1;
+	host_dma.SERQ = 0xFF;
+	i2cReadMsg(&com);
+
+	for(i = 0; i < 3; i++)
+	{
+		i2c1->S = 0;
+		I2C1_IRQHandler();
+	}
+	check(host_dma.SERQ == 0xFF && !(i2c1->C1 & I2C_C1_DMAEN_MASK), "I2C1 long read without DMA");
+	for(i = 0; i < (int)sizeof(data); i++)
+	{
+		i2c1->D = expected[i];
+		i2c1->S = 0;
+		I2C1_IRQHandler();
+	}
+	check(callbacks == 1 && com.fault == I2C_NO_FAULT && !memcmp(data, expected, sizeof(data)), "I2C1 long read data");
+
+	host_dma.CERQ = 0xFF;
+	i2cReadMsg(&com);
+	PIT2_IRQHandler();
+	check(com.fault == I2C_TIMEOUT && host_dma.CERQ == 0xFF, "I2C1 timeout leaves the DMA alone");
+}
+
+int main(void)
+{
+	test_sources();
+	test_long_read();
+	test_dma_pending_flag();
+	test_short_read();
+	test_timeout();
+	test_other_bus();
+
+	return check_report();
+}
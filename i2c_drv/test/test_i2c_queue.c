@@ -0,0 +1,339 @@
+/***************************************************************************//**
+  @file     test_i2c_queue.c
+  @brief    i2cSubmit: chained transactions, aborted groups, timeouts, a full queue and a busy or stuck bus
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "i2c.h"
+#include "hardware.h"
+#include "check.h"
+#include <string.h>
+
+#define SLAVE		0x1D
+#define SDA_PIN		25		// PTE25
+
+#define PIT_LDVAL(us)		((us) * 50 - 1)	// Bus clock de 50 MHz
+#define BUS_WAIT_TICKS		(I2C_TIMEOUT_US / 10 + 1)
+#define RECOVERY_TICKS		(2 * 9 + 3 + 1)	// Un tick por paso y uno para terminar
+
+void I2C0_IRQHandler(void);
+void PIT1_IRQHandler(void);
+
+static I2C_Type * const i2c = &host_i2c[0];
+
+static int done[2 * I2C_QUEUE_LEN], done_count;
+
+#define CALLBACK(n)	static void done##n(void) { done[done_count++] = n; }
+CALLBACK(0)
+CALLBACK(1)
+CALLBACK(2)
+CALLBACK(3)
+static const pfunc callbacks[] = {done0, done1, done2, done3};
+
+// Fin de un byte en el bus: el esclavo contesta ACK o NACK
+static void byte_done(bool ack)
+{
+	i2c->S = ack ? 0 : I2C_S_RXAK_MASK;
+	I2C0_IRQHandler();
+}
+
+// El RSTA de la RAM no se limpia solo: lo leo y lo borro como haria el modulo
+static bool take_repeated_start(void)
+{
+	bool rsta = i2c->C1 & I2C_C1_RSTA_MASK;
+
+	i2c->C1 &= ~I2C_C1_RSTA_MASK;
+	return rsta;
+}
+
+static void job(I2C_COM_CONTROL * com, I2C_MODE mode, uint8_t * data, uint8_t size, uint8_t reg, int n)
+{
+	memset(com, 0, sizeof(*com));
+	com->data = data;
+	com->data_size = size;
+	com->register_address = reg;
+	com->slave_address = SLAVE;
+	com->callback = callbacks[n];
+	com->mode = mode;
+	com->channel = I2C_0;
+}
+
+// Escritura ya arrancada: direccion, registro y datos con ACK
+static void run_write(const uint8_t * expected, uint8_t size, uint8_t reg)
+{
+	uint8_t i;
+
+	check(i2c->D == (SLAVE << 1) && (i2c->C1 & I2C_C1_MST_MASK) && (i2c->C1 & I2C_C1_TX_MASK), "write address");
+	byte_done(true);
+	check(i2c->D == reg, "write register");
+	for(i = 0; i < size; i++)
+	{
+		byte_done(true);
+		check(i2c->D == expected[i], "write data");
+	}
+	byte_done(true);
+}
+
+// Lectura ya arrancada: direccion, registro, repeated START con la direccion de lectura y los datos
+static void run_read(const uint8_t * bytes, uint8_t size, uint8_t reg)
+{
+	uint8_t i;
+
+	check(i2c->D == (SLAVE << 1) && (i2c->C1 & I2C_C1_MST_MASK), "read address");
+	byte_done(true);
+	check(i2c->D == reg, "read register");
+	byte_done(true);
+	check(take_repeated_start() && i2c->D == ((SLAVE << 1) | 1), "repeated START with the read address");
+	byte_done(true);
+	check(!(i2c->C1 & I2C_C1_TX_MASK), "RX mode for the data");
+	for(i = 0; i < size; i++)
+	{
+		check(((i2c->C1 & I2C_C1_TXAK_MASK) != 0) == (i == size - 1), "NACK only on the last byte");
+		i2c->D = bytes[i];
+		byte_done(true);
+	}
+}
+
+static void reset_bus(void)
+{
+	memset(i2c, 0, sizeof(*i2c));
+	i2cInit(I2C_0, I2C_FAST_MODE);
+	*(volatile uint32_t *)&host_gpio[4].PDIR = 1U << SDA_PIN; // SDA liberada
+	done_count = 0;
+}
+
+static void test_chain(void)
+{
+	I2C_COM_CONTROL jobs[3];
+	uint8_t ctrl[] = {0x01}, data[3], expected[] = {0xA1, 0xB2, 0xC3};
+
+	reset_bus();
+	job(&jobs[0], I2C_MODE_WRITE, ctrl, 1, 0x2A, 0);
+	job(&jobs[1], I2C_MODE_READ, data, 3, 0x01, 1);
+	job(&jobs[2], I2C_MODE_WRITE, ctrl, 1, 0x2B, 2);
+	check(i2cSubmit(jobs, 3) == I2C_NO_FAULT, "group queued");
+
+	check(!take_repeated_start(), "first transaction starts with START");
+	run_write(ctrl, 1, 0x2A);
+	check(done_count == 1 && done[0] == 0 && jobs[0].fault == I2C_NO_FAULT, "first callback");
+	check(take_repeated_start() && (i2c->C1 & I2C_C1_MST_MASK), "second chained with repeated START, no STOP");
+
+	run_read(expected, 3, 0x01);
+	check(done_count == 2 && done[1] == 1 && !memcmp(data, expected, 3), "read data");
+	check(take_repeated_start() && (i2c->C1 & I2C_C1_MST_MASK) && (i2c->C1 & I2C_C1_TX_MASK),
+			"read chained back to TX without STOP");
+	check(!(i2c->C1 & I2C_C1_TXAK_MASK), "NACK cleared for the next transaction");
+
+	run_write(ctrl, 1, 0x2B);
+	check(done_count == 3 && done[2] == 2 && jobs[2].fault == I2C_NO_FAULT, "last callback");
+	check(!(i2c->C1 & I2C_C1_MST_MASK), "STOP after the last transaction");
+}
+
+static void test_abort(void)
+{
+	I2C_COM_CONTROL group[2], single;
+	uint8_t ctrl[] = {0x01}, data[2];
+	I2C_FAULT_COUNTERS counters;
+
+	reset_bus();
+	i2cResetFaultCounters(I2C_0);
+	job(&group[0], I2C_MODE_WRITE, ctrl, 1, 0x2A, 0);
+	job(&group[1], I2C_MODE_READ, data, 2, 0x01, 1);
+	job(&single, I2C_MODE_WRITE, ctrl, 1, 0x2C, 2);
+	i2cSubmit(group, 2);
+	check(i2cSubmit(&single, 1) == I2C_NO_FAULT, "second group queued behind the first");
+
+	// NACK a la direccion: el resto del grupo se aborta, el otro grupo sale con un START nuevo
+	byte_done(false);
+	check(group[0].fault == I2C_SLAVE_ERROR && group[1].fault == I2C_ABORTED, "rest of the group aborted");
+	check(done_count == 2 && done[0] == 1 && done[1] == 0, "aborted callbacks called before the failed one");
+	check(!take_repeated_start() && (i2c->C1 & I2C_C1_MST_MASK), "next group starts with a new START");
+	run_write(ctrl, 1, 0x2C);
+	check(done_count == 3 && single.fault == I2C_NO_FAULT, "next group unaffected");
+
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.slave_errors == 1 && counters.aborted == 1 && counters.timeouts == 0, "fault counters");
+}
+
+static void test_timeout(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t data[2];
+	I2C_FAULT_COUNTERS counters;
+
+	reset_bus();
+	i2cResetFaultCounters(I2C_0);
+	job(&com, I2C_MODE_READ, data, 2, 0x01, 3);
+	i2cSubmit(&com, 1);
+	check(host_pit.CHANNEL[1].TCTRL == (PIT_TCTRL_TEN_MASK | PIT_TCTRL_TIE_MASK), "PIT1 armed for the timeout");
+	check(host_pit.CHANNEL[1].LDVAL == PIT_LDVAL(I2C_TIMEOUT_US), "timeout length");
+	byte_done(true);
+
+	// El esclavo no contesta mas
+	PIT1_IRQHandler();
+	check(com.fault == I2C_TIMEOUT && done_count == 1 && done[0] == 3, "timeout reported");
+	check(!(i2c->C1 & I2C_C1_MST_MASK) && host_pit.CHANNEL[1].TCTRL == 0, "STOP and PIT off after a timeout");
+	PIT1_IRQHandler();
+	check(done_count == 1, "late PIT interrupt ignored");
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.timeouts == 1 && counters.recoveries == 0, "timeout counted without recovery");
+}
+
+static void test_queue_full(void)
+{
+	static I2C_COM_CONTROL jobs[I2C_QUEUE_LEN + 1];
+	uint8_t ctrl[] = {0x01};
+	int i;
+
+	reset_bus();
+	for(i = 0; i < I2C_QUEUE_LEN + 1; i++)
+		job(&jobs[i], I2C_MODE_WRITE, ctrl, 1, i, 0);
+	check(i2cSubmit(jobs, 0) == I2C_QUEUE_FULL, "empty submit rejected");
+	check(i2cSubmit(jobs, I2C_QUEUE_LEN + 1) == I2C_QUEUE_FULL && i2c->D == 0, "oversized group rejected whole");
+	check(i2cSubmit(jobs, I2C_QUEUE_LEN - 1) == I2C_NO_FAULT, "group queued");
+	check(i2cSubmit(&jobs[I2C_QUEUE_LEN - 1], 2) == I2C_QUEUE_FULL, "group larger than the free space rejected");
+	check(i2cSubmit(&jobs[I2C_QUEUE_LEN - 1], 1) == I2C_NO_FAULT, "last free slot used");
+
+	// i2cWriteMsg con la cola llena termina enseguida con BUS_BUSY
+	done_count = 0;
+	job(&jobs[I2C_QUEUE_LEN], I2C_MODE_WRITE, ctrl, 1, 0, 1);
+	i2cWriteMsg(&jobs[I2C_QUEUE_LEN]);
+	check(jobs[I2C_QUEUE_LEN].fault == I2C_BUS_BUSY && done_count == 1 && done[0] == 1, "i2cWriteMsg on a full queue");
+
+	for(i = 0; i < I2C_QUEUE_LEN; i++)
+		run_write(ctrl, 1, i);
+	check(done_count == 1 + I2C_QUEUE_LEN && !(i2c->C1 & I2C_C1_MST_MASK), "whole queue served in order");
+}
+
+static void test_blocking_while_queued(void)
+{
+	I2C_COM_CONTROL com;
+	uint8_t ctrl[] = {0x01}, data[2];
+	I2C_FAULT_COUNTERS counters;
+	uint32_t tctrl;
+
+	reset_bus();
+	i2cResetFaultCounters(I2C_0);
+	job(&com, I2C_MODE_WRITE, ctrl, 1, 0x2A, 0);
+	i2cSubmit(&com, 1);
+	tctrl = host_pit.CHANNEL[1].TCTRL;
+	i2c->S = I2C_S_TCF_MASK; // IICIF de la transaccion en curso todavia sin atender
+
+	// Las bloqueantes no pueden tocar el PIT ni el flag de la transaccion en curso
+	check(i2cWriteMsgBlocking(I2C_0, ctrl, 1, 0x2B, SLAVE) == I2C_BUS_BUSY, "blocking write while queued");
+	check(i2cReadMsgBlocking(I2C_0, data, 2, 0x01, SLAVE) == I2C_BUS_BUSY, "blocking read while queued");
+	check(host_pit.CHANNEL[1].TCTRL == tctrl && i2c->S == I2C_S_TCF_MASK, "queued transaction untouched");
+	check(NVIC_GetEnableIRQ(I2C0_IRQn) && NVIC_GetEnableIRQ(PIT1_IRQn), "interrupts enabled again");
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.bus_busy == 0, "busy queue not counted as a bus fault");
+
+	i2c->S = 0;
+	run_write(ctrl, 1, 0x2A);
+	check(done_count == 1 && com.fault == I2C_NO_FAULT, "queued transaction finishes");
+}
+
+static void tick(int n)
+{
+	while(n--)
+		PIT1_IRQHandler();
+}
+
+// Un START con el bus todavia ocupado no se espera en la ISR del I2C: lo larga el PIT
+static void test_bus_wait(void)
+{
+	I2C_COM_CONTROL first, second;
+	uint8_t ctrl[] = {0x01};
+	I2C_FAULT_COUNTERS counters;
+
+	reset_bus();
+	i2cResetFaultCounters(I2C_0);
+	job(&first, I2C_MODE_WRITE, ctrl, 1, 0x2A, 0);
+	job(&second, I2C_MODE_WRITE, ctrl, 1, 0x2B, 1);
+	i2cSubmit(&first, 1);
+	i2cSubmit(&second, 1);
+
+	// NACK a la direccion y el STOP todavia no salio cuando arranca la siguiente
+	i2c->D = 0;
+	i2c->S = I2C_S_RXAK_MASK | I2C_S_BUSY_MASK;
+	I2C0_IRQHandler();
+	check(done_count == 1 && first.fault == I2C_SLAVE_ERROR, "first transaction failed");
+	check(!(i2c->C1 & I2C_C1_MST_MASK) && i2c->D == 0, "no START while the bus is busy");
+	check(host_pit.CHANNEL[1].LDVAL == PIT_LDVAL(10) && (host_pit.CHANNEL[1].TCTRL & PIT_TCTRL_TIE_MASK),
+			"PIT polls the bus");
+	tick(3);
+	check(!(i2c->C1 & I2C_C1_MST_MASK), "still waiting");
+
+	i2c->S = 0;
+	tick(1);
+	check(!take_repeated_start() && (i2c->C1 & I2C_C1_MST_MASK), "START once the bus is free");
+	check(host_pit.CHANNEL[1].LDVAL == PIT_LDVAL(I2C_TIMEOUT_US), "PIT back to the transaction timeout");
+	run_write(ctrl, 1, 0x2B);
+	check(done_count == 2 && second.fault == I2C_NO_FAULT, "second transaction done");
+
+	// El bus no se libera nunca, con SDA suelta: BUS_BUSY sin recuperar
+	i2cSubmit(&first, 1);
+	i2cSubmit(&second, 1);
+	i2c->S = I2C_S_RXAK_MASK | I2C_S_BUSY_MASK;
+	I2C0_IRQHandler();
+	tick(BUS_WAIT_TICKS);
+	check(done_count == 4 && second.fault == I2C_BUS_BUSY && host_pit.CHANNEL[1].TCTRL == 0, "bus busy reported");
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.bus_busy == 1 && counters.recoveries == 0, "bus busy counted without recovery");
+}
+
+// SDA trabada: la recuperacion va de a un paso por tick del PIT y despues sale la transaccion
+static void test_recovery(void)
+{
+	I2C_COM_CONTROL first, second;
+	uint8_t ctrl[] = {0x01};
+	I2C_FAULT_COUNTERS counters;
+
+	reset_bus();
+	i2cResetFaultCounters(I2C_0);
+	job(&first, I2C_MODE_WRITE, ctrl, 1, 0x2A, 0);
+	job(&second, I2C_MODE_WRITE, ctrl, 1, 0x2B, 1);
+	i2cSubmit(&first, 1);
+	i2cSubmit(&second, 1);
+	*(volatile uint32_t *)&host_gpio[4].PDIR = 0;
+	i2c->S = I2C_S_RXAK_MASK | I2C_S_BUSY_MASK;
+	I2C0_IRQHandler();
+	tick(BUS_WAIT_TICKS);
+	check(host_pit.CHANNEL[1].LDVAL == PIT_LDVAL(5) && !(i2c->C1 & I2C_C1_IICEN_MASK), "recovery started by the PIT");
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.recoveries == 0 && done_count == 1, "recovery not done in one go");
+
+	tick(RECOVERY_TICKS - 1);
+	check(!(i2c->C1 & I2C_C1_IICEN_MASK), "recovery still running");
+	*(volatile uint32_t *)&host_gpio[4].PDIR = 1U << SDA_PIN;
+	i2c->S = 0;
+	tick(1);
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.recoveries == 1 && (i2c->C1 & I2C_C1_IICEN_MASK), "recovery finished");
+	check(i2c->C1 & I2C_C1_MST_MASK, "same transaction started after the recovery");
+	run_write(ctrl, 1, 0x2B);
+	check(done_count == 2 && second.fault == I2C_NO_FAULT, "transaction done after the recovery");
+
+	// Timeout con SDA trabada y nada en la cola: la recuperacion tampoco bloquea el PIT
+	i2cSubmit(&first, 1);
+	byte_done(true);
+	*(volatile uint32_t *)&host_gpio[4].PDIR = 0;
+	tick(1);
+	check(first.fault == I2C_TIMEOUT && host_pit.CHANNEL[1].LDVAL == PIT_LDVAL(5), "recovery after a timeout");
+	check(i2cWriteMsgBlocking(I2C_0, ctrl, 1, 0x2B, SLAVE) == I2C_BUS_BUSY, "blocking call refused while recovering");
+	tick(RECOVERY_TICKS);
+	i2cGetFaultCounters(I2C_0, &counters);
+	check(counters.recoveries == 2 && host_pit.CHANNEL[1].TCTRL == 0, "recovery after a timeout finished");
+}
+
+int main(void)
+{
+	test_chain();
+	test_abort();
+	test_timeout();
+	test_queue_full();
+	test_blocking_while_queued();
+	test_bus_wait();
+	test_recovery();
+
+	return check_report();
+}
@@ -65,6 +65,20 @@ const char MqttClientID[]="";
 WiFiClient wclient;
 PubSubClient client(wclient);
 
+// Estados de la conexion. setup_wifi()/reconnect() avanzan un paso por loop(); solo client.connect bloquea, con tope
+typedef enum {LINK_WIFI_START, LINK_WIFI_WAIT, LINK_MQTT_CONNECT, LINK_MQTT_BACKOFF, LINK_CONNECTED} LinkState;
+
+#define WIFI_TIMEOUT_MS         10000   // Sin IP en este tiempo: se reintenta WiFi.begin
+#define MQTT_BACKOFF_MIN_MS     500
+#define MQTT_BACKOFF_MAX_MS     30000
+#define MQTT_SOCKET_TIMEOUT_S   2       // Tope de la espera del CONNACK en client.connect
+#define MQTT_TCP_TIMEOUT_MS     2000    // Tope del connect TCP que hace client.connect
+// client.connect igual bloquea loop() hasta MQTT_TCP_TIMEOUT_MS + MQTT_SOCKET_TIMEOUT_S
+
+LinkState linkState = LINK_WIFI_START;
+unsigned long linkStateMillis;
+unsigned long mqttBackoff = MQTT_BACKOFF_MIN_MS;
+
 void setup_gpios(void);
 void setup_wifi(void);    
 void setup_mqtt(void);
@@ -88,6 +102,7 @@ void reconnect(void);
 void publish_init_state(void);
 void callback(char* topic, byte* payload, unsigned int length);
 void ParseTopic(char* topic, byte* payload, unsigned int length);
+void link_set_state(LinkState state);
 
 void setup() 
 {
@@ -99,15 +114,15 @@ void setup()
 
 void loop() 
 {
-  if (!client.connected()) 
+  reconnect();    // Non-blocking
+  if (linkState == LINK_CONNECTED)
   {
-      reconnect();    
+    client.loop();  //This should be called regularly to allow the client to process incoming messages and maintain its connection to the server
   }
-  client.loop();  //This should be called regularly to allow the client to process incoming messages and maintain its connection to the server
   if (2000 < (millis()-lastMillis)) 
   {
     lastMillis = millis(); 
-    if(debug)
+    if(debug && linkState == LINK_CONNECTED)
     {
     client.publish("holaTopic","holaaaa",false);
     }
@@ -130,52 +145,93 @@ void setup_mqtt(void)
 {
  client.setServer(MqttServer, MqttPort);
  client.setCallback(callback);
+ client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+ wclient.setTimeout(MQTT_TCP_TIMEOUT_MS);
 }
 
 void setup_wifi(void) 
 {
-  debug_message("\n\n");
+  linkState = LINK_WIFI_START;
+}
+
+
+void link_set_state(LinkState state)
+{
+  linkState = state;
+  linkStateMillis = millis();
+}
+
+
+void reconnect() 
+{
+ if (linkState != LINK_WIFI_START && linkState != LINK_WIFI_WAIT && WiFi.status() != WL_CONNECTED)
+ {
+  debug_message("WiFi lost\r\n");
+  digitalWrite(External_LED,External_LED_OFF);
+  link_set_state(LINK_WIFI_START);
+ }
+
+ switch (linkState)
+ {
+ case LINK_WIFI_START:
   debug_message("Connecting to ");
   debug_message(ssid);
   debug_message("\n");
   WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) 
+  link_set_state(LINK_WIFI_WAIT);
+  break;
+
+ case LINK_WIFI_WAIT:
+  if (WiFi.status() == WL_CONNECTED)
   {
-    delay(500);
-    debug_message(".");
+   debug_message("WiFi connected\r\n");
+   digitalWrite(External_LED,External_LED_ON); // WIFI is OK
+   mqttBackoff = MQTT_BACKOFF_MIN_MS;
+   link_set_state(LINK_MQTT_CONNECT);
   }
- debug_message("\nWiFi connected");  
- debug_message("IP address: ");
- debug_message(WiFi.localIP());
- debug_message("\n\n");
- digitalWrite(External_LED,External_LED_ON); // WIFI is OK
-}
+  else if (millis() - linkStateMillis > WIFI_TIMEOUT_MS)
+  {
+   WiFi.disconnect();
+   link_set_state(LINK_WIFI_START);
+  }
+  break;
 
+ case LINK_MQTT_CONNECT:
+  debug_message("Attempting MQTT connection...");
+  if (client.connect(MqttClientID,MqttUser,MqttPassword)) 
+  {
+   debug_message("connected \r\n");
+   //subscribe to topic
+   client.subscribe("myTopic");
+   client.subscribe("play"); 
+   client.subscribe("pause"); 
+   client.subscribe("level");  
+   mqttBackoff = MQTT_BACKOFF_MIN_MS;
+   link_set_state(LINK_CONNECTED);
+  } 
+  else 
+  {
+   debug_message("failed, rc=");
+   debug_message(client.state());
+   debug_message("\r\n");
+   link_set_state(LINK_MQTT_BACKOFF);
+  }
+  break;
 
-void reconnect() 
-{
- // Loop until we're reconnected
- while (!client.connected()) 
- {
- debug_message("Attempting MQTT connection...");
- // Attempt to connect
- if (client.connect(MqttClientID,MqttUser,MqttPassword)) 
- {
-  debug_message("connected \r\n");
-  //subscribe to topic
-  client.subscribe("myTopic");
-  client.subscribe("play"); 
-  client.subscribe("pause"); 
-  client.subscribe("level");  
- } 
- else 
- {
-  debug_message("failed, rc=");
-  debug_message(client.state());
-  debug_message(" try again in 3 seconds \r\n");
-  // Wait before retrying
-  delay(3000);
+ case LINK_MQTT_BACKOFF:
+  if (millis() - linkStateMillis >= mqttBackoff)
+  {
+   mqttBackoff = (mqttBackoff * 2 > MQTT_BACKOFF_MAX_MS)? MQTT_BACKOFF_MAX_MS : mqttBackoff * 2;
+   link_set_state(LINK_MQTT_CONNECT);
+  }
+  break;
+
+ case LINK_CONNECTED:
+  if (!client.connected())
+  {
+   link_set_state(LINK_MQTT_CONNECT);
   }
+  break;
  }
 }
 
@@ -0,0 +1,171 @@
+/*******************************************************************************
+  @file     batcher.c
+  @brief    Batching and coalescing of UART samples before publishing them to MQTT
+  @author   Grupo 2
+ ******************************************************************************/
+
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include "batcher.h"
+#include <string.h>
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef struct {
+	uint8_t data[BATCH_MAX_BYTES];
+	size_t len;
+	size_t last;						// Donde empieza la ultima muestra, para detectar repetidas
+	uint32_t arrival[BATCH_MAX_SAMPLES];
+	uint8_t samples;
+} batch_t;
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES FOR PRIVATE FUNCTIONS WITH FILE LEVEL SCOPE
+ ******************************************************************************/
+
+static void batcher_flush(uint8_t topic_id, uint32_t now_ms);
+static uint32_t batcher_percentile(uint32_t per_thousand);
+
+/*******************************************************************************
+ * PRIVATE VARIABLES WITH FILE LEVEL SCOPE
+ ******************************************************************************/
+
+static batch_t batches[BATCH_MAX_TOPICS];
+static uint32_t window;
+static size_t window_len;
+static batch_flush_t flush_fn;
+
+static batch_stats_t stats;
+static uint32_t histogram[BATCH_HIST_BUCKETS];
+static uint32_t histogram_total;
+
+/*******************************************************************************
+ *                        GLOBAL FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+void batcher_init(uint32_t window_ms, size_t window_bytes, batch_flush_t flush)
+{
+	window = window_ms;
+	window_len = (window_bytes > BATCH_MAX_BYTES)?(BATCH_MAX_BYTES):(window_bytes);
+	flush_fn = flush;
+	memset(batches, 0, sizeof(batches));
+	memset(&stats, 0, sizeof(stats));
+	memset(histogram, 0, sizeof(histogram));
+	histogram_total = 0;
+}
+
+
+bool batcher_add(uint8_t topic_id, const uint8_t * payload, uint8_t len, uint32_t now_ms)
+{
+	batch_t * b;
+
+	if(topic_id >= BATCH_MAX_TOPICS || len + 1 > BATCH_MAX_BYTES)
+	{
+		stats.dropped++;
+		return false;
+	}
+	b = &batches[topic_id];
+
+	// Igual a la muestra anterior: no agrega informacion
+	if(b->samples != 0 && b->data[b->last] == len && !memcmp(&b->data[b->last + 1], payload, len))
+	{
+		stats.coalesced++;
+		return true;
+	}
+
+	// No entra: publico lo que habia y arranco otra ventana
+	if(b->len + len + 1 > BATCH_MAX_BYTES || b->samples == BATCH_MAX_SAMPLES)
+		batcher_flush(topic_id, now_ms);
+
+	b->last = b->len;
+	b->data[b->len++] = len;
+	memcpy(&b->data[b->len], payload, len);
+	b->len += len;
+	b->arrival[b->samples++] = now_ms;
+	stats.samples++;
+
+	if(b->len >= window_len)
+		batcher_flush(topic_id, now_ms);
+	return true;
+}
+
+
+void batcher_poll(uint32_t now_ms)
+{
+	uint8_t i;
+
+	for(i = 0; i < BATCH_MAX_TOPICS; i++)
+	{
+		if(batches[i].samples != 0 && (now_ms - batches[i].arrival[0]) >= window)
+			batcher_flush(i, now_ms);
+	}
+}
+
+
+void batcher_flush_all(uint32_t now_ms)
+{
+	uint8_t i;
+
+	for(i = 0; i < BATCH_MAX_TOPICS; i++)
+		batcher_flush(i, now_ms);
+}
+
+
+void batcher_get_stats(batch_stats_t * out)
+{
+	stats.p50_ms = batcher_percentile(500);
+	stats.p90_ms = batcher_percentile(900);
+	stats.p99_ms = batcher_percentile(990);
+	*out = stats;
+}
+
+
+/*******************************************************************************
+ *                       LOCAL FUNCTION DEFINITIONS
+ ******************************************************************************/
+
+static void batcher_flush(uint8_t topic_id, uint32_t now_ms)
+{
+	batch_t * b = &batches[topic_id];
+	uint32_t latency, bucket;
+	uint8_t i;
+
+	if(b->samples == 0)
+		return;
+
+	if(flush_fn != NULL)
+		flush_fn(topic_id, b->data, b->len);
+	stats.publishes++;
+
+	for(i = 0; i < b->samples; i++)
+	{
+		latency = now_ms - b->arrival[i];
+		bucket = latency / BATCH_HIST_STEP_MS;
+		histogram[(bucket < BATCH_HIST_BUCKETS)?(bucket):(BATCH_HIST_BUCKETS - 1)]++;
+		histogram_total++;
+	}
+	b->len = 0;
+	b->samples = 0;
+}
+
+static uint32_t batcher_percentile(uint32_t per_thousand)
+{
+	uint32_t target = (uint32_t)(((uint64_t)histogram_total * per_thousand + 999) / 1000);
+	uint32_t count = 0;
+	uint8_t i;
+
+	if(histogram_total == 0)
+		return 0;
+	for(i = 0; i < BATCH_HIST_BUCKETS; i++)
+	{
+		count += histogram[i];
+		if(count >= target)
+			break;
+	}
+	return (i + 1) * BATCH_HIST_STEP_MS; // Cota superior de la barra
+}
@@ -0,0 +1,106 @@
+/***************************************************************************//**
+  @file     batcher.h
+  @brief    Batching and coalescing of UART samples before publishing them to MQTT
+  @author   Grupo 2
+ ******************************************************************************/
+
+#ifndef _BATCHER_H_
+#define _BATCHER_H_
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+/*
+ * Las muestras de cada topic se juntan en un solo publish por ventana. Cada muestra
+ * va precedida por su largo:  len0 | muestra0 | len1 | muestra1 | ...
+ * Una muestra igual a la anterior del mismo topic no se vuelve a agregar.
+ * El reloj lo pasa el que llama, asi se puede usar millis() o un reloj falso.
+ */
+
+#define BATCH_MAX_TOPICS	16
+#define BATCH_MAX_BYTES		128		// Por topic, entra en un paquete de PubSubClient
+#define BATCH_MAX_SAMPLES	32		// Por topic y por ventana
+
+#define BATCH_HIST_STEP_MS	8		// Ancho de cada barra del histograma de latencia
+#define BATCH_HIST_BUCKETS	64		// La ultima barra junta todo lo que supera el rango
+
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef void (*batch_flush_t)(uint8_t topic_id, const uint8_t * payload, size_t len);
+
+typedef struct {
+	uint32_t samples;		// Muestras agregadas a algun batch
+	uint32_t coalesced;		// Muestras repetidas que no se agregaron
+	uint32_t dropped;		// Muestras que no entraron
+	uint32_t publishes;
+	uint32_t p50_ms;		// Latencia desde que llega la muestra hasta que se publica
+	uint32_t p90_ms;
+	uint32_t p99_ms;
+} batch_stats_t;
+
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+/**
+ * @brief Initialize the batcher. Discards anything pending and clears the statistics
+ * @param window_ms Maximum time a sample waits before being published
+ * @param window_bytes A topic is published as soon as it gathers this many bytes (up to BATCH_MAX_BYTES)
+ * @param flush Called with every batch to publish
+*/
+void batcher_init(uint32_t window_ms, size_t window_bytes, batch_flush_t flush);
+
+/**
+ * @brief Add a sample to the batch of its topic
+ * @param topic_id Topic of the sample, less than BATCH_MAX_TOPICS
+ * @param payload Sample bytes
+ * @param len Quantity of bytes, up to 255
+ * @param now_ms Current time
+ * @return The sample was added or coalesced (false if dropped)
+*/
+bool batcher_add(uint8_t topic_id, const uint8_t * payload, uint8_t len, uint32_t now_ms);
+
+/**
+ * @brief Publish every batch whose window expired. Call it periodically
+ * @param now_ms Current time
+*/
+void batcher_poll(uint32_t now_ms);
+
+/**
+ * @brief Publish every pending batch right away
+ * @param now_ms Current time
+*/
+void batcher_flush_all(uint32_t now_ms);
+
+/**
+ * @brief Get the counters and latency percentiles since batcher_init
+ * @param stats Where to store them
+*/
+void batcher_get_stats(batch_stats_t * stats);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
+
+#endif // _BATCHER_H_
@@ -0,0 +1,123 @@
+/***************************************************************************//**
+  @file     bridge.h
+  @brief    MQTT topic multiplexing over the Kinetis <-> ESP8266 framed link
+  @author   Grupo 2
+ ******************************************************************************/
+
+#ifndef _BRIDGE_H_
+#define _BRIDGE_H_
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include "frame.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+/*
+ * Cada lado le pone un id chico a los topics que publica y se lo anuncia al otro
+ * una sola vez con un BIND (id, nombre). Despues solo viajan PUBLISH (id, datos):
+ * el que recibe despacha indexando su tabla con el id, sin comparar strings.
+ * Los ids de cada lado son independientes.
+ */
+
+#define BRIDGE_MAX_TOPICS		16
+#define BRIDGE_MAX_TOPIC_LEN	32	// Con el terminador
+#define BRIDGE_MAX_PAYLOAD		(FRAME_MAX_PAYLOAD - 1)
+#define BRIDGE_INVALID_ID		0xFF
+
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef void (*bridge_send_t)(const uint8_t * data, size_t len);
+typedef void (*bridge_handler_t)(uint8_t topic_id, const uint8_t * payload, uint8_t len);
+
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+/**
+ * @brief Initialize the bridge. Forgets every topic
+ * @param send Function that writes the already framed bytes on the link
+ * @param default_handler Called for topics published by the other side without a handler. May be NULL
+*/
+void bridge_init(bridge_send_t send, bridge_handler_t default_handler);
+
+/**
+ * @brief Register a topic this side publishes and announce it to the other side
+ * @param name Topic name. Registering it again returns the same id
+ * @return Topic id to use with bridge_publish, BRIDGE_INVALID_ID if the table is full
+*/
+uint8_t bridge_bind(const char * name);
+
+/**
+ * @brief Find the id of a topic registered with bridge_bind
+ * @param name Topic name
+ * @return Topic id, BRIDGE_INVALID_ID if it wasn't registered
+*/
+uint8_t bridge_find(const char * name);
+
+/**
+ * @brief Send a message on a topic registered with bridge_bind
+ * @param topic_id Id returned by bridge_bind
+ * @param payload Message bytes
+ * @param len Quantity of bytes, up to BRIDGE_MAX_PAYLOAD
+ * @return The message was sent
+*/
+bool bridge_publish(uint8_t topic_id, const uint8_t * payload, uint8_t len);
+
+/**
+ * @brief Set the handler for a topic published by the other side
+ * @param name Topic name. The name is compared only once, when the other side announces it
+ * @param handler Called with every message on that topic
+ * @return The handler was registered
+*/
+bool bridge_on_topic(const char * name, bridge_handler_t handler);
+
+/**
+ * @brief Get the name of a topic published by the other side
+ * @param topic_id Id received with the message
+ * @return Topic name, NULL if it wasn't announced
+*/
+const char * bridge_remote_name(uint8_t topic_id);
+
+/**
+ * @brief Announce again every topic of this side, e.g. after the other side restarted
+*/
+void bridge_rebind_all(void);
+
+/**
+ * @brief Ask the other side to announce its topics again
+*/
+void bridge_request_binds(void);
+
+/**
+ * @brief Process a received frame. Meant to be used as (or called from) the frame_decode callback
+ * @param type Frame type
+ * @param payload Frame payload
+ * @param len Quantity of payload bytes
+*/
+void bridge_handle_frame(uint8_t type, const uint8_t * payload, uint8_t len);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
+
+#endif // _BRIDGE_H_
@@ -0,0 +1,113 @@
+/***************************************************************************//**
+  @file     frame.h
+  @brief    Framing for the Kinetis <-> ESP8266 UART link. COBS + CRC16
+  @author   Grupo 2
+ ******************************************************************************/
+
+#ifndef _FRAME_H_
+#define _FRAME_H_
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+/*
+ * Trama en el cable:  COBS( type | len | payload[len] | crc16_hi | crc16_lo ) | 0x00
+ * El CRC16-CCITT (0x1021, inicial 0xFFFF) cubre type, len y payload.
+ */
+
+#define FRAME_DELIMITER		0x00
+#define FRAME_MAX_PAYLOAD	64
+#define FRAME_HEADER_LEN	2	// type + len
+#define FRAME_CRC_LEN		2
+#define FRAME_RAW_LEN(n)	(FRAME_HEADER_LEN + (n) + FRAME_CRC_LEN)
+#define FRAME_ENCODED_LEN(n) (FRAME_RAW_LEN(n) + FRAME_RAW_LEN(n) / 254 + 2) // Peor caso de COBS + delimitador
+
+
+/*******************************************************************************
+ * ENUMERATIONS AND STRUCTURES AND TYPEDEFS
+ ******************************************************************************/
+
+typedef enum frame_type_t {
+	FRAME_TYPE_ACK = 0x03,	// Mismo valor que el byte suelto que se usaba antes
+	FRAME_TYPE_POLL = 0x04,
+	FRAME_TYPE_DATA = 0x10,
+	FRAME_TYPE_BIND = 0x20,			// payload: topic_id | nombre del topic
+	FRAME_TYPE_PUBLISH = 0x21,		// payload: topic_id | datos
+	FRAME_TYPE_BIND_REQUEST = 0x22	// Pide al otro lado que reenvie todos sus BIND
+} frame_type_t;
+
+typedef void (*frame_callback_t)(uint8_t type, const uint8_t * payload, uint8_t len);
+
+typedef struct {
+	uint8_t raw[FRAME_RAW_LEN(FRAME_MAX_PAYLOAD)];	// Trama ya decodificada
+	uint16_t index;
+	uint8_t code;		// Codigo COBS del bloque actual
+	uint8_t remaining;	// Bytes que faltan del bloque actual
+	bool discard;		// Se descarta hasta el proximo delimitador
+	uint32_t frames_ok;
+	uint32_t frames_error;
+} frame_decoder_t;
+
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+/**
+ * @brief Compute the CRC16-CCITT of a buffer
+ * @param crc Initial value (0xFFFF for a new CRC, or the previous result to continue it)
+ * @param data Bytes to process
+ * @param len Quantity of bytes
+ * @return Updated CRC
+*/
+uint16_t frame_crc16(uint16_t crc, const uint8_t * data, size_t len);
+
+/**
+ * @brief Build a complete frame, ready to be sent
+ * @param type Message type
+ * @param payload Message bytes. May be NULL if len is 0
+ * @param len Quantity of payload bytes, up to FRAME_MAX_PAYLOAD
+ * @param out Where to write the frame, including the delimiter
+ * @param out_size Size of out. FRAME_ENCODED_LEN(len) is always enough
+ * @return Quantity of bytes written, 0 if the frame doesn't fit
+*/
+size_t frame_encode(uint8_t type, const uint8_t * payload, uint8_t len, uint8_t * out, size_t out_size);
+
+/**
+ * @brief Start a decoder. The first frame is accepted without a leading delimiter; a partial one counts as an error
+ * @param dec Decoder to initialize
+*/
+void frame_decoder_init(frame_decoder_t * dec);
+
+/**
+ * @brief Feed received bytes to a decoder. Can be called with any chunk of the stream
+ * @param dec Decoder
+ * @param data Received bytes
+ * @param len Quantity of bytes
+ * @param callback Called with every valid frame. The payload is only valid during the call
+ * @return Quantity of valid frames found
+*/
+uint16_t frame_decode(frame_decoder_t * dec, const uint8_t * data, size_t len, frame_callback_t callback);
+
+
+#ifdef __cplusplus
+}
+#endif
+
+/*******************************************************************************
+ ******************************************************************************/
+
+#endif // _FRAME_H_
@@ -11,6 +11,9 @@
 
 #include <ESP8266WiFi.h>
 #include <PubSubClient.h> 
+#include "frame.h"
+#include "bridge.h"
+#include "batcher.h"
 
 unsigned long  lastMillis;
 
@@ -68,6 +71,49 @@ const char MqttClientID[]="";
 WiFiClient wclient;
 PubSubClient client(wclient);
 
+// Topics de MQTT que se reenvian a la Kinetis. Cada uno recibe un id del bridge
+const char * const SubscribedTopics[] = {"myTopic", "play", "pause", "level", "player", "start", "end"};
+#define SUBSCRIBED_TOPICS_COUNT (sizeof(SubscribedTopics) / sizeof(SubscribedTopics[0]))
+
+frame_decoder_t uart_decoder;
+
+// Las muestras de la Kinetis se juntan en un publish por topic cada BATCH_WINDOW_MS o BATCH_WINDOW_BYTES
+#define BATCH_WINDOW_MS     200
+#define BATCH_WINDOW_BYTES  100
+
+// Estados de la conexion. setup_wifi()/reconnect() no bloquean: avanzan un paso por loop()
+typedef enum {LINK_WIFI_START, LINK_WIFI_WAIT, LINK_MQTT_CONNECT, LINK_MQTT_BACKOFF, LINK_CONNECTED} LinkState;
+
+#define WIFI_TIMEOUT_MS         10000   // Sin IP en este tiempo: se reintenta WiFi.begin
+#define MQTT_BACKOFF_MIN_MS     500
+#define MQTT_BACKOFF_MAX_MS     30000
+#define MQTT_SOCKET_TIMEOUT_S   1       // Tope de la espera del CONNACK en client.connect
+#define MQTT_TCP_TIMEOUT_MS     1000    // Tope del connect TCP que hace client.connect
+// client.connect bloquea hasta MQTT_TCP_TIMEOUT_MS + MQTT_SOCKET_TIMEOUT_S sin leer el UART:
+// a 9600 baudios son ~1920 bytes, que tienen que entrar en el buffer de RX (el default es 256)
+#define SERIAL_RX_BUFFER_LEN    2048
+
+LinkState linkState = LINK_WIFI_START;
+unsigned long linkStateMillis;
+unsigned long mqttBackoff = MQTT_BACKOFF_MIN_MS;
+
+// Lo que no se pudo publicar sin conexion se guarda aca y sale desde loop() con conexion. Lleno: se pisa lo mas viejo
+#define STORE_FORWARD_LEN         16
+#define STORE_FORWARD_MAX_TRIES   3     // Un publish que falla tantas veces con conexion no va a salir: se descarta
+
+typedef struct {
+  uint8_t topicId;
+  uint8_t len;
+  uint8_t tries;
+  uint8_t data[BATCH_MAX_BYTES];
+} StoredPublish;
+
+StoredPublish storeForward[STORE_FORWARD_LEN];
+unsigned int storeForwardHead, storeForwardCount;
+unsigned long storeForwardDropped;
+
+unsigned long bridgeRejected;   // Mensajes de MQTT descartados por no entrar en una trama
+
 void setup_gpios(void);
 void setup_wifi(void);    
 void setup_mqtt(void);
@@ -84,45 +130,51 @@ void ParseTopic(char* topic, byte* payload, unsigned int length);
 #define External_LED_ON   1
 #define SERIAL_TERM  "\n"
 
-void setup_gpios(void);
-void setup_wifi(void);    
-void setup_mqtt(void);
-void reconnect(void); 
-void publish_init_state(void);
-void callback(char* topic, byte* payload, unsigned int length);
-void ParseTopic(char* topic, byte* payload, unsigned int length);
+void setup_bridge(void);
+void uart_send(const uint8_t * data, size_t len);
+void forward_to_mqtt(uint8_t topic_id, const uint8_t * payload, uint8_t len);
+void publish_batch(uint8_t topic_id, const uint8_t * payload, size_t len);
+void publish_batch_stats(void);
+void link_set_state(LinkState state);
+void store_forward_push(uint8_t topic_id, const uint8_t * payload, size_t len);
+void store_forward_flush(void);
 
 void setup() 
 {
   //Serial.begin(115200);
+  Serial.setRxBufferSize(SERIAL_RX_BUFFER_LEN); // Antes de begin
   Serial.begin(9600, SERIAL_8N1);
   Serial.swap();  
   Serial1.begin(115200);
   Serial1.setDebugOutput(true);
   setup_gpios();         // initialize used GPIOS
+  setup_bridge();        // initialize UART framing and topic ids
   setup_wifi();          // initialize WIFI an connect to network
   setup_mqtt();          // initialize mqtt server
 }
 
 void loop() 
 {
-  if (!client.connected()) 
+  reconnect();    // Non-blocking: the UART keeps being read while reconnecting
+  if (linkState == LINK_CONNECTED)
   {
-      reconnect();    
+    client.loop();  //This should be called regularly to allow the client to process incoming messages and maintain its connection to the server
+    store_forward_flush();
   }
-  client.loop();  //This should be called regularly to allow the client to process incoming messages and maintain its connection to the server
   byte serin = 0;
-  if (Serial.available()>0)
+  while (Serial.available()>0)
   {
     serin=Serial.read();
-    client.publish("fromUART","hello from UART",false);
+    frame_decode(&uart_decoder, &serin, 1, bridge_handle_frame); // Los PUBLISH de la Kinetis salen por forward_to_mqtt
   }
+  batcher_poll(millis());
   if (2000 < (millis()-lastMillis)) 
   {
     lastMillis = millis(); 
-    if(debug)
+    if(debug && linkState == LINK_CONNECTED)
     {
     client.publish("holaTopic","holaaaa",false);
+    publish_batch_stats();
     //Serial.write(3);
     }
   }
@@ -138,100 +190,214 @@ void setup_gpios(void )
 }
 
 
-void setup_mqtt(void) 
+void setup_bridge(void)
 {
- client.setServer(MqttServer, MqttPort);
- client.setCallback(callback);
+  frame_decoder_init(&uart_decoder);
+  batcher_init(BATCH_WINDOW_MS, BATCH_WINDOW_BYTES, publish_batch);
+  bridge_init(uart_send, forward_to_mqtt);
+  for (unsigned int i = 0; i < SUBSCRIBED_TOPICS_COUNT; i++)
+  {
+    bridge_bind(SubscribedTopics[i]);
+  }
+  bridge_request_binds(); // Por si la Kinetis arranco antes
 }
 
-void setup_wifi(void) 
+
+void uart_send(const uint8_t * data, size_t len)
 {
-  /*
-  debug_message("\n\n");
-  debug_message("Connecting to ");
-  debug_message(ssid);
-  debug_message("\n");
-  */
-  WiFi.begin(ssid, password);
-  while (WiFi.status() != WL_CONNECTED) 
+  Serial.write(data, len);
+}
+
+
+void forward_to_mqtt(uint8_t topic_id, const uint8_t * payload, uint8_t len)
+{
+  batcher_add(topic_id, payload, len, millis());
+}
+
+
+void publish_batch(uint8_t topic_id, const uint8_t * payload, size_t len)
+{
+  const char * topic = bridge_remote_name(topic_id);
+  if (topic == NULL)
   {
-    delay(500);
-   // debug_message(".");
+    return;
+  }
+  // Si hay algo encolado va detras, para no desordenar
+  if (linkState != LINK_CONNECTED || storeForwardCount != 0 || !client.publish(topic, payload, len, false))
+  {
+    store_forward_push(topic_id, payload, len);
   }
-  /*
- debug_message("\nWiFi connected");  
- debug_message("IP address: ");
- debug_message(WiFi.localIP());
- debug_message("\n\n");
- */
- digitalWrite(External_LED,External_LED_ON); // WIFI is OK
 }
 
 
-void reconnect() 
+void store_forward_push(uint8_t topic_id, const uint8_t * payload, size_t len)
 {
- // Loop until we're reconnected
- while (!client.connected()) 
- {
- debug_message("Attempting MQTT connection...");
- // Attempt to connect
- if (client.connect(MqttClientID,MqttUser,MqttPassword)) 
- {
-  //debug_message("connected \r\n");
-  // ... and subscribe to topic
-  client.subscribe("myTopic"); 
-  client.subscribe("play"); 
-  client.subscribe("pause"); 
-  client.subscribe("level");
-  client.subscribe("player");  
-  client.subscribe("start");
-  client.subscribe("end");    
- } 
- else 
- {
-  delay(3000);
+  StoredPublish * entry;
+  if (storeForwardCount == STORE_FORWARD_LEN)
+  {
+    storeForwardHead = (storeForwardHead + 1) % STORE_FORWARD_LEN;
+    storeForwardCount--;
+    storeForwardDropped++;
   }
- }
+  entry = &storeForward[(storeForwardHead + storeForwardCount) % STORE_FORWARD_LEN];
+  entry->topicId = topic_id;
+  entry->tries = 0;
+  entry->len = (len > BATCH_MAX_BYTES)? BATCH_MAX_BYTES : len;
+  memcpy(entry->data, payload, entry->len);
+  storeForwardCount++;
 }
 
 
-void callback(char* topic, byte* payload, unsigned int length) 
+void store_forward_flush(void)
 {
-  for (int i=0;i<length;i++) 
+  while (storeForwardCount != 0)
   {
-   // debug_message((char)payload[i]);
+    StoredPublish * entry = &storeForward[storeForwardHead];
+    const char * topic = bridge_remote_name(entry->topicId);
+    if (topic != NULL && !client.publish(topic, entry->data, entry->len, false))
+    {
+      if (!client.connected() || ++entry->tries < STORE_FORWARD_MAX_TRIES)
+      {
+        break;  // Se corto o fallo una vez: queda para la proxima vuelta de loop()
+      }
+      storeForwardDropped++;  // Falla con conexion: se descarta para no trabar al resto de la cola
+    }
+    storeForwardHead = (storeForwardHead + 1) % STORE_FORWARD_LEN;
+    storeForwardCount--;
   }
-  //debug_message("\r\n");
-  client.publish("myAnswerTopic","chau",false); //answers
-  Serial.write(3);
-  ParseTopic(topic,payload,length);
 }
 
-void ParseTopic(char* topic, byte* payload, unsigned int length)
+
+void publish_batch_stats(void)
+{
+  batch_stats_t stats;
+  char msg[96];
+  batcher_get_stats(&stats);
+  snprintf(msg, sizeof(msg), "samples=%lu coalesced=%lu dropped=%lu publishes=%lu p50=%lu p90=%lu p99=%lu",
+           (unsigned long)stats.samples, (unsigned long)stats.coalesced, (unsigned long)stats.dropped,
+           (unsigned long)stats.publishes, (unsigned long)stats.p50_ms, (unsigned long)stats.p90_ms,
+           (unsigned long)stats.p99_ms);
+  client.publish("batchStats", msg, false);
+  snprintf(msg, sizeof(msg), "queued=%u dropped=%lu rejected=%lu", storeForwardCount, storeForwardDropped, bridgeRejected);
+  client.publish("storeForwardStats", msg, false);
+}
+
+
+void setup_mqtt(void) 
+{
+ client.setServer(MqttServer, MqttPort);
+ client.setCallback(callback);
+ client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+ wclient.setTimeout(MQTT_TCP_TIMEOUT_MS);
+}
+
+void setup_wifi(void) 
 {
-  if(!strcmp(topic,"level"))
+  linkState = LINK_WIFI_START;
+}
+
+
+void link_set_state(LinkState state)
+{
+  linkState = state;
+  linkStateMillis = millis();
+}
+
+
+void reconnect() 
+{
+ if (linkState != LINK_WIFI_START && linkState != LINK_WIFI_WAIT && WiFi.status() != WL_CONNECTED)
+ {
+  debug_message("WiFi lost\r\n");
+  digitalWrite(External_LED,External_LED_OFF);
+  link_set_state(LINK_WIFI_START);
+ }
+
+ switch (linkState)
+ {
+ case LINK_WIFI_START:
+  debug_message("Connecting to ");
+  debug_message(ssid);
+  debug_message("\n");
+  WiFi.begin(ssid, password);
+  link_set_state(LINK_WIFI_WAIT);
+  break;
+
+ case LINK_WIFI_WAIT:
+  if (WiFi.status() == WL_CONNECTED)
   {
-    //Serial.write(L);
-    Serial.write((char)payload[i]);
+   debug_message("WiFi connected\r\n");
+   digitalWrite(External_LED,External_LED_ON); // WIFI is OK
+   mqttBackoff = MQTT_BACKOFF_MIN_MS;
+   link_set_state(LINK_MQTT_CONNECT);
   }
-  else if(!strcmp(topic,"play"))
+  else if (millis() - linkStateMillis > WIFI_TIMEOUT_MS)
   {
-    Serial.write(P);
+   WiFi.disconnect();
+   link_set_state(LINK_WIFI_START);
   }
-  else if(!strcmp(topic,"pause"))
+  break;
+
+ case LINK_MQTT_CONNECT:
+  debug_message("Attempting MQTT connection...");
+  if (client.connect(MqttClientID,MqttUser,MqttPassword)) 
+  {
+   debug_message("connected \r\n");
+   for (unsigned int i = 0; i < SUBSCRIBED_TOPICS_COUNT; i++)
+   {
+    client.subscribe(SubscribedTopics[i]);
+   }
+   mqttBackoff = MQTT_BACKOFF_MIN_MS;
+   link_set_state(LINK_CONNECTED); // La cola sale desde loop()
+  } 
+  else 
   {
-    Serial.write(A);
+   debug_message("failed, rc=");
+   debug_message(client.state());
+   debug_message("\r\n");
+   link_set_state(LINK_MQTT_BACKOFF);
   }
-  else if(!strcmp(topic,"player"))
+  break;
+
+ case LINK_MQTT_BACKOFF:
+  if (millis() - linkStateMillis >= mqttBackoff)
   {
+   mqttBackoff = (mqttBackoff * 2 > MQTT_BACKOFF_MAX_MS)? MQTT_BACKOFF_MAX_MS : mqttBackoff * 2;
+   link_set_state(LINK_MQTT_CONNECT);
+  }
+  break;
 
+ case LINK_CONNECTED:
+  if (!client.connected())
+  {
+   link_set_state(LINK_MQTT_CONNECT);
   }
-  else if(!strcmp(topic,"start"))
+  break;
+ }
+}
+
+
+void callback(char* topic, byte* payload, unsigned int length) 
+{
+  client.publish("myAnswerTopic","chau",false); //answers
+  ParseTopic(topic,payload,length);
+}
+
+void ParseTopic(char* topic, byte* payload, unsigned int length)
+{
+  uint8_t id = bridge_find(topic);
+  if (id == BRIDGE_INVALID_ID)
   {
-    Serial.write(S);
+    return;
   }
-  else if(!strcmp(topic,"end"))
+  if (length > BRIDGE_MAX_PAYLOAD)
   {
-    Serial.write(E);
+    // No entra en una trama: se descarta entero en vez de mandar un mensaje cortado
+    char msg[64];
+    bridgeRejected++;
+    snprintf(msg, sizeof(msg), "%s: payload de %u bytes, maximo %u", topic, length, (unsigned int)BRIDGE_MAX_PAYLOAD);
+    client.publish("bridgeError", msg, false);
+    return;
   }
+  bridge_publish(id, payload, length);
 }
@@ -0,0 +1,161 @@
+/***************************************************************************//**
+  @file     test_batcher.c
+  @brief    Batcher windows, coalescing, drops and latency percentiles with a fake clock
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "batcher.h"
+#include "check.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static int flushes;
+static uint8_t flushed_id;
+static uint8_t flushed[BATCH_MAX_BYTES];
+static size_t flushed_len;
+
+static void on_flush(uint8_t topic_id, const uint8_t * payload, size_t len)
+{
+	flushes++;
+	flushed_id = topic_id;
+	flushed_len = len;
+	memcpy(flushed, payload, len);
+}
+
+static bool add(uint8_t topic_id, const char * sample, uint32_t now_ms)
+{
+	return batcher_add(topic_id, (const uint8_t *)sample, strlen(sample), now_ms);
+}
+
+static void test_time_window(void)
+{
+	batcher_init(100, BATCH_MAX_BYTES, on_flush);
+	flushes = 0;
+	add(2, "12", 1000);
+	add(2, "345", 1050);
+	batcher_poll(1099);
+	check(flushes == 0, "flushed before the window");
+	batcher_poll(1100);
+	check(flushes == 1 && flushed_id == 2, "flushed when the first sample's window expires");
+	check(flushed_len == 7 && !memcmp(flushed, "\x02" "12" "\x03" "345", 7), "length-prefixed samples");
+	batcher_poll(2000);
+	check(flushes == 1, "empty batch not published");
+}
+
+static void test_byte_window(void)
+{
+	int i;
+
+	batcher_init(1000, 10, on_flush);
+	flushes = 0;
+	add(0, "aaaa", 0);
+	check(flushes == 0, "flushed below the byte window");
+	add(0, "bbbb", 1);
+	check(flushes == 1 && flushed_len == 10, "flushed at the byte window");
+
+	// Ventana mas grande que el buffer: la corta BATCH_MAX_BYTES
+	batcher_init(1000, 10 * BATCH_MAX_BYTES, on_flush);
+	flushes = 0;
+	for(i = 0; flushes == 0; i++)
+		add(1, (i & 1) ? "0123456789" : "9876543210", 0);
+	check(flushed_len == (BATCH_MAX_BYTES / 11) * 11, "batch limited by BATCH_MAX_BYTES");
+}
+
+static void test_coalescing(void)
+{
+	batch_stats_t stats;
+	uint8_t big[BATCH_MAX_BYTES];
+	int i;
+
+	batcher_init(100, BATCH_MAX_BYTES, on_flush);
+	flushes = 0;
+	check(add(3, "7", 0) && add(3, "7", 1) && add(3, "8", 2) && add(3, "7", 3), "samples accepted");
+	batcher_flush_all(10);
+	check(flushes == 1 && flushed_len == 6 && !memcmp(flushed, "\x01" "7" "\x01" "8" "\x01" "7", 6),
+			"only consecutive repeats coalesced");
+
+	// Una repetida en una ventana nueva si se publica
+	add(3, "7", 20);
+	batcher_flush_all(30);
+	check(flushes == 2 && flushed_len == 2, "repeat after a publish kept");
+
+	// Mas muestras que BATCH_MAX_SAMPLES: se publica y arranca otra ventana
+	for(i = 0; i < BATCH_MAX_SAMPLES + 1; i++)
+	{
+		big[0] = i;
+		batcher_add(4, big, 1, 40);
+	}
+	check(flushes == 3 && flushed_len == 2 * BATCH_MAX_SAMPLES, "batch limited by BATCH_MAX_SAMPLES");
+
+	check(!batcher_add(BATCH_MAX_TOPICS, big, 1, 50), "invalid topic accepted");
+	check(!batcher_add(5, big, BATCH_MAX_BYTES, 50), "sample larger than a batch accepted");
+	batcher_get_stats(&stats);
+	check(stats.samples == 4 + BATCH_MAX_SAMPLES + 1 && stats.coalesced == 1 && stats.dropped == 2 &&
+			stats.publishes == 3, "counters");
+}
+
+static void test_percentiles(void)
+{
+	batch_stats_t stats;
+	uint32_t t;
+	char sample[4];
+
+	// Una muestra cada 10 ms con ventana de 200 ms: 20 latencias parejas de 10 a 200
+	batcher_init(200, BATCH_MAX_BYTES, on_flush);
+	for(t = 0; t < 100000; t++)
+	{
+		batcher_poll(t); // La ventana vence antes de agregar la muestra del mismo ms
+		if(t % 10 == 0)
+		{
+			snprintf(sample, sizeof(sample), "%u", (unsigned int)(t / 10 % 100));
+			add(0, sample, t);
+		}
+	}
+	batcher_get_stats(&stats);
+	// El histograma da la cota superior de la barra
+	check(stats.p50_ms > 100 && stats.p50_ms <= 100 + BATCH_HIST_STEP_MS, "p50");
+	check(stats.p90_ms > 180 && stats.p90_ms <= 180 + BATCH_HIST_STEP_MS, "p90");
+	check(stats.p99_ms > 200 && stats.p99_ms <= 200 + BATCH_HIST_STEP_MS, "p99");
+	check(stats.p50_ms <= stats.p90_ms && stats.p90_ms <= stats.p99_ms, "percentiles in order");
+}
+
+// Compromiso latencia / publishes para distintas ventanas, con muestras de 4 bytes a 50 Hz
+static void print_tradeoff(void)
+{
+	static const uint32_t windows[] = {10, 50, 100, 250, 500};
+	batch_stats_t stats;
+	unsigned int w;
+	uint32_t t;
+	char sample[8];
+
+	printf("  window_ms  publishes/s  p50_ms  p99_ms\n");
+	for(w = 0; w < sizeof(windows) / sizeof(windows[0]); w++)
+	{
+		batcher_init(windows[w], BATCH_MAX_BYTES, NULL);
+		srand(1);
+		for(t = 0; t < 60000; t++)
+		{
+			batcher_poll(t);
+			if(t % 20 == 0)
+			{
+				snprintf(sample, sizeof(sample), "%04d", rand() % 1000);
+				add(0, sample, t);
+			}
+		}
+		batcher_get_stats(&stats);
+		printf("  %9u  %11u  %6u  %6u\n", (unsigned int)windows[w], (unsigned int)(stats.publishes / 60),
+				(unsigned int)stats.p50_ms, (unsigned int)stats.p99_ms);
+	}
+}
+
+int main(void)
+{
+	test_time_window();
+	test_byte_window();
+	test_coalescing();
+	test_percentiles();
+	print_tradeoff();
+
+	return check_report();
+}
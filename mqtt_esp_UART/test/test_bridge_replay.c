@@ -0,0 +1,275 @@
+/***************************************************************************//**
+  @file     test_bridge_replay.c
+  @brief    ESP side of the bridge replaying a Kinetis UART capture against a fake MQTT broker
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "frame.h"
+#include "bridge.h"
+#include "batcher.h"
+#include "check.h"
+#include <string.h>
+
+/*
+ * El broker de mentira sigue las reglas de mosquitto que le importan al sketch: el topic de un
+ * publish no puede estar vacio ni tener comodines, los filtros de subscribe aceptan + y #, y un
+ * mensaje le llega a todos los clientes suscriptos. No hay TCP: PubSubClient y ESP8266WiFi solo
+ * compilan para el ESP, asi que la parte del .ino que se prueba esta copiada abajo (esp_*).
+ */
+
+#define BROKER_MAX_SUBS		16
+#define BROKER_MAX_MSGS		32
+#define BROKER_MAX_TOPIC	64
+
+#define BATCH_WINDOW_MS		200
+#define BATCH_WINDOW_BYTES	100
+
+typedef enum {CLIENT_ESP, CLIENT_OBSERVER} client_t; // El observador es un mosquitto_sub -t '#'
+
+typedef struct {
+	char topic[BROKER_MAX_TOPIC];
+	uint8_t payload[BATCH_MAX_BYTES];
+	size_t len;
+} broker_msg_t;
+
+static uint32_t now_ms;
+
+static struct {
+	client_t client;
+	char filter[BROKER_MAX_TOPIC];
+} subs[BROKER_MAX_SUBS];
+static int sub_count;
+static broker_msg_t observed[BROKER_MAX_MSGS];
+static int observed_count, rejected_publishes;
+
+// Lo que el ESP manda por el UART, visto desde la Kinetis
+static frame_decoder_t kinetis_dec;
+static int kinetis_binds, kinetis_requests, kinetis_publishes;
+static uint8_t kinetis_id, kinetis_len, kinetis_payload[FRAME_MAX_PAYLOAD];
+
+static frame_decoder_t esp_dec;
+static const char * const esp_topics[] = {"myTopic", "play", "pause", "level", "player", "start", "end"};
+#define ESP_TOPICS_COUNT	(sizeof(esp_topics) / sizeof(esp_topics[0]))
+
+// Captura del UART de la Kinetis: arranca a mitad de una trama y tiene una trama con un byte cambiado
+static const uint8_t kinetis_capture[] = {
+	0x31, 0x32, 0x08, 0x80, 0x00,	// Final de una trama anterior al arranque del ESP
+	0x02, 0x22, 0x03, 0x7D, 0x8B, 0x00,	// BIND_REQUEST
+	0x03, 0x20, 0x05, 0x07, 0x74, 0x65, 0x6D, 0x70, 0x27, 0xC7, 0x00,	// BIND 0 temp
+	0x0D, 0x20, 0x08, 0x01, 0x62, 0x61, 0x74, 0x74, 0x65, 0x72, 0x79, 0x92, 0x43, 0x00,	// BIND 1 battery
+	0x03, 0x21, 0x03, 0x05, 0x31, 0x32, 0x08, 0x80, 0x00,	// PUBLISH 0 "12"
+	0x03, 0x21, 0x03, 0x05, 0x31, 0x32, 0x08, 0x80, 0x00,	// PUBLISH 0 "12", repetida
+	0x08, 0x21, 0x03, 0x01, 0x32, 0x34, 0x1A, 0x04, 0x00,	// PUBLISH 1 "25" con el dato cambiado: la descarta el CRC
+	0x08, 0x21, 0x03, 0x01, 0x32, 0x35, 0x1A, 0x04, 0x00,	// PUBLISH 1 "25"
+	0x03, 0x21, 0x03, 0x05, 0x31, 0x33, 0x18, 0xA1, 0x00,	// PUBLISH 0 "13"
+	0x08, 0x21, 0x03, 0x01, 0x32, 0x36, 0x2A, 0x67, 0x00,	// PUBLISH 1 "26"
+};
+
+static void esp_callback(const char * topic, const uint8_t * payload, size_t len);
+
+/*******************************************************************************
+ * Broker
+ ******************************************************************************/
+
+static bool topic_matches(const char * filter, const char * topic)
+{
+	while(*filter != '\0')
+	{
+		if(*filter == '#')
+			return true;
+		if(*filter == '+')
+		{
+			while(*topic != '\0' && *topic != '/')
+				topic++;
+			filter++;
+		}
+		else if(*filter++ != *topic++)
+		{
+			return false;
+		}
+	}
+	return *topic == '\0';
+}
+
+static void broker_subscribe(client_t client, const char * filter)
+{
+	subs[sub_count].client = client;
+	strcpy(subs[sub_count].filter, filter);
+	sub_count++;
+}
+
+static bool broker_publish(const char * topic, const uint8_t * payload, size_t len)
+{
+	broker_msg_t * msg;
+	int i;
+
+	if(*topic == '\0' || strpbrk(topic, "+#") != NULL || len > BATCH_MAX_BYTES)
+	{
+		rejected_publishes++;
+		return false;
+	}
+	for(i = 0; i < sub_count; i++)
+	{
+		if(!topic_matches(subs[i].filter, topic))
+			continue;
+		if(subs[i].client == CLIENT_ESP)
+		{
+			esp_callback(topic, payload, len);
+		}
+		else if(observed_count < BROKER_MAX_MSGS)
+		{
+			msg = &observed[observed_count++];
+			strcpy(msg->topic, topic);
+			memcpy(msg->payload, payload, len);
+			msg->len = len;
+		}
+	}
+	return true;
+}
+
+static const broker_msg_t * observed_on(const char * topic)
+{
+	int i;
+
+	for(i = observed_count - 1; i >= 0; i--)
+		if(!strcmp(observed[i].topic, topic))
+			return &observed[i];
+	return NULL;
+}
+
+/*******************************************************************************
+ * Lado del ESP, como en mqtt_esp_UART.ino con la conexion arriba
+ ******************************************************************************/
+
+static void on_kinetis_frame(uint8_t type, const uint8_t * payload, uint8_t len)
+{
+	kinetis_binds += (type == FRAME_TYPE_BIND);
+	kinetis_requests += (type == FRAME_TYPE_BIND_REQUEST);
+	if(type == FRAME_TYPE_PUBLISH)
+	{
+		kinetis_publishes++;
+		kinetis_id = payload[0];
+		kinetis_len = len - 1;
+		memcpy(kinetis_payload, &payload[1], len - 1);
+	}
+}
+
+static void esp_uart_send(const uint8_t * data, size_t len)
+{
+	frame_decode(&kinetis_dec, data, len, on_kinetis_frame);
+}
+
+static void esp_forward_to_mqtt(uint8_t topic_id, const uint8_t * payload, uint8_t len)
+{
+	batcher_add(topic_id, payload, len, now_ms);
+}
+
+static void esp_publish_batch(uint8_t topic_id, const uint8_t * payload, size_t len)
+{
+	const char * topic = bridge_remote_name(topic_id);
+
+	if(topic != NULL)
+		broker_publish(topic, payload, len);
+}
+
+static void esp_callback(const char * topic, const uint8_t * payload, size_t len)
+{
+	uint8_t id = bridge_find(topic);
+
+	if(id == BRIDGE_INVALID_ID)
+		return;
+	if(len > BRIDGE_MAX_PAYLOAD)
+	{
+		broker_publish("bridgeError", (const uint8_t *)topic, strlen(topic));
+		return;
+	}
+	bridge_publish(id, payload, len);
+}
+
+static void esp_setup(void)
+{
+	unsigned int i;
+
+	frame_decoder_init(&esp_dec);
+	batcher_init(BATCH_WINDOW_MS, BATCH_WINDOW_BYTES, esp_publish_batch);
+	bridge_init(esp_uart_send, esp_forward_to_mqtt);
+	for(i = 0; i < ESP_TOPICS_COUNT; i++)
+		bridge_bind(esp_topics[i]);
+	bridge_request_binds();
+	for(i = 0; i < ESP_TOPICS_COUNT; i++)
+		broker_subscribe(CLIENT_ESP, esp_topics[i]);
+}
+
+// A 9600 baudios llega un byte por milisegundo
+static void esp_loop_uart(const uint8_t * data, size_t len)
+{
+	while(len--)
+	{
+		frame_decode(&esp_dec, data++, 1, bridge_handle_frame);
+		now_ms++;
+		batcher_poll(now_ms);
+	}
+}
+
+/*******************************************************************************
+ * Tests
+ ******************************************************************************/
+
+static void test_startup(void)
+{
+	frame_decoder_init(&kinetis_dec);
+	broker_subscribe(CLIENT_OBSERVER, "#");
+	esp_setup();
+	check(kinetis_binds == ESP_TOPICS_COUNT && kinetis_requests == 1, "BINDs and BIND_REQUEST on startup");
+}
+
+static void test_kinetis_to_broker(void)
+{
+	static const uint8_t temp[] = {2, '1', '2', 2, '1', '3'};
+	static const uint8_t battery[] = {2, '2', '5', 2, '2', '6'};
+	const broker_msg_t * msg;
+
+	kinetis_binds = 0;
+	esp_loop_uart(kinetis_capture, sizeof(kinetis_capture));
+	check(kinetis_binds == ESP_TOPICS_COUNT, "BIND_REQUEST from the Kinetis answered with every BIND");
+	check(esp_dec.frames_error == 2 && esp_dec.frames_ok == 8, "partial and corrupted frames rejected");
+	check(observed_count == 0, "nothing published before the window");
+
+	now_ms += BATCH_WINDOW_MS;
+	batcher_poll(now_ms);
+	check(observed_count == 2, "one publish per topic");
+	msg = observed_on("temp");
+	check(msg != NULL && msg->len == sizeof(temp) && !memcmp(msg->payload, temp, sizeof(temp)),
+			"temp batch, repeated sample coalesced");
+	msg = observed_on("battery");
+	check(msg != NULL && msg->len == sizeof(battery) && !memcmp(msg->payload, battery, sizeof(battery)),
+			"battery batch without the corrupted sample");
+	check(rejected_publishes == 0, "topic names accepted by the broker");
+}
+
+static void test_broker_to_kinetis(void)
+{
+	uint8_t big[BRIDGE_MAX_PAYLOAD + 1] = {0};
+
+	check(broker_publish("play", (const uint8_t *)"1", 1), "publish on play");
+	check(kinetis_publishes == 1 && kinetis_id == bridge_find("play") && kinetis_len == 1 && kinetis_payload[0] == '1',
+			"play forwarded to the Kinetis with its id");
+
+	broker_publish("volume", (const uint8_t *)"5", 1);
+	check(kinetis_publishes == 1, "topic the ESP didn't subscribe not forwarded");
+
+	broker_publish("level", big, sizeof(big));
+	check(kinetis_publishes == 1, "payload above BRIDGE_MAX_PAYLOAD not forwarded");
+	check(observed_on("bridgeError") != NULL, "oversized payload reported on bridgeError");
+
+	check(!broker_publish("play/#", (const uint8_t *)"1", 1), "wildcard topic rejected by the broker");
+}
+
+int main(void)
+{
+	test_startup();
+	test_kinetis_to_broker();
+	test_broker_to_kinetis();
+
+	return check_report();
+}
@@ -0,0 +1,31 @@
+/***************************************************************************//**
+  @file     check.c
+  @brief    Failure counting shared by the host tests of every project
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "check.h"
+#include <stdarg.h>
+#include <stdio.h>
+
+static int failures;
+
+void check(bool ok, const char * what, ...)
+{
+	va_list args;
+
+	if(ok)
+		return;
+	va_start(args, what);
+	printf("  FAIL ");
+	vprintf(what, args);
+	printf("\n");
+	va_end(args);
+	failures++;
+}
+
+int check_report(void)
+{
+	printf("%s: %d failures\n", failures ? "FAIL" : "OK", failures);
+	return failures != 0;
+}
@@ -0,0 +1,24 @@
+/***************************************************************************//**
+  @file     check.h
+  @brief    Failure counting shared by the host tests of every project
+  @author   Grupo 2
+ ******************************************************************************/
+
+#ifndef _CHECK_H_
+#define _CHECK_H_
+
+#include <stdbool.h>
+
+/**
+ * @brief Counts a failure and prints it when ok is false
+ * @param what printf format of the failure message, followed by its arguments
+*/
+void check(bool ok, const char * what, ...) __attribute__((format(printf, 2, 3)));
+
+/**
+ * @brief Prints "OK: 0 failures" or "FAIL: N failures"
+ * @return Exit code for main, 0 without failures
+*/
+int check_report(void);
+
+#endif /* _CHECK_H_ */
@@ -0,0 +1,131 @@
+/***************************************************************************//**
+  @file     hardware.h
+  @brief    Host replacement for startup/hardware.h, shared by the tests of every project
+  @author   Grupo 2
+ ******************************************************************************/
+
+#ifndef _HARDWARE_H_
+#define _HARDWARE_H_
+
+/*******************************************************************************
+ * INCLUDE HEADER FILES
+ ******************************************************************************/
+
+#include <stdint.h>
+#include <stdbool.h>
+
+// core_cm4.h solo compila para ARM: se saltea y lo que usan los drivers lo da host.c
+#define __CORE_CM4_H_GENERIC
+#define __CORE_CM4_H_DEPENDANT
+#define __I		volatile const
+#define __O		volatile
+#define __IO	volatile
+#define __IM	volatile const
+#define __OM	volatile
+#define __IOM	volatile
+
+#include "fsl_device_registers.h"
+
+
+/*******************************************************************************
+ * CONSTANT AND MACRO DEFINITIONS USING #DEFINE
+ ******************************************************************************/
+
+#define __CORE_CLOCK__  100000000U
+#define __FOREVER__     for(;;)
+#define __ISR__         void
+
+// Los perifericos que tocan los drivers son RAM del host: los tests hacen de bus leyendo y escribiendo los registros
+#undef SIM_BASE
+#undef PIT_BASE
+#undef PORTA_BASE
+#undef PORTB_BASE
+#undef PORTC_BASE
+#undef PORTD_BASE
+#undef PORTE_BASE
+#undef GPIOA_BASE
+#undef GPIOB_BASE
+#undef GPIOC_BASE
+#undef GPIOD_BASE
+#undef GPIOE_BASE
+#undef UART0_BASE
+#undef UART1_BASE
+#undef UART2_BASE
+#undef UART3_BASE
+#undef UART4_BASE
+#undef UART5_BASE
+#undef I2C0_BASE
+#undef I2C1_BASE
+#undef I2C2_BASE
+#undef SPI0_BASE
+#undef SPI1_BASE
+#undef SPI2_BASE
+#undef DMA_BASE
+#undef DMAMUX_BASE
+#define SIM_BASE	((uintptr_t)&host_sim)
+#define PIT_BASE	((uintptr_t)&host_pit)
+#define PORTA_BASE	((uintptr_t)&host_port[0])
+#define PORTB_BASE	((uintptr_t)&host_port[1])
+#define PORTC_BASE	((uintptr_t)&host_port[2])
+#define PORTD_BASE	((uintptr_t)&host_port[3])
+#define PORTE_BASE	((uintptr_t)&host_port[4])
+#define GPIOA_BASE	((uintptr_t)&host_gpio[0])
+#define GPIOB_BASE	((uintptr_t)&host_gpio[1])
+#define GPIOC_BASE	((uintptr_t)&host_gpio[2])
+#define GPIOD_BASE	((uintptr_t)&host_gpio[3])
+#define GPIOE_BASE	((uintptr_t)&host_gpio[4])
+#define UART0_BASE	((uintptr_t)&host_uart[0])
+#define UART1_BASE	((uintptr_t)&host_uart[1])
+#define UART2_BASE	((uintptr_t)&host_uart[2])
+#define UART3_BASE	((uintptr_t)&host_uart[3])
+#define UART4_BASE	((uintptr_t)&host_uart[4])
+#define UART5_BASE	((uintptr_t)&host_uart[5])
+#define I2C0_BASE	((uintptr_t)&host_i2c[0])
+#define I2C1_BASE	((uintptr_t)&host_i2c[1])
+#define I2C2_BASE	((uintptr_t)&host_i2c[2])
+#define SPI0_BASE	((uintptr_t)&host_spi[0])
+#define SPI1_BASE	((uintptr_t)&host_spi[1])
+#define SPI2_BASE	((uintptr_t)&host_spi[2])
+#define DMA_BASE	((uintptr_t)&host_dma)
+#define DMAMUX_BASE	((uintptr_t)&host_dmamux)
+
+#define __DMB()		__sync_synchronize()
+
+
+/*******************************************************************************
+ * VARIABLE PROTOTYPES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+extern SIM_Type host_sim;
+extern PIT_Type host_pit;
+extern PORT_Type host_port[5];
+extern GPIO_Type host_gpio[5];
+extern UART_Type host_uart[6];
+extern I2C_Type host_i2c[3];
+extern SPI_Type host_spi[3];
+extern DMA_Type host_dma;
+extern DMAMUX_Type host_dmamux;
+extern uint32_t host_primask;		// 1 mientras las interrupciones estan enmascaradas
+extern uint32_t host_nvic_enabled[4];
+extern uint32_t host_nvic_pending[4];
+
+
+/*******************************************************************************
+ * FUNCTION PROTOTYPES WITH GLOBAL SCOPE
+ ******************************************************************************/
+
+void hw_Init (void);
+void hw_EnableInterrupts (void);
+void hw_DisableInterrupts (void);
+
+void __enable_irq(void);
+void __disable_irq(void);
+uint32_t __get_PRIMASK(void);
+void __set_PRIMASK(uint32_t primask);
+
+void NVIC_EnableIRQ(IRQn_Type IRQn);
+void NVIC_DisableIRQ(IRQn_Type IRQn);
+uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn);
+void NVIC_SetPendingIRQ(IRQn_Type IRQn);
+
+#endif /* _HARDWARE_H_ */
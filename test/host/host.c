@@ -0,0 +1,34 @@
+/***************************************************************************//**
+  @file     host.c
+  @brief    Registers and core functions of the host replacement for hardware.h
+  @author   Grupo 2
+ ******************************************************************************/
+
+#include "hardware.h"
+
+SIM_Type host_sim;
+PIT_Type host_pit;
+PORT_Type host_port[5];
+GPIO_Type host_gpio[5];
+UART_Type host_uart[6];
+I2C_Type host_i2c[3];
+SPI_Type host_spi[3];
+DMA_Type host_dma;
+DMAMUX_Type host_dmamux;
+uint32_t host_primask;
+uint32_t host_nvic_enabled[4];
+uint32_t host_nvic_pending[4];
+
+void hw_Init (void) {}
+void hw_EnableInterrupts (void) { host_primask = 0; }
+void hw_DisableInterrupts (void) { host_primask = 1; }
+
+void __enable_irq(void) { host_primask = 0; }
+void __disable_irq(void) { host_primask = 1; }
+uint32_t __get_PRIMASK(void) { return host_primask; }
+void __set_PRIMASK(uint32_t primask) { host_primask = primask; }
+
+void NVIC_EnableIRQ(IRQn_Type IRQn) { host_nvic_enabled[IRQn >> 5] |= 1U << (IRQn & 0x1F); }
+void NVIC_DisableIRQ(IRQn_Type IRQn) { host_nvic_enabled[IRQn >> 5] &= ~(1U << (IRQn & 0x1F)); }
+uint32_t NVIC_GetEnableIRQ(IRQn_Type IRQn) { return (host_nvic_enabled[IRQn >> 5] >> (IRQn & 0x1F)) & 1U; }
+void NVIC_SetPendingIRQ(IRQn_Type IRQn) { host_nvic_pending[IRQn >> 5] |= 1U << (IRQn & 0x1F); }
@@ -0,0 +1,32 @@
+# Reglas comunes de los tests que corren en la PC (gcc del host, no el de MCUXpresso)
+# El Makefile de cada test/ define TESTS, SUPPORT y sus CFLAGS, y despues incluye este archivo.
+#   make        compila y corre todos los tests
+#   make clean
+
+TEST_DIR := $(patsubst %/,%,$(dir $(lastword $(MAKEFILE_LIST))))
+
+CC = gcc
+# Van antes que los CFLAGS del proyecto: host/hardware.h le gana al de startup/
+TEST_CFLAGS = -std=gnu11 -Wall -g -I$(TEST_DIR)
+BUILD = build
+
+# check.c siempre; host/ solo si el Makefile lo pide con HOST_HW = 1 (los drivers que tocan registros)
+SUPPORT += $(TEST_DIR)/check.c
+ifeq ($(HOST_HW),1)
+TEST_CFLAGS += -Wno-int-conversion -Wno-pointer-to-int-cast -DCPU_MK64FN1M0VLL12 -I$(TEST_DIR)/host
+SUPPORT += $(TEST_DIR)/host/host.c
+DEPS += $(TEST_DIR)/host/hardware.h
+endif
+
+.PHONY: test clean
+test: $(addprefix $(BUILD)/,$(TESTS))
+	@for t in $^; do echo "== $$t"; ./$$t || exit 1; done
+
+$(BUILD)/%: %.c $(SUPPORT) $(DEPS) | $(BUILD)
+	$(CC) $(TEST_CFLAGS) $(CFLAGS) -o $@ $< $(SUPPORT) $(LDLIBS)
+
+$(BUILD):
+	mkdir -p $@
+
+clean:
+	rm -rf $(BUILD)